@@ -0,0 +1,539 @@
+#include "detab.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../common/bits.h"
+
+#ifdef DETAB_HAS_WRITEV
+#include <errno.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#ifdef DETAB_HAS_THREADS
+#include <pthread.h>
+#endif
+
+// The straightforward byte-at-a-time expansion, kept as the reference for the block kernel below. Returns the number of
+// bytes written to `result`.
+size_t detab_piece_scalar(TabStops* tab_stops, DisplayColumn* column, char* piece, size_t piece_size, char* result)
+{
+    size_t result_i = 0;
+    for (size_t i = 0; i < piece_size; i++)
+    {
+        if (piece[i] == '\t')
+        {
+            size_t spaces_count = get_next_tab_stop(tab_stops, column->column) - column->column;
+            for (size_t j = 0; j < spaces_count; j++) { result[result_i++] = ' '; }
+            column->column += spaces_count;
+            column->utf8_decoder.remaining_size = 0;
+        }
+        else if (piece[i] == '\n')
+        {
+            result[result_i++] = '\n';
+            *column = make_display_column(0);
+        }
+        else
+        {
+            result[result_i++] = piece[i];
+            column->column += advance_utf8_decoder(&column->utf8_decoder, (unsigned char)piece[i]);
+        }
+    }
+    return result_i;
+}
+
+// The block kernel looks at 64 bytes at a time and gets bitmasks of their tabs and newlines. Runs of other bytes are
+// copied in 16-byte moves and tabs are filled with 16-byte stores of spaces of which only the needed part is kept.
+// Both of these can go past the end of what they need: stores by up to `DETAB_OVERSTORE_SIZE` bytes past the output,
+// loads by up to `DETAB_OVERSTORE_SIZE` bytes past the current block, so blocks are only processed while that much
+// input is still readable after them. That counts a column per byte, so blocks with non-ASCII bytes, which can be
+// parts of UTF-8 sequences, go through the byte-at-a-time expansion instead.
+void scan_tab_block_scalar(char* block, uint64_t* tabs, uint64_t* newlines)
+{
+    *tabs = 0;
+    *newlines = 0;
+    for (int i = 0; i < DETAB_SCAN_BLOCK_SIZE; i++)
+    {
+        if (block[i] == '\t') { *tabs |= (uint64_t)1 << i; }
+        else if (block[i] == '\n') { *newlines |= (uint64_t)1 << i; }
+    }
+}
+
+#ifdef DETAB_HAS_SIMD
+#include <immintrin.h>
+
+void scan_tab_block_sse2(char* block, uint64_t* tabs, uint64_t* newlines)
+{
+    *tabs = 0;
+    *newlines = 0;
+    for (int offset = 0; offset < DETAB_SCAN_BLOCK_SIZE; offset += 16)
+    {
+        __m128i bytes = _mm_loadu_si128((__m128i*)(block + offset));
+        *tabs |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('\t'))) << offset;
+        *newlines |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('\n'))) << offset;
+    }
+}
+
+__attribute__((target("avx2")))
+void scan_tab_block_avx2(char* block, uint64_t* tabs, uint64_t* newlines)
+{
+    *tabs = 0;
+    *newlines = 0;
+    for (int offset = 0; offset < DETAB_SCAN_BLOCK_SIZE; offset += 32)
+    {
+        __m256i bytes = _mm256_loadu_si256((__m256i*)(block + offset));
+        *tabs |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\t'))) << offset;
+        *newlines |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\n')))
+            << offset;
+    }
+}
+#endif
+
+ScanTabBlockFunction select_scan_tab_block_function()
+{
+#ifdef DETAB_HAS_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) { return scan_tab_block_avx2; }
+    return scan_tab_block_sse2;
+#else
+    return scan_tab_block_scalar;
+#endif
+}
+
+int get_available_scan_tab_block_functions(ScanTabBlockFunction* functions, char** names)
+{
+    int result = 0;
+    functions[result] = scan_tab_block_scalar;
+    names[result++] = "scalar";
+#ifdef DETAB_HAS_SIMD
+    functions[result] = scan_tab_block_sse2;
+    names[result++] = "SSE2";
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        functions[result] = scan_tab_block_avx2;
+        names[result++] = "AVX2";
+    }
+#endif
+    return result;
+}
+
+ScanTabBlockFunction scan_tab_block = NULL;
+
+// Keeps a scanner that was swapped in before the first use
+void select_scan_tab_block() { if (scan_tab_block == NULL) { scan_tab_block = select_scan_tab_block_function(); } }
+
+#ifdef DETAB_HAS_THREADS
+pthread_once_t scan_tab_block_selection = PTHREAD_ONCE_INIT;
+#endif
+
+// Picks the scanner on first use, only once even when several threads detab at the same time
+void select_scan_tab_block_once()
+{
+#ifdef DETAB_HAS_THREADS
+    pthread_once(&scan_tab_block_selection, select_scan_tab_block);
+#else
+    select_scan_tab_block();
+#endif
+}
+
+char detab_spaces[DETAB_OVERSTORE_SIZE] = "                ";
+
+// Copies `size` bytes in 16-byte moves, so it can read and write up to 15 bytes more than asked for
+void copy_detab_run(char* destination, char* source, size_t size)
+{
+    for (size_t i = 0; i < size; i += DETAB_OVERSTORE_SIZE)
+    { memcpy(destination + i, source + i, DETAB_OVERSTORE_SIZE); }
+}
+
+// Same contract as `detab_piece_scalar`, except that `readable_size` bytes starting at `piece` have to be readable
+// (where `readable_size >= piece_size`) and `result` needs `DETAB_OVERSTORE_SIZE` bytes of room past the output. It
+// gets a copy for each type of tab stops, so that working out where a tab ends costs a shift or a table lookup.
+TAB_STOPS_SPECIALIZED size_t detab_piece_with_tab_stops_type(
+    TabStopsType tab_stops_type,
+    TabStops* tab_stops,
+    DisplayColumn* column,
+    char* piece,
+    size_t piece_size,
+    size_t readable_size,
+    char* result
+)
+{
+    select_scan_tab_block_once();
+    size_t result_i = 0;
+    size_t i = 0;
+    while (i + DETAB_SCAN_BLOCK_SIZE <= piece_size && i + DETAB_SCAN_BLOCK_SIZE + DETAB_OVERSTORE_SIZE <= readable_size)
+    {
+        if (!is_ascii_block(piece + i))
+        { // bytes of UTF-8 sequences aren't a column each, such blocks are expanded a byte at a time
+            result_i += detab_piece_scalar(tab_stops, column, piece + i, DETAB_SCAN_BLOCK_SIZE, result + result_i);
+            i += DETAB_SCAN_BLOCK_SIZE;
+            continue;
+        }
+        column->utf8_decoder.remaining_size = 0;
+        uint64_t tabs;
+        uint64_t newlines;
+        scan_tab_block(piece + i, &tabs, &newlines);
+        uint64_t specials = tabs | newlines;
+        size_t run_start = i;
+        while (specials != 0)
+        {
+            size_t position = i + count_trailing_zeros(specials);
+            specials &= specials - 1;
+            size_t run_size = position - run_start;
+            copy_detab_run(result + result_i, piece + run_start, run_size);
+            result_i += run_size;
+            if (piece[position] == '\t')
+            {
+                size_t tab_column = column->column + run_size;
+                size_t spaces_count = NEXT_TAB_STOP(tab_stops_type, tab_stops, tab_column) - tab_column;
+                for (size_t j = 0; j < spaces_count; j += DETAB_OVERSTORE_SIZE)
+                { memcpy(result + result_i + j, detab_spaces, DETAB_OVERSTORE_SIZE); }
+                result_i += spaces_count;
+                column->column = tab_column + spaces_count;
+            }
+            else
+            {
+                result[result_i++] = '\n';
+                column->column = 0;
+            }
+            run_start = position + 1;
+        }
+        size_t run_size = i + DETAB_SCAN_BLOCK_SIZE - run_start;
+        copy_detab_run(result + result_i, piece + run_start, run_size);
+        result_i += run_size;
+        column->column += run_size;
+        i += DETAB_SCAN_BLOCK_SIZE;
+    }
+    return result_i + detab_piece_scalar(tab_stops, column, piece + i, piece_size - i, result + result_i);
+}
+
+size_t detab_piece_power_of_two(
+    TabStops* tab_stops,
+    DisplayColumn* column,
+    char* piece,
+    size_t piece_size,
+    size_t readable_size,
+    char* result
+)
+{
+    return detab_piece_with_tab_stops_type(
+        TabStopsTypePowerOfTwo,
+        tab_stops,
+        column,
+        piece,
+        piece_size,
+        readable_size,
+        result
+    );
+}
+
+size_t detab_piece_uniform(
+    TabStops* tab_stops,
+    DisplayColumn* column,
+    char* piece,
+    size_t piece_size,
+    size_t readable_size,
+    char* result
+)
+{
+    return detab_piece_with_tab_stops_type(
+        TabStopsTypeUniform,
+        tab_stops,
+        column,
+        piece,
+        piece_size,
+        readable_size,
+        result
+    );
+}
+
+size_t detab_piece_list(
+    TabStops* tab_stops,
+    DisplayColumn* column,
+    char* piece,
+    size_t piece_size,
+    size_t readable_size,
+    char* result
+)
+{
+    return detab_piece_with_tab_stops_type(
+        TabStopsTypeList,
+        tab_stops,
+        column,
+        piece,
+        piece_size,
+        readable_size,
+        result
+    );
+}
+
+DetabPieceFunction select_detab_piece_function(TabStops* tab_stops)
+{
+    switch (tab_stops->type)
+    {
+        case TabStopsTypePowerOfTwo: return detab_piece_power_of_two;
+        case TabStopsTypeUniform: return detab_piece_uniform;
+        case TabStopsTypeList: return detab_piece_list;
+    }
+    return detab_piece_list;
+}
+
+DetabState make_detab_state(TabStops* tab_stops)
+{
+    DetabState result;
+    result.column = make_display_column(0);
+    result.tab_stops = tab_stops;
+    result.detab_piece = select_detab_piece_function(tab_stops);
+    return result;
+}
+
+// Expands the tabs of the next part of the input into the output. The column is carried over in the state, so the
+// input can be split anywhere.
+void detab_chunk(DetabState* state, char* chunk, size_t chunk_size, OutputBuffer* output)
+{
+    size_t chunk_i = 0;
+    while (chunk_i < chunk_size)
+    {
+        // every input byte becomes at most as many output bytes as the widest tab, so reserve for the worst case one
+        // piece at a time, with pieces small enough that the worst case stays around the input block size
+        size_t remaining_size = chunk_size - chunk_i;
+        size_t max_piece_size = DETAB_INPUT_BLOCK_SIZE / state->tab_stops->max_distance;
+        if (max_piece_size == 0) { max_piece_size = 1; }
+        size_t piece_size = remaining_size < max_piece_size ? remaining_size : max_piece_size;
+        char* result = reserve_output(output, piece_size * state->tab_stops->max_distance + DETAB_OVERSTORE_SIZE);
+        output->size += state->detab_piece(
+            state->tab_stops,
+            &state->column,
+            chunk + chunk_i,
+            piece_size,
+            remaining_size,
+            result
+        );
+        chunk_i += piece_size;
+    }
+}
+
+char* detab(char* input, size_t input_size, TabStops* tab_stops)
+{
+    OutputBuffer output = make_output_buffer(NULL);
+    DetabState state = make_detab_state(tab_stops);
+    detab_chunk(&state, input, input_size, &output);
+    *reserve_output(&output, 1) = '\0';
+    return output.data;
+}
+
+// Streams the file (standard input for "-") through fixed-size input and output buffers, so files of any size take the
+// same amount of memory. Where that's supported, named files are opened as input views instead: files that can be
+// mapped are written out from the mapping, and the others are detabbed from the view.
+void detab_file(char* input_file_path, TabStops* tab_stops, FILE* output_file_handle)
+{
+    bool is_standard_input = strcmp(input_file_path, "-") == 0;
+#ifdef DETAB_HAS_WRITEV
+    if (!is_standard_input)
+    {
+        InputView input = open_input_view(input_file_path);
+        if (input.is_mapped)
+        {
+            fflush(output_file_handle);
+            detab_to_descriptor(input.data, input.size, tab_stops, fileno(output_file_handle));
+            close_input_view(input);
+            return;
+        }
+        // a pipe or the like, which can't be opened again for reading, so the view has the whole input already
+        OutputBuffer output = make_output_buffer(output_file_handle);
+        DetabState state = make_detab_state(tab_stops);
+        detab_chunk(&state, input.data, input.size, &output);
+        flush_output(&output);
+        deallocate_output_buffer(output);
+        close_input_view(input);
+        return;
+    }
+#endif
+    FILE* input_file_handle = is_standard_input ? stdin : fopen(input_file_path, "rb");
+    if (input_file_handle == NULL) { printf("Failed to open file '%s'\n", input_file_path); exit(1); }
+    char* input_block = malloc(DETAB_INPUT_BLOCK_SIZE);
+    OutputBuffer output = make_output_buffer(output_file_handle);
+    DetabState state = make_detab_state(tab_stops);
+    size_t input_block_size;
+    while ((input_block_size = fread(input_block, 1, DETAB_INPUT_BLOCK_SIZE, input_file_handle)) > 0)
+    { detab_chunk(&state, input_block, input_block_size, &output); }
+    flush_output(&output);
+    deallocate_output_buffer(output);
+    free(input_block);
+    if (!is_standard_input) { fclose(input_file_handle); }
+}
+
+#ifdef DETAB_HAS_WRITEV
+
+char detab_zero_copy_spaces[DETAB_ZERO_COPY_SPACES_SIZE];
+
+typedef struct
+{
+    int file_descriptor;
+    struct iovec* iovecs;
+    // the kernel's output for dense windows. Its iovecs have a NULL base and their offset into it in
+    // `staged_offsets` until the flush, since it moves when it grows.
+    OutputBuffer staging;
+    size_t* staged_offsets;
+    int iovec_count;
+} ZeroCopyOutput;
+
+ZeroCopyOutput make_zero_copy_output(int file_descriptor)
+{
+    ZeroCopyOutput result;
+    result.file_descriptor = file_descriptor;
+    result.iovecs = malloc(DETAB_IOVEC_BATCH_SIZE * sizeof(struct iovec));
+    result.staging = make_output_buffer(NULL);
+    result.staged_offsets = malloc(DETAB_IOVEC_BATCH_SIZE * sizeof(size_t));
+    result.iovec_count = 0;
+    return result;
+}
+
+void deallocate_zero_copy_output(ZeroCopyOutput output)
+{
+    free(output.iovecs);
+    deallocate_output_buffer(output.staging);
+    free(output.staged_offsets);
+}
+
+void flush_zero_copy_output(ZeroCopyOutput* output)
+{
+    struct iovec* iovecs = output->iovecs;
+    int iovec_count = output->iovec_count;
+    for (int i = 0; i < iovec_count; i++)
+    {
+        if (iovecs[i].iov_base == NULL) { iovecs[i].iov_base = output->staging.data + output->staged_offsets[i]; }
+    }
+    while (iovec_count > 0)
+    {
+        ssize_t written_size = writev(output->file_descriptor, iovecs, iovec_count);
+        if (written_size < 0)
+        {
+            if (errno == EINTR) { continue; }
+            printf("Failed to write output\n");
+            exit(1);
+        }
+        // skip what was written, which can end partway through an iovec
+        size_t remaining_written_size = (size_t)written_size;
+        while (iovec_count > 0 && remaining_written_size >= iovecs->iov_len)
+        {
+            remaining_written_size -= iovecs->iov_len;
+            iovecs++;
+            iovec_count--;
+        }
+        if (iovec_count > 0)
+        {
+            iovecs->iov_base = (char*)iovecs->iov_base + remaining_written_size;
+            iovecs->iov_len -= remaining_written_size;
+        }
+    }
+    output->iovec_count = 0;
+    output->staging.size = 0;
+}
+
+void add_iovec(ZeroCopyOutput* output, char* data, size_t size, size_t staged_offset)
+{
+    if (output->iovec_count == DETAB_IOVEC_BATCH_SIZE) { flush_zero_copy_output(output); }
+    output->iovecs[output->iovec_count].iov_base = data;
+    output->iovecs[output->iovec_count].iov_len = size;
+    output->staged_offsets[output->iovec_count] = staged_offset;
+    output->iovec_count++;
+}
+
+void add_input_run(ZeroCopyOutput* output, char* run, size_t run_size)
+{
+    if (run_size == 0) { return; }
+    if (output->iovec_count > 0)
+    {
+        struct iovec* last_iovec = output->iovecs + output->iovec_count - 1;
+        if (last_iovec->iov_base != NULL && (char*)last_iovec->iov_base + last_iovec->iov_len == run)
+        { // a run that continues across windows
+            last_iovec->iov_len += run_size;
+            return;
+        }
+    }
+    add_iovec(output, run, run_size, 0);
+}
+
+void add_spaces(ZeroCopyOutput* output, size_t spaces_count)
+{
+    while (spaces_count > 0)
+    {
+        size_t size = spaces_count < DETAB_ZERO_COPY_SPACES_SIZE ? spaces_count : DETAB_ZERO_COPY_SPACES_SIZE;
+        add_iovec(output, detab_zero_copy_spaces, size, 0);
+        spaces_count -= size;
+    }
+}
+
+// Moves the column over a run without tabs
+void advance_column_over_run(DisplayColumn* column, char* run, size_t run_size)
+{
+    for (size_t i = run_size; i > 0; i--)
+    {
+        if (run[i - 1] == '\n')
+        {
+            *column = make_display_column(0);
+            run += i;
+            run_size -= i;
+            break;
+        }
+    }
+    column->column += get_display_width(&column->utf8_decoder, run, run_size);
+}
+
+size_t count_detab_window_tabs(char* window, size_t window_size)
+{
+    size_t result = 0;
+    for (size_t i = 0; i < window_size; i++) { result += window[i] == '\t'; }
+    return result;
+}
+
+void detab_window_zero_copy(DetabState* state, char* window, size_t window_size, ZeroCopyOutput* output)
+{
+    size_t run_start = 0;
+    while (true)
+    {
+        char* tab = memchr(window + run_start, '\t', window_size - run_start);
+        size_t run_end = tab == NULL ? window_size : (size_t)(tab - window);
+        advance_column_over_run(&state->column, window + run_start, run_end - run_start);
+        add_input_run(output, window + run_start, run_end - run_start);
+        if (tab == NULL) { return; }
+        size_t spaces_count = get_next_tab_stop(state->tab_stops, state->column.column) - state->column.column;
+        add_spaces(output, spaces_count);
+        state->column.column += spaces_count;
+        state->column.utf8_decoder.remaining_size = 0;
+        run_start = run_end + 1;
+    }
+}
+
+void detab_to_descriptor(char* input, size_t input_size, TabStops* tab_stops, int file_descriptor)
+{
+    if (detab_zero_copy_spaces[0] != ' ') { memset(detab_zero_copy_spaces, ' ', DETAB_ZERO_COPY_SPACES_SIZE); }
+    ZeroCopyOutput output = make_zero_copy_output(file_descriptor);
+    DetabState state = make_detab_state(tab_stops);
+    for (size_t window_start = 0; window_start < input_size; window_start += DETAB_ZERO_COPY_WINDOW_SIZE)
+    {
+        size_t remaining_size = input_size - window_start;
+        size_t window_size = remaining_size < DETAB_ZERO_COPY_WINDOW_SIZE ? remaining_size : DETAB_ZERO_COPY_WINDOW_SIZE;
+        char* window = input + window_start;
+        // every tab takes the iovecs of a run and its spaces
+        if (count_detab_window_tabs(window, window_size) * DETAB_ZERO_COPY_MIN_RUN_SIZE <= window_size)
+        {
+            detab_window_zero_copy(&state, window, window_size, &output);
+            continue;
+        }
+        // flushed first if need be, since the flush empties the staging buffer
+        if (output.iovec_count == DETAB_IOVEC_BATCH_SIZE) { flush_zero_copy_output(&output); }
+        size_t staged_offset = output.staging.size;
+        detab_chunk(&state, window, window_size, &output.staging);
+        add_iovec(&output, NULL, output.staging.size - staged_offset, staged_offset);
+        if (output.staging.size >= OUTPUT_BUFFER_CAPACITY) { flush_zero_copy_output(&output); }
+    }
+    flush_zero_copy_output(&output);
+    deallocate_zero_copy_output(output);
+}
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef KNR_DETAB_H
+#define KNR_DETAB_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../common/input.h"
+#include "../common/output.h"
+#include "../common/tab_stops.h"
+#include "../common/utf8.h"
+
+#define DETAB_INPUT_BLOCK_SIZE (64 * 1024)
+
+// The block kernel works on blocks of this many bytes and can read and write up to `DETAB_OVERSTORE_SIZE` bytes past
+// what it needs
+#define DETAB_SCAN_BLOCK_SIZE 64
+#define DETAB_OVERSTORE_SIZE 16
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DETAB_HAS_SIMD
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#define DETAB_HAS_WRITEV
+#define DETAB_HAS_THREADS
+#endif
+
+typedef void (*ScanTabBlockFunction)(char* block, uint64_t* tabs, uint64_t* newlines);
+
+void scan_tab_block_scalar(char* block, uint64_t* tabs, uint64_t* newlines);
+#ifdef DETAB_HAS_SIMD
+void scan_tab_block_sse2(char* block, uint64_t* tabs, uint64_t* newlines);
+void scan_tab_block_avx2(char* block, uint64_t* tabs, uint64_t* newlines);
+#endif
+ScanTabBlockFunction select_scan_tab_block_function();
+#define MAX_SCAN_TAB_BLOCK_FUNCTION_COUNT 3
+// Fills in every scanner that the processor can run, and its name, for comparing them. Returns how many there are.
+int get_available_scan_tab_block_functions(ScanTabBlockFunction* functions, char** names);
+// Picked once on first use, from whichever thread gets there first. Can be swapped to compare the scanners while no
+// other thread is detabbing.
+extern ScanTabBlockFunction scan_tab_block;
+
+size_t detab_piece_scalar(TabStops* tab_stops, DisplayColumn* column, char* piece, size_t piece_size, char* result);
+
+typedef size_t (*DetabPieceFunction)(
+    TabStops* tab_stops,
+    DisplayColumn* column,
+    char* piece,
+    size_t piece_size,
+    size_t readable_size,
+    char* result
+);
+
+DetabPieceFunction select_detab_piece_function(TabStops* tab_stops);
+
+typedef struct
+{
+    DisplayColumn column; // of the next output character
+    TabStops* tab_stops;
+    DetabPieceFunction detab_piece; // picked once for the tab stops, instead of checking their type for every tab
+} DetabState;
+
+DetabState make_detab_state(TabStops* tab_stops);
+void detab_chunk(DetabState* state, char* chunk, size_t chunk_size, OutputBuffer* output);
+// Returns a NUL-terminated copy of the input with its tabs expanded
+char* detab(char* input, size_t input_size, TabStops* tab_stops);
+void detab_file(char* input_file_path, TabStops* tab_stops, FILE* output_file_handle);
+
+#ifdef DETAB_HAS_WRITEV
+// Writes the expanded input straight to the descriptor with `writev`: the runs between tabs are written from the input
+// itself and the tabs from a buffer of spaces, so an input that stays mapped costs little more than copying it. Windows
+// of the input with more tabs than that pays off for go through the block kernel into a staging buffer instead.
+#define DETAB_ZERO_COPY_WINDOW_SIZE DETAB_INPUT_BLOCK_SIZE
+#define DETAB_ZERO_COPY_MIN_RUN_SIZE 256 // below this many bytes between tabs on average, copying is faster
+#define DETAB_ZERO_COPY_SPACES_SIZE 4096
+#define DETAB_IOVEC_BATCH_SIZE 1024 // iovecs per `writev`, no more than any system's IOV_MAX
+
+void detab_to_descriptor(char* input, size_t input_size, TabStops* tab_stops, int file_descriptor);
+#endif
+
+#endif
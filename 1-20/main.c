@@ -7,83 +7,274 @@ Assume a fixed set of tab stops, say every `n` columns.
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <stdint.h>
 
-#define TAB_SIZE 4
-#define MAX_STRING 1024
+#include "detab.h"
+#include "../common/testing.h"
 
-char* read_file(char* file_path)
+#ifdef DETAB_HAS_WRITEV
+#include <unistd.h>
+#endif
+
+bool all_test_cases_passed = true;
+
+void report_failed_test_case(int file_i, char* detab_method, InputView expected_output_file, char* detab_output)
+{
+    all_test_cases_passed = false;
+    printf(
+        "Test %d (%s) failed failed: expected `%.*s`; got `%s`\n",
+        file_i,
+        detab_method,
+        (int)expected_output_file.size,
+        expected_output_file.data,
+        detab_output
+    );
+}
+
+bool does_output_match(char* output, size_t output_size, InputView expected_output_file)
 {
-    FILE* file_handle = fopen(file_path, "rb");
-    if (file_handle == NULL) { printf("Failed to open file '%s'\n", file_path); exit(1); }
-    fseek(file_handle, 0, SEEK_END);
-    int file_size = ftell(file_handle);
-    rewind(file_handle);
-    char* file_contents = malloc(file_size + 1);
-    int bytes_read = (int)fread(file_contents, 1, file_size, file_handle);
-    if (bytes_read != file_size)
+    return output_size == expected_output_file.size
+        && memcmp(output, expected_output_file.data, expected_output_file.size) == 0;
+}
+
+void test_case(int file_i)
+{
+    char input_file_path[256];
+    snprintf(input_file_path, sizeof(input_file_path), "test files/test %d input.txt", file_i);
+    InputView input_file = open_input_view(input_file_path);
+    char expected_output_file_path[256];
+    snprintf(expected_output_file_path, sizeof(expected_output_file_path), "test files/test %d output.txt", file_i);
+    InputView expected_output_file = open_input_view(expected_output_file_path);
+    TabStops tab_stops = make_uniform_tab_stops(DEFAULT_TAB_SIZE);
+    char* detab_output = detab(input_file.data, input_file.size, &tab_stops);
+    if (!does_output_match(detab_output, strlen(detab_output), expected_output_file))
+    { report_failed_test_case(file_i, "whole buffer", expected_output_file, detab_output); }
+    free(detab_output);
+
+    // the output mustn't depend on where the input is split
+    for (size_t chunk_size = 1; chunk_size < input_file.size; chunk_size++)
     {
-        printf("Was only able to read %d bytes out of %d expected for file '%s'\n", bytes_read, file_size, file_path);
-        exit(1);
+        OutputBuffer output = make_output_buffer(NULL);
+        DetabState state = make_detab_state(&tab_stops);
+        for (size_t offset = 0; offset < input_file.size; offset += chunk_size)
+        {
+            size_t remaining_size = input_file.size - offset;
+            size_t current_chunk_size = remaining_size < chunk_size ? remaining_size : chunk_size;
+            detab_chunk(&state, input_file.data + offset, current_chunk_size, &output);
+        }
+        if (!does_output_match(output.data, output.size, expected_output_file))
+        {
+            char detab_method[64];
+            snprintf(detab_method, sizeof(detab_method), "chunks of %zu bytes", chunk_size);
+            *reserve_output(&output, 1) = '\0';
+            report_failed_test_case(file_i, detab_method, expected_output_file, output.data);
+        }
+        deallocate_output_buffer(output);
     }
-    file_contents[file_size] = '\0';
-    fclose(file_handle);
-    return file_contents;
+
+    deallocate_tab_stops(tab_stops);
+    close_input_view(expected_output_file);
+    close_input_view(input_file);
 }
 
-char* copy_string(char* source)
+// seeded the same way every time, so that the test inputs are the same on every run
+uint64_t random_state = 88172645463325252ull;
+
+// Compares the block kernel with the scalar reference on random inputs, with every available way of scanning blocks and
+// every type of tab stops
+void test_detab_kernel()
 {
-    int source_size = strlen(source);
-    char* result = malloc(source_size + 1);
-    memcpy(result, source, source_size + 1);
-    return result;
+    int tab_stop_lists[][4] = {{4}, {8}, {1}, {3}, {20}, {2, 5, 13}, {1, 2, 40, 41}};
+    int tab_stop_list_sizes[] = {1, 1, 1, 1, 1, 3, 4};
+    int tab_stop_list_count = sizeof(tab_stop_list_sizes) / sizeof(tab_stop_list_sizes[0]);
+
+    ScanTabBlockFunction scan_tab_block_functions[MAX_SCAN_TAB_BLOCK_FUNCTION_COUNT];
+    char* scan_tab_block_names[MAX_SCAN_TAB_BLOCK_FUNCTION_COUNT];
+    int scan_tab_block_function_count = get_available_scan_tab_block_functions(
+        scan_tab_block_functions,
+        scan_tab_block_names
+    );
+    ScanTabBlockFunction selected_scan_tab_block = select_scan_tab_block_function();
+
+    // with the bytes of "é" and "漢", which come out as whole, cut-off and stray UTF-8 sequences
+    char alphabet[] = "\t\t\t\nabcdefgh \xC3\xA9\xE6\xBC\xA2";
+    for (int input_i = 0; input_i < 2000; input_i++)
+    {
+        size_t input_size = get_random_number(&random_state) % 700;
+        char* input = malloc(input_size + 1); // exactly sized so that reading past it would be caught by sanitizers
+        for (size_t i = 0; i < input_size; i++)
+        { input[i] = alphabet[get_random_number(&random_state) % (sizeof(alphabet) - 1)]; }
+        DisplayColumn initial_column = make_display_column(get_random_number(&random_state) % 8);
+        int tab_stop_list_i = input_i % tab_stop_list_count;
+        TabStops tab_stops = make_listed_tab_stops(
+            tab_stop_lists[tab_stop_list_i],
+            tab_stop_list_sizes[tab_stop_list_i]
+        );
+        DetabPieceFunction detab_piece = select_detab_piece_function(&tab_stops);
+        char* expected_output = malloc(input_size * tab_stops.max_distance + 1);
+        DisplayColumn expected_column = initial_column;
+        size_t expected_output_size = detab_piece_scalar(
+            &tab_stops,
+            &expected_column,
+            input,
+            input_size,
+            expected_output
+        );
+
+        char* output = malloc(input_size * tab_stops.max_distance + DETAB_OVERSTORE_SIZE);
+        for (int i = 0; i < scan_tab_block_function_count; i++)
+        {
+            scan_tab_block = scan_tab_block_functions[i];
+            DisplayColumn column = initial_column;
+            size_t output_size = detab_piece(&tab_stops, &column, input, input_size, input_size, output);
+            if (
+                output_size != expected_output_size
+                    || memcmp(output, expected_output, output_size) != 0
+                    || column.column != expected_column.column
+                    || !are_utf8_decoders_equal(column.utf8_decoder, expected_column.utf8_decoder)
+            )
+            {
+                all_test_cases_passed = false;
+                printf(
+                    "Detab kernel test failed for random input %d of %zu bytes with the %s scanner\n",
+                    input_i,
+                    input_size,
+                    scan_tab_block_names[i]
+                );
+            }
+        }
+        free(output);
+        free(expected_output);
+        deallocate_tab_stops(tab_stops);
+        free(input);
+    }
+    scan_tab_block = selected_scan_tab_block;
+}
+
+// Past the last listed stop tabs become single blanks, like they do for `expand -t 2,5`
+void test_listed_tab_stops()
+{
+    char input[] = "a\tb\tc\td\te\n";
+    char expected_output[] = "a b  c d e\n";
+    TabStops tab_stops = parse_tab_stops("2,5");
+    char* output = detab(input, strlen(input), &tab_stops);
+    if (strcmp(output, expected_output) != 0)
+    {
+        all_test_cases_passed = false;
+        printf("Listed tab stops test failed: expected `%s`; got `%s`\n", expected_output, output);
+    }
+    free(output);
+    deallocate_tab_stops(tab_stops);
 }
 
-char* detab(char* input)
+// Tabs line up by display width: "漢" takes two columns, "é" one, and so does "e" with a combining acute accent
+void test_utf8_columns()
 {
-    char* result = malloc(MAX_STRING);
-    int result_i = 0;
-    for (int i = 0; input[i] != '\0'; i++)
+    char input[] = "\xE6\xBC\xA2\tx\n\xC3\xA9\ty\ne\xCC\x81\tz\n";
+    char expected_output[] = "\xE6\xBC\xA2  x\n\xC3\xA9   y\ne\xCC\x81   z\n";
+    TabStops tab_stops = make_uniform_tab_stops(4);
+    char* output = detab(input, strlen(input), &tab_stops);
+    if (strcmp(output, expected_output) != 0)
+    {
+        all_test_cases_passed = false;
+        printf("UTF-8 columns test failed: expected `%s`; got `%s`\n", expected_output, output);
+    }
+    free(output);
+    deallocate_tab_stops(tab_stops);
+}
+
+#ifdef DETAB_HAS_WRITEV
+// Sparse tabs get written from the input and dense ones through the kernel, both have to match the plain expansion
+void test_zero_copy_detab()
+{
+    size_t input_size = 3 * DETAB_ZERO_COPY_WINDOW_SIZE + 123;
+    char* input = malloc(input_size);
+    for (size_t i = 0; i < input_size; i++)
+    {
+        bool is_dense = i >= DETAB_ZERO_COPY_WINDOW_SIZE && i < 2 * DETAB_ZERO_COPY_WINDOW_SIZE;
+        input[i] = i % 997 == 0 || (is_dense && i % 5 == 0) ? '\t' : i % 89 == 0 ? '\n' : 'a' + i % 26;
+    }
+    char* tab_stops_texts[] = {"8", "3,17,40"};
+    for (int i = 0; i < 2; i++)
     {
-        if (input[i] == '\t')
+        TabStops tab_stops = parse_tab_stops(tab_stops_texts[i]);
+        char* expected_output = detab(input, input_size, &tab_stops);
+        FILE* output_file_handle = tmpfile();
+        detab_to_descriptor(input, input_size, &tab_stops, fileno(output_file_handle));
+        size_t expected_output_size = strlen(expected_output);
+        char* output = malloc(expected_output_size + 1);
+        rewind(output_file_handle);
+        size_t output_size = fread(output, 1, expected_output_size + 1, output_file_handle);
+        if (output_size != expected_output_size || memcmp(output, expected_output, output_size) != 0)
         {
-            int spaces_count = TAB_SIZE - (result_i % TAB_SIZE);
-            for (int j = 0; j < spaces_count; j++) { result[result_i++] = ' '; }
+            all_test_cases_passed = false;
+            printf("Zero-copy detab test failed for tab stops %s\n", tab_stops_texts[i]);
         }
-        else { result[result_i++] = input[i]; }
+        fclose(output_file_handle);
+        free(output);
+        free(expected_output);
+        deallocate_tab_stops(tab_stops);
     }
-    result[result_i] = '\0';
-    return result;
+    free(input);
 }
 
-bool all_test_cases_passed = true;
-
-void test_case(int file_i)
+// A named input that can't be mapped, such as a pipe, is only read once
+void test_unmapped_detab_file()
 {
-    char input_file_path[256];
-    snprintf(input_file_path, sizeof(input_file_path), "test files/test %d input.txt", file_i);
-    char* input_file_contents = read_file(input_file_path);
-    char expected_output_file_path[256];
-    snprintf(expected_output_file_path, sizeof(expected_output_file_path), "test files/test %d output.txt", file_i);
-    char* expected_output_file_contents = read_file(expected_output_file_path);
-    char* detab_output = detab(input_file_contents);
-    if (strcmp(detab_output, expected_output_file_contents) != 0)
+    char* input = "a\tb\n\tc\td\n";
+    int pipe_descriptors[2];
+    if (pipe(pipe_descriptors) != 0) { printf("Failed to create a pipe\n"); exit(1); }
+    if (write(pipe_descriptors[1], input, strlen(input)) != (ssize_t)strlen(input))
+    { printf("Failed to write to a pipe\n"); exit(1); }
+    close(pipe_descriptors[1]);
+    char pipe_path[32];
+    snprintf(pipe_path, sizeof(pipe_path), "/dev/fd/%d", pipe_descriptors[0]);
+
+    TabStops tab_stops = make_uniform_tab_stops(DEFAULT_TAB_SIZE);
+    FILE* output_file_handle = tmpfile();
+    detab_file(pipe_path, &tab_stops, output_file_handle);
+    char* expected_output = "a   b\n    c   d\n";
+    char output[64];
+    rewind(output_file_handle);
+    size_t output_size = fread(output, 1, sizeof(output), output_file_handle);
+    if (output_size != strlen(expected_output) || memcmp(output, expected_output, output_size) != 0)
     {
         all_test_cases_passed = false;
-        printf(
-            "Test %d failed failed: expected `%s`; got `%s`\n",
-            file_i,
-            expected_output_file_contents,
-            detab_output
-        );
+        printf("Detabbing a pipe failed: expected `%s`; got `%.*s`\n", expected_output, (int)output_size, output);
     }
-    free(detab_output);
-    free(expected_output_file_contents);
-    free(input_file_contents);
+    fclose(output_file_handle);
+    close(pipe_descriptors[0]);
+    deallocate_tab_stops(tab_stops);
 }
+#endif
 
-int main()
+int main(int argument_count, char** arguments)
 {
-    for (int i = 1; i <= 4; i++) { test_case(i); }
+    if (argument_count > 1)
+    { // detab the given files to standard output instead of running the test cases, `-t` takes expand's tab stops
+        int first_file_i = 1;
+        TabStops tab_stops = make_uniform_tab_stops(DEFAULT_TAB_SIZE);
+        if (strcmp(arguments[1], "-t") == 0)
+        {
+            if (argument_count < 3) { printf("Expected tab stops after -t\n"); exit(1); }
+            tab_stops = parse_tab_stops(arguments[2]);
+            first_file_i = 3;
+        }
+        if (first_file_i == argument_count) { detab_file("-", &tab_stops, stdout); }
+        for (int i = first_file_i; i < argument_count; i++) { detab_file(arguments[i], &tab_stops, stdout); }
+        deallocate_tab_stops(tab_stops);
+        return 0;
+    }
+
+    for (int i = 1; i <= 5; i++) { test_case(i); }
+    test_detab_kernel();
+    test_listed_tab_stops();
+    test_utf8_columns();
+#ifdef DETAB_HAS_WRITEV
+    test_zero_copy_detab();
+    test_unmapped_detab_file();
+#endif
 
     if (all_test_cases_passed) { printf("All test cases passed!\n"); }
+    return all_test_cases_passed ? 0 : 1;
 }
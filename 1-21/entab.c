@@ -0,0 +1,348 @@
+#include "entab.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+#define ENTAB_HAS_THREADS
+#endif
+
+#include "../common/system.h"
+#include "../common/utf8.h"
+
+// Retabs whole lines, so the input has to start at the beginning of a line. Lines are independent of each other, as
+// the column starts over after every newline. Every input byte becomes at most as many output bytes as the widest input
+// tab, which is what the result needs room for. Returns the size of the result. It gets a copy for each type of output
+// tab stops, so that working out where the next stop is costs a shift or a table lookup.
+TAB_STOPS_SPECIALIZED size_t retab_lines_with_tab_stops_type(
+    TabStopsType output_tab_stops_type,
+    TabStops* input_tab_stops,
+    TabStops* output_tab_stops,
+    char* input,
+    size_t input_size,
+    char* result
+)
+{
+    size_t result_i = 0;
+    size_t column = 0;
+    // columns are display widths, but blocks that turn out to be ASCII only are a column per byte without decoding
+    Utf8Decoder utf8_decoder = make_utf8_decoder();
+    size_t ascii_end = 0;
+    bool counting_blanks = false;
+    size_t blanks_start_column;
+    for (size_t i = 0; i <= input_size; i++)
+    {
+        bool is_end_of_input = i == input_size; // behaves like a non-blank so that trailing blanks get flushed
+        if (!is_end_of_input && (input[i] == ' ' || input[i] == '\t'))
+        {
+            if (!counting_blanks)
+            { // don't print anything, count the blanks first
+                counting_blanks = true;
+                blanks_start_column = column;
+            }
+            column = input[i] == ' ' ? column + 1 : get_next_tab_stop(input_tab_stops, column);
+            utf8_decoder.remaining_size = 0;
+            continue;
+        }
+
+        if (counting_blanks)
+        {
+            counting_blanks = false;
+            size_t j = blanks_start_column;
+            // print as many tabs as possible first, but none past the last listed stop where they would only replace
+            // single blanks
+            size_t next_stop;
+            while (
+                output_tab_stops != NULL
+                    && (next_stop = NEXT_TAB_STOP(output_tab_stops_type, output_tab_stops, j)) <= column
+                    && (output_tab_stops_type != TabStopsTypeList || j < output_tab_stops->last_stop)
+            )
+            {
+                result[result_i++] = '\t';
+                j = next_stop;
+            }
+            // fill the rest with spaces
+            while (j < column)
+            {
+                result[result_i++] = ' ';
+                j++;
+            }
+        }
+
+        // copy the actual non-blank character that we stopped at
+        if (is_end_of_input) { break; }
+        result[result_i++] = input[i];
+        if (i >= ascii_end && i + UTF8_ASCII_BLOCK_SIZE <= input_size && is_ascii_block(input + i))
+        {
+            ascii_end = i + UTF8_ASCII_BLOCK_SIZE;
+            utf8_decoder.remaining_size = 0;
+        }
+        // a newline resets the decoder like any ASCII byte
+        int width = i < ascii_end ? 1 : advance_utf8_decoder(&utf8_decoder, (unsigned char)input[i]);
+        column = input[i] == '\n' ? 0 : (size_t)((ptrdiff_t)column + width);
+    }
+    return result_i;
+}
+
+size_t retab_lines_power_of_two(
+    TabStops* input_tab_stops,
+    TabStops* output_tab_stops,
+    char* input,
+    size_t input_size,
+    char* result
+)
+{
+    return retab_lines_with_tab_stops_type(
+        TabStopsTypePowerOfTwo,
+        input_tab_stops,
+        output_tab_stops,
+        input,
+        input_size,
+        result
+    );
+}
+
+size_t retab_lines_uniform(
+    TabStops* input_tab_stops,
+    TabStops* output_tab_stops,
+    char* input,
+    size_t input_size,
+    char* result
+)
+{
+    return retab_lines_with_tab_stops_type(
+        TabStopsTypeUniform,
+        input_tab_stops,
+        output_tab_stops,
+        input,
+        input_size,
+        result
+    );
+}
+
+size_t retab_lines_list(
+    TabStops* input_tab_stops,
+    TabStops* output_tab_stops,
+    char* input,
+    size_t input_size,
+    char* result
+)
+{
+    return retab_lines_with_tab_stops_type(
+        TabStopsTypeList,
+        input_tab_stops,
+        output_tab_stops,
+        input,
+        input_size,
+        result
+    );
+}
+
+size_t retab_lines_to_spaces(
+    TabStops* input_tab_stops,
+    TabStops* output_tab_stops,
+    char* input,
+    size_t input_size,
+    char* result
+)
+{
+    (void)output_tab_stops;
+    return retab_lines_with_tab_stops_type(TabStopsTypeList, input_tab_stops, NULL, input, input_size, result);
+}
+
+// Picked once for the output tab stops, instead of checking their type for every run of blanks
+RetabLinesFunction select_retab_lines_function(TabStops* output_tab_stops)
+{
+    if (output_tab_stops == NULL) { return retab_lines_to_spaces; }
+    switch (output_tab_stops->type)
+    {
+        case TabStopsTypePowerOfTwo: return retab_lines_power_of_two;
+        case TabStopsTypeUniform: return retab_lines_uniform;
+        case TabStopsTypeList: return retab_lines_list;
+    }
+    return retab_lines_list;
+}
+
+// Large inputs are split into chunks of whole lines that get retabbed on all cores, each into its own buffer. The
+// chunks are processed in rounds of a few per thread and written out in order after every round, so memory use doesn't
+// grow with the size of the input. Smaller inputs go through the same chunks on the calling thread, straight into the
+// output.
+#define RETAB_CHUNKS_PER_THREAD 2
+
+typedef struct
+{
+    char* input;
+    size_t input_size;
+    char* output;
+    size_t output_size;
+    size_t output_capacity;
+} RetabChunk;
+
+typedef struct
+{
+    RetabChunk* chunks;
+    int chunk_count;
+    atomic_int next_chunk_i;
+    TabStops* input_tab_stops;
+    TabStops* output_tab_stops;
+    RetabLinesFunction retab_lines;
+} RetabChunkQueue;
+
+void* run_retab_chunk_worker(void* queue_pointer)
+{
+    RetabChunkQueue* queue = queue_pointer;
+    while (true)
+    {
+        int chunk_i = atomic_fetch_add(&queue->next_chunk_i, 1);
+        if (chunk_i >= queue->chunk_count) { break; }
+        RetabChunk* chunk = &queue->chunks[chunk_i];
+        chunk->output_size = queue->retab_lines(
+            queue->input_tab_stops,
+            queue->output_tab_stops,
+            chunk->input,
+            chunk->input_size,
+            chunk->output
+        );
+    }
+    return NULL;
+}
+
+void process_retab_chunks(
+    RetabChunk* chunks,
+    int chunk_count,
+    TabStops* input_tab_stops,
+    TabStops* output_tab_stops,
+    int thread_count
+)
+{
+    RetabChunkQueue queue;
+    queue.chunks = chunks;
+    queue.chunk_count = chunk_count;
+    atomic_init(&queue.next_chunk_i, 0);
+    queue.input_tab_stops = input_tab_stops;
+    queue.output_tab_stops = output_tab_stops;
+    queue.retab_lines = select_retab_lines_function(output_tab_stops);
+#ifdef ENTAB_HAS_THREADS
+    if (thread_count > chunk_count) { thread_count = chunk_count; }
+    pthread_t* threads = malloc(sizeof(pthread_t) * thread_count);
+    int started_thread_count = 0;
+    // the calling thread is a worker too
+    for (int i = 1; i < thread_count; i++)
+    {
+        if (pthread_create(&threads[started_thread_count], NULL, run_retab_chunk_worker, &queue) != 0) { break; }
+        started_thread_count++;
+    }
+    run_retab_chunk_worker(&queue);
+    for (int i = 0; i < started_thread_count; i++) { pthread_join(threads[i], NULL); }
+    free(threads);
+#else
+    (void)thread_count;
+    run_retab_chunk_worker(&queue);
+#endif
+}
+
+// Returns the offset right after the end of the line that the byte at `offset` is in
+size_t find_retab_line_end(char* input, size_t input_size, size_t offset)
+{
+    char* newline = memchr(input + offset, '\n', input_size - offset);
+    return newline == NULL ? input_size : (size_t)(newline - input) + 1;
+}
+
+// A chunk takes at least `chunk_size` bytes and then the rest of the line it stopped in
+size_t find_retab_chunk_end(char* input, size_t input_size, size_t offset, size_t chunk_size)
+{
+    if (input_size - offset <= chunk_size) { return input_size; }
+    return find_retab_line_end(input, input_size, offset + chunk_size - 1);
+}
+
+void retab_in_parallel(
+    char* input,
+    size_t input_size,
+    TabStops* input_tab_stops,
+    TabStops* output_tab_stops,
+    size_t chunk_size,
+    int thread_count,
+    OutputBuffer* output
+)
+{
+    int round_chunk_count = thread_count * RETAB_CHUNKS_PER_THREAD;
+    RetabChunk* chunks = calloc(round_chunk_count, sizeof(RetabChunk));
+    size_t offset = 0;
+    while (offset < input_size)
+    {
+        int chunk_count = 0;
+        while (chunk_count < round_chunk_count && offset < input_size)
+        {
+            size_t chunk_end = find_retab_chunk_end(input, input_size, offset, chunk_size);
+            RetabChunk* chunk = &chunks[chunk_count++];
+            chunk->input = input + offset;
+            chunk->input_size = chunk_end - offset;
+            size_t max_output_size = chunk->input_size * input_tab_stops->max_distance;
+            if (chunk->output_capacity < max_output_size)
+            {
+                chunk->output_capacity = max_output_size;
+                chunk->output = realloc(chunk->output, chunk->output_capacity);
+            }
+            offset = chunk_end;
+        }
+        process_retab_chunks(chunks, chunk_count, input_tab_stops, output_tab_stops, thread_count);
+        for (int i = 0; i < chunk_count; i++) { write_output(output, chunks[i].output, chunks[i].output_size); }
+    }
+    for (int i = 0; i < round_chunk_count; i++) { free(chunks[i].output); }
+    free(chunks);
+}
+
+// `output_tab_stops` is NULL for output with spaces only
+void retab_to_output(
+    char* input,
+    size_t input_size,
+    TabStops* input_tab_stops,
+    TabStops* output_tab_stops,
+    OutputBuffer* output
+)
+{
+    // chunks are smaller for wide input tabs, so that their worst-case output stays around the same size
+    size_t chunk_size = RETAB_CHUNK_SIZE / input_tab_stops->max_distance;
+    if (chunk_size == 0) { chunk_size = 1; }
+    int processor_count = get_processor_count();
+    if (input_size >= PARALLEL_RETAB_MIN_SIZE && processor_count > 1)
+    {
+        retab_in_parallel(input, input_size, input_tab_stops, output_tab_stops, chunk_size, processor_count, output);
+        return;
+    }
+    RetabLinesFunction retab_lines = select_retab_lines_function(output_tab_stops);
+    for (size_t offset = 0; offset < input_size;)
+    {
+        size_t chunk_end = find_retab_chunk_end(input, input_size, offset, chunk_size);
+        char* result = reserve_output(output, (chunk_end - offset) * input_tab_stops->max_distance);
+        output->size += retab_lines(input_tab_stops, output_tab_stops, input + offset, chunk_end - offset, result);
+        offset = chunk_end;
+    }
+}
+
+char* retab(char* input, size_t input_size, TabStops* input_tab_stops, TabStops* output_tab_stops)
+{
+    OutputBuffer output = make_output_buffer(NULL);
+    retab_to_output(input, input_size, input_tab_stops, output_tab_stops, &output);
+    *reserve_output(&output, 1) = '\0';
+    return output.data;
+}
+
+char* entab(char* input, size_t input_size, TabStops* tab_stops)
+{ return retab(input, input_size, tab_stops, tab_stops); }
+
+// The standard input can't be mapped, it gets read into memory in full instead
+void retab_file(char* input_file_path, TabStops* input_tab_stops, TabStops* output_tab_stops, FILE* output_file_handle)
+{
+    InputView input_file = strcmp(input_file_path, "-") == 0
+        ? open_input_view_from_descriptor(0, "standard input")
+        : open_input_view(input_file_path);
+    OutputBuffer output = make_output_buffer(output_file_handle);
+    retab_to_output(input_file.data, input_file.size, input_tab_stops, output_tab_stops, &output);
+    flush_output(&output);
+    deallocate_output_buffer(output);
+    close_input_view(input_file);
+}
@@ -0,0 +1,49 @@
+#ifndef KNR_ENTAB_H
+#define KNR_ENTAB_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include "../common/input.h"
+#include "../common/output.h"
+#include "../common/tab_stops.h"
+
+// Retabbing reads the input with one set of tab stops and writes it with another, in a single pass: the column is
+// tracked like detab does, with input tabs advancing it to the next input stop, and every run of blanks and tabs is
+// written out again like entab does, as tabs for the output stops and spaces for the rest. Without output tab stops
+// (NULL) the runs become spaces only. Entabbing is retabbing with the same tab stops for the input and the output.
+
+#define PARALLEL_RETAB_MIN_SIZE (4 * 1024 * 1024)
+#define RETAB_CHUNK_SIZE (4 * 1024 * 1024)
+
+typedef size_t (*RetabLinesFunction)(
+    TabStops* input_tab_stops,
+    TabStops* output_tab_stops,
+    char* input,
+    size_t input_size,
+    char* result
+);
+
+RetabLinesFunction select_retab_lines_function(TabStops* output_tab_stops);
+void retab_in_parallel(
+    char* input,
+    size_t input_size,
+    TabStops* input_tab_stops,
+    TabStops* output_tab_stops,
+    size_t chunk_size,
+    int thread_count,
+    OutputBuffer* output
+);
+void retab_to_output(
+    char* input,
+    size_t input_size,
+    TabStops* input_tab_stops,
+    TabStops* output_tab_stops,
+    OutputBuffer* output
+);
+// These return a NUL-terminated result
+char* retab(char* input, size_t input_size, TabStops* input_tab_stops, TabStops* output_tab_stops);
+char* entab(char* input, size_t input_size, TabStops* tab_stops);
+void retab_file(char* input_file_path, TabStops* input_tab_stops, TabStops* output_tab_stops, FILE* output_file_handle);
+
+#endif
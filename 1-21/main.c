@@ -7,71 +7,10 @@ spacing. Use the same tab stops as for detab.
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <stdint.h>
 
-#define TAB_SIZE 4
-#define MAX_STRING 1024
-
-char* entab(char* input)
-{
-    char* result = malloc(MAX_STRING);
-    int result_i = 0;
-    bool counting_blanks = false;
-    int blanks_start;
-    for (int i = 0; ; i++)
-    {
-        if (!counting_blanks)
-        {
-            if (input[i] == ' ')
-            { // don't print anything, count the blanks first
-                counting_blanks = true;
-                blanks_start = i;
-            }
-            else { result[result_i++] = input[i]; }
-        }
-        else if (input[i] != ' ')
-        {
-            counting_blanks = false;
-            int j = blanks_start;
-            // print as many tabs as possible first
-            while (j < i / TAB_SIZE * TAB_SIZE)
-            {
-                result[result_i++] = '\t';
-                j = (j / TAB_SIZE + 1) * TAB_SIZE;
-            }
-            // fill the rest with spaces
-            while (j < i)
-            {
-                result[result_i++] = ' ';
-                j++;
-            }
-
-            result[result_i++] = input[i]; // copy the actual non-blank character that we stopped at
-        }
-
-        if (input[i] == '\0') { break; }
-    }
-    result[result_i] = '\0';
-    return result;
-}
-
-char* read_file(char* file_path)
-{
-    FILE* file_handle = fopen(file_path, "rb");
-    if (file_handle == NULL) { printf("Failed to open file '%s'\n", file_path); exit(1); }
-    fseek(file_handle, 0, SEEK_END);
-    int file_size = ftell(file_handle);
-    rewind(file_handle);
-    char* file_contents = malloc(file_size + 1);
-    int bytes_read = (int)fread(file_contents, 1, file_size, file_handle);
-    if (bytes_read != file_size)
-    {
-        printf("Was only able to read %d bytes out of %d expected for file '%s'\n", bytes_read, file_size, file_path);
-        exit(1);
-    }
-    file_contents[file_size] = '\0';
-    fclose(file_handle);
-    return file_contents;
-}
+#include "entab.h"
+#include "../common/testing.h"
 
 bool all_test_cases_passed = true;
 
@@ -79,30 +18,195 @@ void test_case(int file_i)
 {
     char input_file_path[256];
     snprintf(input_file_path, sizeof(input_file_path), "test files/test %d input.txt", file_i);
-    char* input_file_contents = read_file(input_file_path);
+    InputView input_file = open_input_view(input_file_path);
     char expected_output_file_path[256];
     snprintf(expected_output_file_path, sizeof(expected_output_file_path), "test files/test %d output.txt", file_i);
-    char* expected_output_file_contents = read_file(expected_output_file_path);
-    char* detab_output = entab(input_file_contents);
-    if (strcmp(detab_output, expected_output_file_contents) != 0)
+    InputView expected_output_file = open_input_view(expected_output_file_path);
+    TabStops tab_stops = make_uniform_tab_stops(DEFAULT_TAB_SIZE);
+    char* entab_output = entab(input_file.data, input_file.size, &tab_stops);
+    if (
+        strlen(entab_output) != expected_output_file.size
+            || memcmp(entab_output, expected_output_file.data, expected_output_file.size) != 0
+    )
     {
         all_test_cases_passed = false;
         printf(
-            "Test %d failed failed: expected `%s`; got `%s`\n",
+            "Test %d failed failed: expected `%.*s`; got `%s`\n",
             file_i,
-            expected_output_file_contents,
-            detab_output
+            (int)expected_output_file.size,
+            expected_output_file.data,
+            entab_output
         );
     }
-    free(detab_output);
-    free(expected_output_file_contents);
-    free(input_file_contents);
+    free(entab_output);
+    deallocate_tab_stops(tab_stops);
+    close_input_view(expected_output_file);
+    close_input_view(input_file);
 }
 
-int main()
+// seeded the same way every time, so that the test inputs are the same on every run
+uint64_t random_state = 88172645463325252ull;
+
+// Checks on random inputs that retabbing keeps the spacing and gives the same result as expanding the tabs and then
+// entabbing, for every type of tab stops and for output with spaces only, and that retabbing in chunks on several
+// threads gives the same result as retabbing everything at once, with chunks small enough to split the inputs in many
+// places
+void test_retab()
 {
-    int test_case_count = 5;
+    int tab_stop_lists[][4] = {{4}, {8}, {3}, {2, 5, 13}, {1, 2, 40, 41}};
+    int tab_stop_list_sizes[] = {1, 1, 1, 3, 4};
+    int tab_stop_list_count = sizeof(tab_stop_list_sizes) / sizeof(tab_stop_list_sizes[0]);
+    char alphabet[] = "      \t\n\nab";
+    for (int input_i = 0; input_i < 500; input_i++)
+    {
+        size_t input_size = get_random_number(&random_state) % 2000;
+        char* input = malloc(input_size + 1);
+        for (size_t i = 0; i < input_size; i++)
+        { input[i] = alphabet[get_random_number(&random_state) % (sizeof(alphabet) - 1)]; }
+        int input_tab_stop_list_i = get_random_number(&random_state) % tab_stop_list_count;
+        TabStops input_tab_stops = make_listed_tab_stops(
+            tab_stop_lists[input_tab_stop_list_i],
+            tab_stop_list_sizes[input_tab_stop_list_i]
+        );
+        // the same tab stops half of the time, that's entabbing, and spaces only some of the time
+        int output_tab_stop_list_i = input_i % 2 == 0
+            ? input_tab_stop_list_i
+            : (int)(get_random_number(&random_state) % (tab_stop_list_count + 1));
+        bool is_output_spaces_only = output_tab_stop_list_i == tab_stop_list_count;
+        TabStops output_tab_stops = make_listed_tab_stops(
+            tab_stop_lists[is_output_spaces_only ? 0 : output_tab_stop_list_i],
+            tab_stop_list_sizes[is_output_spaces_only ? 0 : output_tab_stop_list_i]
+        );
+        TabStops* output_tab_stops_pointer = is_output_spaces_only ? NULL : &output_tab_stops;
+
+        char* expected_output = malloc(input_size * input_tab_stops.max_distance + 1);
+        size_t expected_output_size = select_retab_lines_function(output_tab_stops_pointer)(
+            &input_tab_stops,
+            output_tab_stops_pointer,
+            input,
+            input_size,
+            expected_output
+        );
+
+        size_t expanded_input_size;
+        char* expanded_input = expand_tabs(input, input_size, &input_tab_stops, &expanded_input_size);
+        size_t expanded_output_size;
+        char* expanded_output = expand_tabs(
+            expected_output,
+            expected_output_size,
+            &output_tab_stops,
+            &expanded_output_size
+        );
+        char* two_pass_output = is_output_spaces_only
+            ? retab(expanded_input, expanded_input_size, &output_tab_stops, NULL)
+            : entab(expanded_input, expanded_input_size, &output_tab_stops);
+        if (
+            expanded_input_size != expanded_output_size
+                || memcmp(expanded_input, expanded_output, expanded_input_size) != 0
+                || strlen(two_pass_output) != expected_output_size
+                || memcmp(two_pass_output, expected_output, expected_output_size) != 0
+                || (is_output_spaces_only && memchr(expected_output, '\t', expected_output_size) != NULL)
+        )
+        {
+            all_test_cases_passed = false;
+            printf("Retab test failed for random input %d of %zu bytes\n", input_i, input_size);
+        }
+        free(two_pass_output);
+        free(expanded_output);
+        free(expanded_input);
+
+        size_t chunk_size = 1 + get_random_number(&random_state) % 100;
+        int thread_count = 1 + get_random_number(&random_state) % 4;
+        OutputBuffer output = make_output_buffer(NULL);
+        retab_in_parallel(
+            input,
+            input_size,
+            &input_tab_stops,
+            output_tab_stops_pointer,
+            chunk_size,
+            thread_count,
+            &output
+        );
+        if (output.size != expected_output_size || memcmp(output.data, expected_output, output.size) != 0)
+        {
+            all_test_cases_passed = false;
+            printf(
+                "Parallel retab test failed for random input %d of %zu bytes in chunks of %zu bytes on %d threads\n",
+                input_i,
+                input_size,
+                chunk_size,
+                thread_count
+            );
+        }
+        deallocate_output_buffer(output);
+        free(expected_output);
+        deallocate_tab_stops(output_tab_stops);
+        deallocate_tab_stops(input_tab_stops);
+        free(input);
+    }
+}
+
+// Blanks after "漢" start at its second column, so two spaces reach the stop at 4, and after "é" it takes three
+void test_utf8_columns()
+{
+    char input[] = "\xE6\xBC\xA2  x\n\xC3\xA9   y\n\xC3\xA9  z\n";
+    char expected_output[] = "\xE6\xBC\xA2\tx\n\xC3\xA9\ty\n\xC3\xA9  z\n";
+    TabStops tab_stops = make_uniform_tab_stops(4);
+    char* output = entab(input, strlen(input), &tab_stops);
+    if (strcmp(output, expected_output) != 0)
+    {
+        all_test_cases_passed = false;
+        printf("UTF-8 columns test failed: expected `%s`; got `%s`\n", expected_output, output);
+    }
+    free(output);
+    deallocate_tab_stops(tab_stops);
+}
+
+int main(int argument_count, char** arguments)
+{
+    if (argument_count > 1)
+    { // entab the given files to standard output instead of running the test cases
+        // `-t` takes expand's tab stops for the output, and for the input too unless `-i` gives them separately. `-s`
+        // makes the output use spaces only.
+        char* input_tab_stops_text = NULL;
+        char* output_tab_stops_text = NULL;
+        bool is_output_spaces_only = false;
+        int argument_i = 1;
+        for (; argument_i < argument_count && arguments[argument_i][0] == '-' && arguments[argument_i][1] != '\0';
+             argument_i++)
+        {
+            if (strcmp(arguments[argument_i], "-s") == 0) { is_output_spaces_only = true; }
+            else if (strcmp(arguments[argument_i], "-t") == 0 || strcmp(arguments[argument_i], "-i") == 0)
+            {
+                if (argument_i + 1 == argument_count)
+                { printf("Expected tab stops after %s\n", arguments[argument_i]); exit(1); }
+                if (arguments[argument_i][1] == 't') { output_tab_stops_text = arguments[argument_i + 1]; }
+                else { input_tab_stops_text = arguments[argument_i + 1]; }
+                argument_i++;
+            }
+            else { printf("Unknown option '%s'\n", arguments[argument_i]); exit(1); }
+        }
+        TabStops output_tab_stops = output_tab_stops_text == NULL
+            ? make_uniform_tab_stops(DEFAULT_TAB_SIZE)
+            : parse_tab_stops(output_tab_stops_text);
+        if (input_tab_stops_text == NULL) { input_tab_stops_text = output_tab_stops_text; }
+        TabStops input_tab_stops = input_tab_stops_text == NULL
+            ? make_uniform_tab_stops(DEFAULT_TAB_SIZE)
+            : parse_tab_stops(input_tab_stops_text);
+        TabStops* output_tab_stops_pointer = is_output_spaces_only ? NULL : &output_tab_stops;
+        if (argument_i == argument_count) { retab_file("-", &input_tab_stops, output_tab_stops_pointer, stdout); }
+        for (; argument_i < argument_count; argument_i++)
+        { retab_file(arguments[argument_i], &input_tab_stops, output_tab_stops_pointer, stdout); }
+        deallocate_tab_stops(input_tab_stops);
+        deallocate_tab_stops(output_tab_stops);
+        return 0;
+    }
+
+    int test_case_count = 6;
     for (int i = 1; i <= test_case_count; i++) { test_case(i); }
+    test_retab();
+    test_utf8_columns();
 
     if (all_test_cases_passed) { printf("All %d test cases passed!\n", test_case_count); }
+    return all_test_cases_passed ? 0 : 1;
 }
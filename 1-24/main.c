@@ -10,464 +10,752 @@ generality.)
 #include <stdbool.h>
 #include <string.h>
 
-char* read_file(char* file_path)
-{
-    FILE* file_handle = fopen(file_path, "rb");
-    if (file_handle == NULL) { printf("Failed to open file '%s'\n", file_path); exit(1); }
-    fseek(file_handle, 0, SEEK_END);
-    int file_size = ftell(file_handle);
-    rewind(file_handle);
-    char* file_contents = malloc(file_size + 1);
-    int bytes_read = (int)fread(file_contents, 1, file_size, file_handle);
-    if (bytes_read != file_size)
-    {
-        printf("Was only able to read %d bytes out of %d expected for file '%s'\n", bytes_read, file_size, file_path);
-        exit(1);
-    }
-    file_contents[file_size] = '\0';
-    fclose(file_handle);
-    return file_contents;
-}
+#include "validation.h"
+#include "../common/hash.h"
+#include "../common/input.h"
+#include "../common/pipeline.h"
+#include "../common/system.h"
 
-char* copy_string(char* source)
+#ifdef VALIDATION_HAS_THREADS
+
+// Validates every file, every C source under every directory and every file listed in every @list file. Results are
+// printed in argument order, and the process fails if any of the files did.
+int run_batch_validation(int argument_count, char** arguments)
 {
-    int source_size = strlen(source);
-    char* result = malloc(source_size + 1);
-    memcpy(result, source, source_size + 1);
-    return result;
+    PathList paths = make_path_list();
+    for (int i = 0; i < argument_count; i++) { collect_argument_paths(arguments[i], &paths); }
+
+    double start_time = get_seconds();
+    BatchValidationEntry* entries = validate_in_batch(
+        paths.data,
+        paths.size,
+        get_processor_count(),
+        DEFAULT_READ_AHEAD_DEPTH
+    );
+    double elapsed_time = get_seconds() - start_time;
+
+    bool all_files_passed = true;
+    size_t total_size = 0;
+    for (int i = 0; i < paths.size; i++)
+    {
+        char* result_string = validation_result_to_string(entries[i].result);
+        printf("%s: %s\n", paths.data[i], result_string);
+        free(result_string);
+        all_files_passed = all_files_passed && entries[i].result.type == ValidationResultTypeSuccess;
+        total_size += entries[i].size;
+    }
+    if (elapsed_time <= 0) { elapsed_time = 1e-9; }
+    fprintf(
+        stderr,
+        "Validated %d files (%.1f MB) in %.3f s: %.0f files/s, %.1f MB/s\n",
+        paths.size,
+        total_size / 1e6,
+        elapsed_time,
+        paths.size / elapsed_time,
+        total_size / 1e6 / elapsed_time
+    );
+
+    free(entries);
+    deallocate_path_list(paths);
+    return all_files_passed ? 0 : 1;
 }
 
-typedef enum
-{
-    DelimiterParenthesis,
-    DelimiterBracket,
-    DelimiterBrace,
-} Delimiter;
+#endif
 
-char closing_delimiter_to_character(Delimiter source)
+// Reports every error in every file instead of just the first one, in recovery mode
+int run_validation_with_recovery(int argument_count, char** arguments)
 {
-    switch (source)
+    bool all_files_passed = true;
+    for (int i = 0; i < argument_count; i++)
     {
-        case DelimiterParenthesis: return ')';
-        case DelimiterBracket: return ']';
-        case DelimiterBrace: return '}';
-        default:
-            printf("`closing_delimiter_to_character` received an invalid argument: %d\n", source);
-            exit(1);
+        InputView input = open_input_view(arguments[i]);
+        ValidationResultList errors = validate_with_recovery(input.data, input.size, DEFAULT_MAX_RECOVERED_ERROR_COUNT);
+        close_input_view(input);
+        for (int j = 0; j < errors.size; j++)
+        {
+            char* error_string = validation_result_to_string(errors.data[j]);
+            printf("%s: %s\n", arguments[i], error_string);
+            free(error_string);
+        }
+        if (errors.is_truncated) { printf("%s: stopped after %d errors\n", arguments[i], errors.size); }
+        if (errors.size == 0) { printf("%s: successful validation\n", arguments[i]); }
+        all_files_passed = all_files_passed && errors.size == 0;
+        deallocate_validation_result_list(errors);
     }
+    return all_files_passed ? 0 : 1;
 }
 
-typedef enum
-{
-    ValidationResultTypeSuccess,
-    ValidationResultTypeExtraClosingDelimiter,
-    ValidationResultTypeWrongDelimiter,
-    ValidationResultTypeUnmatchedDelimiters,
-    ValidationResultTypeUnterminatedQuote,
-    ValidationResultTypeUnterminatedBlockComment,
-} ValidationResultType;
-
-typedef struct
+#ifdef VALIDATION_STATS
+
+// Validates every file on its own and prints its result with the statistics, as text or as one JSON object per line
+int run_validation_with_stats(int argument_count, char** arguments, bool prints_json)
 {
-    ValidationResultType type;
-    int error_line;
-    int error_character;
-    union
+    bool all_files_passed = true;
+    for (int i = 0; i < argument_count; i++)
     {
-        Delimiter extra_closing_delimiter;
-        struct
+        InputView input = open_input_view(arguments[i]);
+        ValidationStats stats;
+        ValidationResult result = validate_with_stats(input.data, input.size, &stats);
+        close_input_view(input);
+        if (prints_json)
         {
-            Delimiter wrong_delimiter_expected;
-            Delimiter wrong_delimiter_actual;
-        };
-        int unmatched_delimiters_count;
-        bool unterminated_quote_is_single_quote;
-    };
-} ValidationResult;
-
-ValidationResult make_successful_validation_result()
-{
-    ValidationResult result;
-    result.type = ValidationResultTypeSuccess;
-    return result;
+            char* json = validation_stats_to_json(result, stats);
+            printf("{\"path\": \"%s\", \"validation\": %s}\n", arguments[i], json);
+            free(json);
+        }
+        else
+        {
+            char* result_string = validation_result_to_string(result);
+            char* stats_string = validation_stats_to_string(stats);
+            printf("%s: %s\n%s\n", arguments[i], result_string, stats_string);
+            free(stats_string);
+            free(result_string);
+        }
+        all_files_passed = all_files_passed && result.type == ValidationResultTypeSuccess;
+    }
+    return all_files_passed ? 0 : 1;
 }
 
-bool are_validation_results_equal(ValidationResult left, ValidationResult right)
+#endif
+
+bool all_test_cases_passed = true;
+
+void report_failed_test_case(
+    char* test_file_path,
+    char* validation_method,
+    ValidationResult expected_validation_result,
+    ValidationResult actual_validation_result
+)
 {
-    if (left.type != right.type) { return false; }
-    switch (left.type)
-    {
-        case ValidationResultTypeSuccess: return true;
-        case ValidationResultTypeExtraClosingDelimiter:
-            return left.error_line == right.error_line
-                && left.error_character == right.error_character
-                && left.extra_closing_delimiter == right.extra_closing_delimiter;
-        case ValidationResultTypeWrongDelimiter:
-            return left.error_line == right.error_line
-                && left.error_character == right.error_character
-                && left.wrong_delimiter_actual == right.wrong_delimiter_actual
-                && left.wrong_delimiter_expected == right.wrong_delimiter_expected;
-        case ValidationResultTypeUnmatchedDelimiters:
-            return left.unmatched_delimiters_count == right.unmatched_delimiters_count;
-        case ValidationResultTypeUnterminatedQuote:
-            return left.unterminated_quote_is_single_quote == right.unterminated_quote_is_single_quote;
-        case ValidationResultTypeUnterminatedBlockComment: return true;
-    }
+    all_test_cases_passed = false;
+    char* expected_validation_result_string = validation_result_to_string(expected_validation_result);
+    char* actual_validation_result_string = validation_result_to_string(actual_validation_result);
+    printf(
+        "Validation test for file '%s' (%s) failed: expected %s; got %s\n",
+        test_file_path,
+        validation_method,
+        expected_validation_result_string,
+        actual_validation_result_string
+    );
+    free(actual_validation_result_string);
+    free(expected_validation_result_string);
 }
 
-char* validation_result_to_string(ValidationResult validation_result)
+// Applies a series of single byte insertions and deletions to the source, checking the incremental result against a
+// full validation after each of them. The checkpoint interval is tiny so that the test files have many checkpoints.
+void test_incremental_validation(char* test_file_path, char* source, size_t source_size)
 {
-    switch (validation_result.type)
+    char inserted_bytes[] = "()[]{}\"'\\/*\n x";
+    size_t edited_source_capacity = source_size + sizeof(inserted_bytes);
+    char* edited_source = malloc(edited_source_capacity);
+    memcpy(edited_source, source, source_size);
+    size_t edited_source_size = source_size;
+    IncrementalValidation validation = make_incremental_validation(edited_source, edited_source_size, 4);
+    for (int edit_i = 0; edit_i < (int)sizeof(inserted_bytes) - 1; edit_i++)
     {
-        case ValidationResultTypeSuccess:
-            return copy_string("successful validation");
-        case ValidationResultTypeExtraClosingDelimiter:
+        size_t edit_offset = (size_t)edit_i * 7 % (edited_source_size + 1);
+        if (edit_i % 3 == 2 && edit_offset < edited_source_size)
         {
-            int error_message_capacity = 1024;
-            char* error_message = malloc(error_message_capacity);
-            snprintf(
-                error_message,
-                error_message_capacity,
-                "failed validation: extra '%c' at line %d, character %d",
-                closing_delimiter_to_character(validation_result.extra_closing_delimiter),
-                validation_result.error_line,
-                validation_result.error_character
+            memmove(
+                edited_source + edit_offset,
+                edited_source + edit_offset + 1,
+                edited_source_size - edit_offset - 1
             );
-            return error_message;
+            edited_source_size--;
+            revalidate_after_edit(edited_source, edited_source_size, edit_offset, 1, 0, &validation);
         }
-        case ValidationResultTypeWrongDelimiter:
+        else
         {
-            int error_message_capacity = 1024;
-            char* error_message = malloc(error_message_capacity);
-            snprintf(
-                error_message,
-                error_message_capacity,
-                "failed validation: expected '%c' at line %d, character %d, but got '%c'",
-                closing_delimiter_to_character(validation_result.wrong_delimiter_expected),
-                validation_result.error_line,
-                validation_result.error_character,
-                closing_delimiter_to_character(validation_result.wrong_delimiter_actual)
+            memmove(
+                edited_source + edit_offset + 1,
+                edited_source + edit_offset,
+                edited_source_size - edit_offset
             );
-            return error_message;
+            edited_source[edit_offset] = inserted_bytes[edit_i];
+            edited_source_size++;
+            revalidate_after_edit(edited_source, edited_source_size, edit_offset, 0, 1, &validation);
         }
-        case ValidationResultTypeUnmatchedDelimiters:
+
+        ValidationResult expected_validation_result = validate(edited_source, edited_source_size);
+        if (!are_validation_results_equal(validation.result, expected_validation_result))
         {
-            int error_message_capacity = 1024;
-            char* error_message = malloc(error_message_capacity);
-            snprintf(
-                error_message,
-                error_message_capacity,
-                "failed validation: left %d unmatched delimiters",
-                validation_result.unmatched_delimiters_count
-            );
-            return error_message;
+            char validation_method[64];
+            snprintf(validation_method, sizeof(validation_method), "incrementally, after edit %d", edit_i);
+            report_failed_test_case(test_file_path, validation_method, expected_validation_result, validation.result);
         }
-        case ValidationResultTypeUnterminatedQuote:
+    }
+    deallocate_incremental_validation(validation);
+    free(edited_source);
+}
+
+#define MAX_TEST_CASE_COUNT 64
+
+char* test_file_paths[MAX_TEST_CASE_COUNT];
+ValidationResult expected_test_validation_results[MAX_TEST_CASE_COUNT];
+int test_case_count = 0;
+
+void test_case(char* test_file_path, ValidationResult expected_validation_result)
+{
+    test_file_paths[test_case_count] = test_file_path;
+    expected_test_validation_results[test_case_count] = expected_validation_result;
+    test_case_count++;
+
+    InputView test_file = open_input_view(test_file_path);
+    ValidationResult actual_validation_result = validate(test_file.data, test_file.size);
+    if (!are_validation_results_equal(actual_validation_result, expected_validation_result))
+    {
+        report_failed_test_case(test_file_path, "whole buffer", expected_validation_result, actual_validation_result);
+    }
+
+    // the streaming API has to give the same result regardless of where the chunk boundaries fall
+    for (size_t chunk_size = 1; chunk_size < test_file.size; chunk_size++)
+    {
+        actual_validation_result = validate_in_chunks(test_file.data, test_file.size, chunk_size);
+        if (!are_validation_results_equal(actual_validation_result, expected_validation_result))
         {
-            int error_message_capacity = 1024;
-            char* error_message = malloc(error_message_capacity);
-            snprintf(
-                error_message,
-                error_message_capacity,
-                "failed validation: unterminated %s quote",
-                validation_result.unterminated_quote_is_single_quote ? "single" : "double"
+            char validation_method[64];
+            snprintf(validation_method, sizeof(validation_method), "chunks of %zu bytes", chunk_size);
+            report_failed_test_case(
+                test_file_path,
+                validation_method,
+                expected_validation_result,
+                actual_validation_result
             );
-            return error_message;
         }
-        case ValidationResultTypeUnterminatedBlockComment:
-            return copy_string("failed validation: unterminated block comment");
-        default:
-            printf(
-                "`validation_result_to_string` received a `ValidationResult` with an invalid `type` value: %d\n",
-                validation_result.type
+    }
+
+    // so does the parallel validation regardless of how the source is split between the threads
+    for (int chunk_count = 2; (size_t)chunk_count <= test_file.size; chunk_count++)
+    {
+        actual_validation_result = validate_in_parallel(test_file.data, test_file.size, chunk_count, 4);
+        if (!are_validation_results_equal(actual_validation_result, expected_validation_result))
+        {
+            char validation_method[64];
+            snprintf(validation_method, sizeof(validation_method), "in parallel, %d chunks", chunk_count);
+            report_failed_test_case(
+                test_file_path,
+                validation_method,
+                expected_validation_result,
+                actual_validation_result
             );
-            exit(1);
+        }
+    }
+    test_incremental_validation(test_file_path, test_file.data, test_file.size);
+    close_input_view(test_file);
+
+    actual_validation_result = validate_file(test_file_path);
+    if (!are_validation_results_equal(actual_validation_result, expected_validation_result))
+    {
+        report_failed_test_case(test_file_path, "streamed file", expected_validation_result, actual_validation_result);
     }
 }
 
-typedef struct
-{
-    Delimiter* delimiter_stack_data;
-    int delimiter_stack_size;
-    int delimiter_stack_capacity;
-    int line; // 1-based
-    int character; // 1-based
-    bool is_inside_quotes;
-    bool is_inside_single_quotes;
-    bool is_escaped;
-    bool is_inside_comment;
-    bool is_inside_line_comment;
-    int line_comment_state_machine;
-    int block_comment_state_machine;
-} ValidationState;
-
-ValidationState make_validation_state()
+// The statistics of a parallel validation have to add up to the same numbers as those of a serial one, except for the
+// stack regrowths, which depend on how the stack is split
+void test_validation_stats()
 {
-    ValidationState result;
-    result.delimiter_stack_size = 0;
-    result.delimiter_stack_capacity = 16;
-    result.delimiter_stack_data = malloc(sizeof(Delimiter) * result.delimiter_stack_capacity);
-    result.line = 1;
-    result.character = 1;
-    result.is_inside_quotes = false;
-    result.is_escaped = false;
-    result.is_inside_comment = false;
-    result.is_inside_line_comment = false;
-    result.line_comment_state_machine = 0;
-    result.block_comment_state_machine = 0;
-    return result;
+#ifdef VALIDATION_STATS
+    char source[] = "int f(/* c */ \"s\") { a[(1)]; } // ()\nchar c = '{';\n";
+    size_t source_size = sizeof(source) - 1;
+    ValidationStats expected_stats;
+    validate_with_stats(source, source_size, &expected_stats);
+    // comments count from their second byte to the one before the last, strings from the opening quote to the one
+    // before the closing one
+    if (
+        expected_stats.bytes_scanned != source_size
+            || expected_stats.bytes_in_comments != 5 + 4
+            || expected_stats.bytes_in_strings != 2 + 2
+            || expected_stats.max_delimiter_stack_depth != 3
+    )
+    {
+        all_test_cases_passed = false;
+        char* stats_string = validation_stats_to_string(expected_stats);
+        printf("Validation stats test failed, got:\n%s\n", stats_string);
+        free(stats_string);
+    }
+    for (int chunk_count = 2; (size_t)chunk_count <= source_size; chunk_count++)
+    {
+        ValidationStats stats;
+        validate_in_parallel_with_stats(source, source_size, chunk_count, 4, &stats);
+        if (
+            stats.bytes_scanned != expected_stats.bytes_scanned
+                || stats.bytes_in_comments != expected_stats.bytes_in_comments
+                || stats.bytes_in_strings != expected_stats.bytes_in_strings
+                || stats.max_delimiter_stack_depth != expected_stats.max_delimiter_stack_depth
+        )
+        {
+            all_test_cases_passed = false;
+            char* stats_string = validation_stats_to_string(stats);
+            printf("Validation stats test failed in parallel with %d chunks, got:\n%s\n", chunk_count, stats_string);
+            free(stats_string);
+        }
+    }
+#endif
 }
 
-void deallocate_validation_state(ValidationState state) { free(state.delimiter_stack_data); }
-
-void push_delimiter(Delimiter delimiter, ValidationState* state)
+// Nests deep enough for the delimiter stack to move to the heap and grow a few times, one delimiter per line, then
+// closes all but the outermost few. The open ones have to keep their kinds and positions through all of that.
+void test_deep_nesting()
 {
-    if (state->delimiter_stack_size == state->delimiter_stack_capacity)
+    int depth = DELIMITER_STACK_INLINE_CAPACITY * 8 + 5;
+    int left_open_count = 3;
+    char opening_characters[] = "([{";
+    char closing_characters[] = ")]}";
+    size_t source_size = (size_t)(depth * 2 + (depth - left_open_count) * 2);
+    char* source = malloc(source_size);
+    char* source_i = source;
+    for (int i = 0; i < depth; i++)
     {
-        state->delimiter_stack_capacity *= 2;
-        state->delimiter_stack_data = realloc(state->delimiter_stack_data, state->delimiter_stack_capacity);
+        *source_i++ = opening_characters[i * 7 % 3];
+        *source_i++ = '\n';
+    }
+    for (int i = depth - 1; i >= left_open_count; i--)
+    {
+        *source_i++ = closing_characters[i * 7 % 3];
+        *source_i++ = ' ';
     }
-    state->delimiter_stack_data[state->delimiter_stack_size] = delimiter;
-    state->delimiter_stack_size++;
-}
 
-int get_delimiter_stack_size(ValidationState state) { return state.delimiter_stack_size; }
+    ValidationResult expected_validation_result;
+    expected_validation_result.type = ValidationResultTypeUnmatchedDelimiters;
+    expected_validation_result.unmatched_delimiters_count = left_open_count;
+    expected_validation_result.last_unmatched_delimiter = (left_open_count - 1) * 7 % 3;
+    expected_validation_result.error_line = left_open_count;
+    expected_validation_result.error_character = 1;
+    ValidationResult actual_validation_result = validate(source, source_size);
+    if (!are_validation_results_equal(actual_validation_result, expected_validation_result))
+    {
+        report_failed_test_case("deep nesting", "whole buffer", expected_validation_result, actual_validation_result);
+    }
+    actual_validation_result = validate_in_parallel(source, source_size, 7, 3);
+    if (!are_validation_results_equal(actual_validation_result, expected_validation_result))
+    {
+        report_failed_test_case("deep nesting", "in parallel", expected_validation_result, actual_validation_result);
+    }
 
-bool is_delimiter_stack_empty(ValidationState state) { return state.delimiter_stack_size == 0; }
+    ValidationState state = make_validation_state();
+    feed_validation_state(&state, source, source_size);
+    for (int i = 0; i < get_open_delimiter_count(&state); i++)
+    {
+        OpenDelimiter open_delimiter = get_open_delimiter(&state, i);
+        if (open_delimiter.delimiter != (Delimiter)(i * 7 % 3) || open_delimiter.line != i + 1)
+        {
+            all_test_cases_passed = false;
+            printf("Deep nesting test failed: wrong open delimiter %d\n", i);
+        }
+    }
+    deallocate_validation_state(state);
+    free(source);
+}
 
-Delimiter get_last_delimiter(ValidationState state)
-{ 
-    if (state.delimiter_stack_size == 0)
+void report_failed_recovery_test(char* validation_method, int error_i, ValidationResultList errors)
+{
+    all_test_cases_passed = false;
+    printf("Recovery test (%s) failed at error %d, got %d errors:\n", validation_method, error_i, errors.size);
+    for (int i = 0; i < errors.size; i++)
     {
-        printf("`get_last_delimiter` was called on an empty delimiter stack\n");
-        exit(1);
+        char* error_string = validation_result_to_string(errors.data[i]);
+        printf("    %s\n", error_string);
+        free(error_string);
     }
-    return state.delimiter_stack_data[state.delimiter_stack_size - 1];
 }
 
-void pop_delimiter(ValidationState* state) { state->delimiter_stack_size--; }
+ValidationResult make_test_failure(ValidationResultType type, int line, int character, Delimiter delimiter)
+{
+    ValidationResult result;
+    result.type = type;
+    result.error_line = line;
+    result.error_character = character;
+    switch (type)
+    {
+        case ValidationResultTypeExtraClosingDelimiter: result.extra_closing_delimiter = delimiter; break;
+        case ValidationResultTypeUnmatchedDelimiters:
+            result.unmatched_delimiters_count = 1;
+            result.last_unmatched_delimiter = delimiter;
+            break;
+        case ValidationResultTypeUnterminatedQuote: result.unterminated_quote_is_single_quote = delimiter != 0; break;
+        default: break;
+    }
+    return result;
+}
 
-void update_tracking_information(char source, ValidationState* state)
+// A file with an error on most lines has to have all of them reported, whatever the chunk boundaries, and the error
+// limit has to cut the list short
+void test_error_recovery()
 {
-    if (source == '\n')
+    ValidationResult expected_errors[6];
+    expected_errors[0] = make_test_failure(ValidationResultTypeUnmatchedDelimiters, 1, 12, DelimiterBrace);
+    expected_errors[1] = make_test_failure(ValidationResultTypeWrongDelimiter, 2, 12, 0);
+    expected_errors[1].wrong_delimiter_expected = DelimiterBracket;
+    expected_errors[1].wrong_delimiter_actual = DelimiterParenthesis;
+    expected_errors[2] = make_test_failure(ValidationResultTypeExtraClosingDelimiter, 3, 18, DelimiterParenthesis);
+    expected_errors[3] = make_test_failure(ValidationResultTypeUnterminatedQuote, 4, 29, false);
+    expected_errors[4] = make_test_failure(ValidationResultTypeWrongDelimiter, 5, 5, 0);
+    expected_errors[4].wrong_delimiter_expected = DelimiterParenthesis;
+    expected_errors[4].wrong_delimiter_actual = DelimiterBrace;
+    expected_errors[5] = make_test_failure(ValidationResultTypeUnterminatedQuote, 6, 17, true);
+    int expected_error_count = sizeof(expected_errors) / sizeof(expected_errors[0]);
+
+    InputView test_file = open_input_view("test files/test28.txt");
+    for (size_t chunk_size = 1; chunk_size <= test_file.size; chunk_size++)
     {
-        state->line++;
-        state->character = 1;
+        ValidationState state = make_recovering_validation_state(DEFAULT_MAX_RECOVERED_ERROR_COUNT);
+        for (size_t offset = 0; offset < test_file.size; offset += chunk_size)
+        {
+            size_t remaining_size = test_file.size - offset;
+            size_t fed_size = remaining_size < chunk_size ? remaining_size : chunk_size;
+            feed_validation_state(&state, test_file.data + offset, fed_size);
+        }
+        ValidationResultList errors = finish_validation_with_recovery(&state);
+        for (int i = 0; i < expected_error_count || i < errors.size; i++)
+        {
+            if (
+                i >= expected_error_count
+                    || i >= errors.size
+                    || !are_validation_results_equal(errors.data[i], expected_errors[i])
+            )
+            {
+                char validation_method[64];
+                snprintf(validation_method, sizeof(validation_method), "chunks of %zu bytes", chunk_size);
+                report_failed_recovery_test(validation_method, i, errors);
+                break;
+            }
+        }
+        deallocate_validation_result_list(errors);
     }
-    else { state->character++; }
 
-    if (!state->is_inside_comment)
+    ValidationResultList errors = validate_with_recovery(test_file.data, test_file.size, 2);
+    if (
+        errors.size != 2
+            || !errors.is_truncated
+            || !are_validation_results_equal(errors.data[0], expected_errors[1])
+            || !are_validation_results_equal(errors.data[1], expected_errors[2])
+    )
+    { report_failed_recovery_test("at most 2 errors", 0, errors); }
+    deallocate_validation_result_list(errors);
+    close_input_view(test_file);
+}
+
+// One state with caller storage for all test files: it must give the same results as fresh states without ever leaving
+// the storage, until a source nests deeper than the storage holds
+void test_reused_validation_state()
+{
+    uint64_t storage[1024];
+    ValidationState state = make_validation_state_with_storage(storage, sizeof(storage));
+    for (int i = 0; i < test_case_count; i++)
     {
-        if (
-            (source == '"' || source == '\'')
-                && !state->is_escaped
-                && (!state->is_inside_quotes || (source == '\'') == state->is_inside_single_quotes)
-        )
+        InputView test_file = open_input_view(test_file_paths[i]);
+        ValidationResult actual_validation_result = validate_reusing_state(&state, test_file.data, test_file.size);
+        close_input_view(test_file);
+        if (!are_validation_results_equal(actual_validation_result, expected_test_validation_results[i]))
         {
-            state->is_inside_quotes = !state->is_inside_quotes;
-            if (state->is_inside_quotes) { state->is_inside_single_quotes = source == '\''; }
+            report_failed_test_case(
+                test_file_paths[i],
+                "reused state",
+                expected_test_validation_results[i],
+                actual_validation_result
+            );
         }
+    }
+    if (state.delimiter_stack_heap_words != storage)
+    {
+        all_test_cases_passed = false;
+        printf("Reused validation state test failed: the delimiter stack left the storage\n");
+    }
+
+    int depth = (int)(sizeof(storage) / sizeof(uint64_t) / 8 * DELIMITERS_PER_WORD);
+    char* source = malloc(depth);
+    memset(source, '{', depth);
+    ValidationResult actual_validation_result = validate_reusing_state(&state, source, depth);
+    if (
+        actual_validation_result.type != ValidationResultTypeUnmatchedDelimiters
+            || actual_validation_result.unmatched_delimiters_count != depth
+            || actual_validation_result.error_character != depth
+    )
+    {
+        all_test_cases_passed = false;
+        printf("Reused validation state test failed past the storage\n");
+    }
+    free(source);
+    deallocate_validation_state(state);
 
-        state->is_escaped = source == '\\' && !state->is_escaped;
+    char full_message[256];
+    int message_size = format_validation_result(actual_validation_result, full_message, sizeof(full_message));
+    char short_message[16];
+    int short_message_size = format_validation_result(actual_validation_result, short_message, sizeof(short_message));
+    if (
+        short_message_size != message_size
+            || (size_t)message_size != strlen(full_message)
+            || strncmp(short_message, full_message, sizeof(short_message) - 1) != 0
+            || short_message[sizeof(short_message) - 1] != '\0'
+    )
+    {
+        all_test_cases_passed = false;
+        printf("Formatting into a short buffer failed: '%s' from '%s'\n", short_message, full_message);
     }
+}
 
-    if (!state->is_inside_quotes)
+// All test files at once with a shared pool, which exercises stealing, reading ahead and reusing the validation state
+void test_batch_validation()
+{
+#ifdef VALIDATION_HAS_THREADS
+    BatchValidationEntry* entries = validate_in_batch(test_file_paths, test_case_count, 3, 2);
+    for (int i = 0; i < test_case_count; i++)
     {
-        if (!state->is_inside_comment)
+        if (!are_validation_results_equal(entries[i].result, expected_test_validation_results[i]))
         {
-            if (source == '/')
-            {
-                state->line_comment_state_machine++;
-                state->block_comment_state_machine = 1;
-            }
-            else if (source == '*')
-            {
-                if (state->block_comment_state_machine == 1) { state->block_comment_state_machine = 2; }
-            }
-            else
-            {
-                state->line_comment_state_machine = 0;
-                state->block_comment_state_machine = 0;
-            }
+            report_failed_test_case(
+                test_file_paths[i],
+                "batch",
+                expected_test_validation_results[i],
+                entries[i].result
+            );
+        }
+    }
+    free(entries);
+#endif
+}
 
-            if (state->line_comment_state_machine == 2)
-            {
-                state->is_inside_comment = true;
-                state->is_inside_line_comment = true;
+#ifdef VALIDATION_HAS_CACHE
 
-                state->line_comment_state_machine = 0;
-                state->block_comment_state_machine = 0;
-            }
-            else if (state->block_comment_state_machine == 2)
-            {
-                state->is_inside_comment = true;
-                state->is_inside_line_comment = false;
+void report_failed_cache_test(char* reason)
+{
+    all_test_cases_passed = false;
+    printf("Validation cache test failed: %s\n", reason);
+}
+
+ValidationCacheKey make_test_cache_key(int i)
+{
+    ValidationCacheKey result;
+    result.source_hash = (uint64_t)i;
+    result.source_size = (size_t)i;
+    return result;
+}
 
-                state->line_comment_state_machine = 0;
-                state->block_comment_state_machine = 0;
+bool is_test_cache_key_cached(ValidationCache* cache, int i)
+{
+    ValidationResult result;
+    return look_up_validation_result(cache, make_test_cache_key(i), &result);
+}
+
+// The set of keys 0 to `VALIDATION_CACHE_WAYS` after key 0 was used again before the last one was stored, so key 1
+// was used longest ago and got replaced
+void check_test_cache_eviction(ValidationCache* cache)
+{
+    if (is_test_cache_key_cached(cache, 1))
+    { report_failed_cache_test("the least recently used entry wasn't replaced"); }
+    if (!is_test_cache_key_cached(cache, 0) || !is_test_cache_key_cached(cache, VALIDATION_CACHE_WAYS))
+    { report_failed_cache_test("a recently used entry was replaced"); }
+}
+
+#endif
+
+// Every backend has to hand out the test files in the order they were queued and as they are on disk, also when queueing
+// and taking are interleaved, and has to drop the files that were never taken
+void test_input_pipeline()
+{
+    InputPipelineBackend backends[] = {
+        InputPipelineBackendIoUring,
+        InputPipelineBackendThread,
+        InputPipelineBackendSynchronous,
+    };
+    for (int backend_i = 0; backend_i < (int)(sizeof(backends) / sizeof(backends[0])); backend_i++)
+    {
+        InputPipeline* pipeline = make_input_pipeline_with_backend(3, backends[backend_i]);
+        int queued_count = 0;
+        for (int i = 0; i < test_case_count; i++)
+        {
+            for (; queued_count < test_case_count && queued_count <= i * 2; queued_count++)
+            { queue_pipeline_input(pipeline, test_file_paths[queued_count]); }
+            InputView actual_file = take_pipeline_input(pipeline);
+            InputView expected_file = open_input_view(test_file_paths[i]);
+            if (
+                actual_file.size != expected_file.size
+                    || (expected_file.size != 0 && memcmp(actual_file.data, expected_file.data, expected_file.size) != 0)
+            )
+            {
+                all_test_cases_passed = false;
+                printf("Input pipeline test failed for '%s' with backend %d\n", test_file_paths[i], backends[backend_i]);
             }
+            close_input_view(expected_file);
+            close_input_view(actual_file);
         }
-        else
+        for (int i = 0; i < test_case_count; i++) { queue_pipeline_input(pipeline, test_file_paths[i]); }
+        close_input_view(take_pipeline_input(pipeline));
+        deallocate_input_pipeline(pipeline);
+    }
+}
+
+// Every offset of every test file has to map to the line and character that counting from the start gives
+void test_line_index()
+{
+    for (int i = 0; i < test_case_count; i++)
+    {
+        InputView test_file = open_input_view(test_file_paths[i]);
+        LineIndex index = make_line_index(test_file.data, test_file.size);
+        int line = 1;
+        int character = 1;
+        Utf8Decoder utf8_decoder = make_utf8_decoder();
+        for (size_t offset = 0; offset <= test_file.size; offset++)
         {
-            if (state->is_inside_line_comment)
+            SourcePosition position = get_source_position(&index, test_file.data, offset);
+            if (position.line != line || position.character != character)
             {
-                if (source == '\n') { state->is_inside_comment = false; }
+                all_test_cases_passed = false;
+                printf(
+                    "Line index test for file '%s' failed at offset %zu: expected %d:%d; got %d:%d\n",
+                    test_file_paths[i],
+                    offset,
+                    line,
+                    character,
+                    position.line,
+                    position.character
+                );
+                break;
             }
-            else
+            if (offset == test_file.size) { break; }
+            if (test_file.data[offset] == '\n')
             {
-                if (source == '*') { state->block_comment_state_machine = 1; }
-                else if (source == '/' && state->block_comment_state_machine == 1)
-                { state->block_comment_state_machine = 2; }
-                else { state->block_comment_state_machine = 0; }
-
-                if (state->block_comment_state_machine == 2)
+                line++;
+                character = 1;
+                utf8_decoder = make_utf8_decoder();
+                if (get_line_start_offset(&index, line) != offset + 1)
                 {
-                    state->is_inside_comment = false;
-                    state->block_comment_state_machine = 0;
+                    all_test_cases_passed = false;
+                    printf(
+                        "Line index test for file '%s' failed: line %d starts elsewhere\n",
+                        test_file_paths[i],
+                        line
+                    );
                 }
             }
+            else { character += advance_utf8_decoder(&utf8_decoder, (unsigned char)test_file.data[offset]); }
         }
+        deallocate_line_index(index);
+        close_input_view(test_file);
     }
 }
 
-typedef struct
+// Known XXH64 hashes with the seed 0, from the reference implementation, with inputs long enough to go through the
+// 32-byte stripes and short enough for each of the tails
+void test_hash_bytes()
 {
-    bool success;
-    Delimiter delimiter;
-    bool is_opening;
-} ParsedDelimiter;
-
-ParsedDelimiter parse_delimiter(char source)
-{
-    ParsedDelimiter result;
-    switch (source)
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    char* inputs[] = {
+        "",
+        "a",
+        "abc",
+        "Nobody inspects the spammish repetition",
+        "The quick brown fox jumps over the lazy dog",
+    };
+    uint64_t expected_hashes[] = {
+        0xef46db3751d8e999ull,
+        0xd24ec4f1a98c6e5bull,
+        0x44bc2cf5ad770999ull,
+        0xfbcea83c8a378bf1ull,
+        0x0b242d361fda71bcull,
+    };
+    for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++)
     {
-        case '(':
-            result.success = true;
-            result.delimiter = DelimiterParenthesis;
-            result.is_opening = true;
-            break;
-        case '[':
-            result.success = true;
-            result.delimiter = DelimiterBracket;
-            result.is_opening = true;
-            break;
-        case '{':
-            result.success = true;
-            result.delimiter = DelimiterBrace;
-            result.is_opening = true;
-            break;
-        case ')':
-            result.success = true;
-            result.delimiter = DelimiterParenthesis;
-            result.is_opening = false;
-            break;
-        case ']':
-            result.success = true;
-            result.delimiter = DelimiterBracket;
-            result.is_opening = false;
-            break;
-        case '}':
-            result.success = true;
-            result.delimiter = DelimiterBrace;
-            result.is_opening = false;
-            break;
-        default:
-            result.success = false;
-            break;
+        uint64_t actual_hash = hash_bytes(inputs[i], strlen(inputs[i]), 0);
+        if (actual_hash != expected_hashes[i])
+        {
+            all_test_cases_passed = false;
+            printf(
+                "Hash test failed for '%s': expected %016llx, got %016llx\n",
+                inputs[i],
+                (unsigned long long)expected_hashes[i],
+                (unsigned long long)actual_hash
+            );
+        }
     }
-    return result;
+#endif
 }
 
-ValidationResult validate(char* source)
+// The results of all test files go through a cache file and come back the same after reopening it. A cache of a single
+// set then has to replace its least recently used entry, and a damaged cache file has to be started over.
+void test_validation_cache()
 {
-    ValidationState state = make_validation_state();
-    for (int i = 0; source[i] != '\0'; i++)
+#ifdef VALIDATION_HAS_CACHE
+    char* cache_path = "validation cache.tmp";
+    remove(cache_path);
+    for (int pass = 0; pass < 2; pass++)
     {
-        if (!state.is_inside_quotes && !state.is_inside_comment)
+        ValidationCache cache = open_validation_cache(cache_path, test_case_count * VALIDATION_CACHE_WAYS);
+        for (int i = 0; i < test_case_count; i++)
         {
-            ParsedDelimiter parsed_delimiter = parse_delimiter(source[i]);
-            if (!parsed_delimiter.success) { }
-            else if (parsed_delimiter.is_opening) { push_delimiter(parsed_delimiter.delimiter, &state); }
-            else
+            InputView test_file = open_input_view(test_file_paths[i]);
+            ValidationCacheKey key = make_validation_cache_key(test_file.data, test_file.size);
+            ValidationResult cached_result;
+            bool is_cached = look_up_validation_result(&cache, key, &cached_result);
+            ValidationResult actual_validation_result = validate_with_cache(&cache, test_file.data, test_file.size);
+            close_input_view(test_file);
+            if (is_cached != (pass == 1)) { report_failed_cache_test(pass == 0 ? "a hit in a new cache" : "a miss"); }
+            if (!are_validation_results_equal(actual_validation_result, expected_test_validation_results[i]))
             {
-                if (is_delimiter_stack_empty(state))
-                {
-                    ValidationResult result;
-                    result.type = ValidationResultTypeExtraClosingDelimiter;
-                    result.error_line = state.line;
-                    result.error_character = state.character;
-                    result.extra_closing_delimiter = parsed_delimiter.delimiter;
-                    return result;
-                }
-                if (get_last_delimiter(state) != parsed_delimiter.delimiter)
-                {
-                    ValidationResult result;
-                    result.type = ValidationResultTypeWrongDelimiter;
-                    result.error_line = state.line;
-                    result.error_character = state.character;
-                    result.wrong_delimiter_actual = parsed_delimiter.delimiter;
-                    result.wrong_delimiter_expected = get_last_delimiter(state);
-                    return result;
-                }
-                pop_delimiter(&state);
+                report_failed_test_case(
+                    test_file_paths[i],
+                    pass == 0 ? "cache miss" : "cache hit",
+                    expected_test_validation_results[i],
+                    actual_validation_result
+                );
             }
         }
-        update_tracking_information(source[i], &state);
+        if (pass == 1 && cache.is_modified) { report_failed_cache_test("nothing but hits changed the cache"); }
+        if (!close_validation_cache(cache)) { report_failed_cache_test("the cache file couldn't be written"); }
     }
-    if (!is_delimiter_stack_empty(state))
-    {
-        ValidationResult result;
-        result.type = ValidationResultTypeUnmatchedDelimiters;
-        result.unmatched_delimiters_count = get_delimiter_stack_size(state);
-        return result;
-    }
-    if (state.is_inside_quotes)
-    {
-        ValidationResult result;
-        result.type = ValidationResultTypeUnterminatedQuote;
-        result.unterminated_quote_is_single_quote = state.is_inside_single_quotes;
-        return result;
-    }
-    if (state.is_inside_comment && !state.is_inside_line_comment)
-    {
-        ValidationResult result;
-        result.type = ValidationResultTypeUnterminatedBlockComment;
-        return result;
-    }
-    deallocate_validation_state(state);
-    return make_successful_validation_result();
-}
 
-bool all_test_cases_passed = true;
+    remove(cache_path);
+    ValidationCache cache = open_validation_cache(cache_path, VALIDATION_CACHE_WAYS);
+    for (int i = 0; i < VALIDATION_CACHE_WAYS; i++)
+    { store_validation_result(&cache, make_test_cache_key(i), make_successful_validation_result()); }
+    is_test_cache_key_cached(&cache, 0);
+    store_validation_result(&cache, make_test_cache_key(VALIDATION_CACHE_WAYS), make_successful_validation_result());
+    check_test_cache_eviction(&cache);
+    close_validation_cache(cache);
+    cache = open_validation_cache(cache_path, VALIDATION_CACHE_WAYS);
+    check_test_cache_eviction(&cache);
+    close_validation_cache(cache);
+
+    FILE* cache_file = fopen(cache_path, "r+b");
+    fputs("damaged", cache_file);
+    fclose(cache_file);
+    cache = open_validation_cache(cache_path, VALIDATION_CACHE_WAYS);
+    if (is_test_cache_key_cached(&cache, 0)) { report_failed_cache_test("a damaged cache file was used"); }
+    close_validation_cache(cache);
+    remove(cache_path);
+#endif
+}
 
-void test_case(char* test_file_path, ValidationResult expected_validation_result)
+int main(int argument_count, char** arguments)
 {
-    char* test_file_contents = read_file(test_file_path);
-    ValidationResult actual_validation_result = validate(test_file_contents);
-    free(test_file_contents);
-    if (!are_validation_results_equal(actual_validation_result, expected_validation_result))
+    if (argument_count > 1 && strcmp(arguments[1], "--all-errors") == 0)
+    { return run_validation_with_recovery(argument_count - 2, arguments + 2); }
+    if (argument_count > 1 && (strcmp(arguments[1], "--stats") == 0 || strcmp(arguments[1], "--stats-json") == 0))
     {
-        all_test_cases_passed = false;
-        char* expected_validation_result_string = validation_result_to_string(expected_validation_result);
-        char* actual_validation_result_string = validation_result_to_string(actual_validation_result);
-        printf(
-            "Validation test for file '%s' failed: expected %s; got %s\n",
-            test_file_path,
-            expected_validation_result_string,
-            actual_validation_result_string
-        );
-        free(actual_validation_result_string);
-        free(expected_validation_result_string);
+#ifdef VALIDATION_STATS
+        return run_validation_with_stats(argument_count - 2, arguments + 2, strcmp(arguments[1], "--stats-json") == 0);
+#else
+        printf("Statistics aren't collected in this build, configure it with KNR_VALIDATION_STATS=ON\n");
+        return 1;
+#endif
+    }
+    if (argument_count > 1)
+    {
+#ifdef VALIDATION_HAS_THREADS
+        return run_batch_validation(argument_count - 1, arguments + 1);
+#else
+        printf("Validating files from the command line isn't supported on this platform\n");
+        return 1;
+#endif
     }
-}
 
-int main()
-{
     {
         ValidationResult expected_validation_result;
         expected_validation_result.type = ValidationResultTypeUnmatchedDelimiters;
         expected_validation_result.unmatched_delimiters_count = 1;
+        expected_validation_result.last_unmatched_delimiter = DelimiterParenthesis;
+        expected_validation_result.error_line = 1;
+        expected_validation_result.error_character = 1;
         test_case("test files/test1.txt", expected_validation_result);
     }
     test_case("test files/test2.txt", make_successful_validation_result());
@@ -475,6 +763,9 @@ int main()
         ValidationResult expected_validation_result;
         expected_validation_result.type = ValidationResultTypeUnmatchedDelimiters;
         expected_validation_result.unmatched_delimiters_count = 1;
+        expected_validation_result.last_unmatched_delimiter = DelimiterBracket;
+        expected_validation_result.error_line = 1;
+        expected_validation_result.error_character = 1;
         test_case("test files/test3.txt", expected_validation_result);
     }
     test_case("test files/test4.txt", make_successful_validation_result());
@@ -492,6 +783,8 @@ int main()
     {
         ValidationResult expected_validation_result;
         expected_validation_result.type = ValidationResultTypeUnterminatedQuote;
+        expected_validation_result.error_line = 1;
+        expected_validation_result.error_character = 2;
         expected_validation_result.unterminated_quote_is_single_quote = true;
         test_case("test files/test8.txt", expected_validation_result);
     }
@@ -499,6 +792,8 @@ int main()
     {
         ValidationResult expected_validation_result;
         expected_validation_result.type = ValidationResultTypeUnterminatedQuote;
+        expected_validation_result.error_line = 1;
+        expected_validation_result.error_character = 2;
         expected_validation_result.unterminated_quote_is_single_quote = false;
         test_case("test files/test10.txt", expected_validation_result);
     }
@@ -506,6 +801,8 @@ int main()
     {
         ValidationResult expected_validation_result;
         expected_validation_result.type = ValidationResultTypeUnterminatedQuote;
+        expected_validation_result.error_line = 1;
+        expected_validation_result.error_character = 3;
         expected_validation_result.unterminated_quote_is_single_quote = true;
         test_case("test files/test12.txt", expected_validation_result);
     }
@@ -517,12 +814,16 @@ int main()
     {
         ValidationResult expected_validation_result;
         expected_validation_result.type = ValidationResultTypeUnterminatedQuote;
+        expected_validation_result.error_line = 1;
+        expected_validation_result.error_character = 6;
         expected_validation_result.unterminated_quote_is_single_quote = true;
         test_case("test files/test18.txt", expected_validation_result);
     }
     {
         ValidationResult expected_validation_result;
         expected_validation_result.type = ValidationResultTypeUnterminatedQuote;
+        expected_validation_result.error_line = 1;
+        expected_validation_result.error_character = 6;
         expected_validation_result.unterminated_quote_is_single_quote = false;
         test_case("test files/test19.txt", expected_validation_result);
     }
@@ -541,17 +842,51 @@ int main()
         ValidationResult expected_validation_result;
         expected_validation_result.type = ValidationResultTypeUnmatchedDelimiters;
         expected_validation_result.unmatched_delimiters_count = 1;
+        expected_validation_result.last_unmatched_delimiter = DelimiterParenthesis;
+        expected_validation_result.error_line = 1;
+        expected_validation_result.error_character = 1;
         test_case("test files/test24.txt", expected_validation_result);
     }
     {
         ValidationResult expected_validation_result;
         expected_validation_result.type = ValidationResultTypeUnterminatedBlockComment;
+        expected_validation_result.error_line = 1;
+        expected_validation_result.error_character = 3;
         test_case("test files/test25.txt", expected_validation_result);
     }
     test_case("test files/test26.txt", make_successful_validation_result());
+    {
+        ValidationResult expected_validation_result;
+        expected_validation_result.type = ValidationResultTypeWrongDelimiter;
+        expected_validation_result.error_line = 6;
+        expected_validation_result.error_character = 15;
+        expected_validation_result.wrong_delimiter_actual = DelimiterBracket;
+        expected_validation_result.wrong_delimiter_expected = DelimiterBrace;
+        test_case("test files/test27.txt", expected_validation_result);
+    }
+    {
+        // after Japanese in a string and a Chinese identifier, at its display column rather than its byte
+        ValidationResult expected_validation_result;
+        expected_validation_result.type = ValidationResultTypeWrongDelimiter;
+        expected_validation_result.error_line = 4;
+        expected_validation_result.error_character = 59;
+        expected_validation_result.wrong_delimiter_actual = DelimiterBracket;
+        expected_validation_result.wrong_delimiter_expected = DelimiterParenthesis;
+        test_case("test files/test29.txt", expected_validation_result);
+    }
+    test_batch_validation();
+    test_reused_validation_state();
+    test_deep_nesting();
+    test_error_recovery();
+    test_validation_stats();
+    test_hash_bytes();
+    test_validation_cache();
+    test_line_index();
+    test_input_pipeline();
 
     if (all_test_cases_passed)
     {
         printf("All test cases passed!\n");
     }
+    return all_test_cases_passed ? 0 : 1;
 }
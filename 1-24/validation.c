@@ -0,0 +1,2307 @@
+#include "validation.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#ifdef VALIDATION_HAS_THREADS
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef VALIDATION_HAS_CACHE
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "../common/bits.h"
+#include "../common/hash.h"
+#include "../common/input.h"
+#include "../common/pipeline.h"
+#include "../common/strings.h"
+#include "../common/system.h"
+
+char closing_delimiter_to_character(Delimiter source)
+{
+    switch (source)
+    {
+        case DelimiterParenthesis: return ')';
+        case DelimiterBracket: return ']';
+        case DelimiterBrace: return '}';
+        default:
+            printf("`closing_delimiter_to_character` received an invalid argument: %d\n", source);
+            exit(1);
+    }
+}
+
+char opening_delimiter_to_character(Delimiter source)
+{
+    switch (source)
+    {
+        case DelimiterParenthesis: return '(';
+        case DelimiterBracket: return '[';
+        case DelimiterBrace: return '{';
+        default:
+            printf("`opening_delimiter_to_character` received an invalid argument: %d\n", source);
+            exit(1);
+    }
+}
+
+ValidationResult make_successful_validation_result()
+{
+    ValidationResult result;
+    result.type = ValidationResultTypeSuccess;
+    return result;
+}
+
+bool are_validation_results_equal(ValidationResult left, ValidationResult right)
+{
+    if (left.type != right.type) { return false; }
+    switch (left.type)
+    {
+        case ValidationResultTypeSuccess: return true;
+        case ValidationResultTypeExtraClosingDelimiter:
+            return left.error_line == right.error_line
+                && left.error_character == right.error_character
+                && left.extra_closing_delimiter == right.extra_closing_delimiter;
+        case ValidationResultTypeWrongDelimiter:
+            return left.error_line == right.error_line
+                && left.error_character == right.error_character
+                && left.wrong_delimiter_actual == right.wrong_delimiter_actual
+                && left.wrong_delimiter_expected == right.wrong_delimiter_expected;
+        case ValidationResultTypeUnmatchedDelimiters:
+            return left.unmatched_delimiters_count == right.unmatched_delimiters_count
+                && left.last_unmatched_delimiter == right.last_unmatched_delimiter
+                && left.error_line == right.error_line
+                && left.error_character == right.error_character;
+        case ValidationResultTypeUnterminatedQuote:
+            return left.error_line == right.error_line
+                && left.error_character == right.error_character
+                && left.unterminated_quote_is_single_quote == right.unterminated_quote_is_single_quote;
+        case ValidationResultTypeUnterminatedBlockComment:
+            return left.error_line == right.error_line && left.error_character == right.error_character;
+    }
+    return false;
+}
+
+// Works like `snprintf`: writes as much of the message as fits, always NUL-terminated if there's any space, and returns
+// the length of the whole message
+int format_validation_result(ValidationResult validation_result, char* buffer, size_t buffer_size)
+{
+    switch (validation_result.type)
+    {
+        case ValidationResultTypeSuccess:
+            return snprintf(buffer, buffer_size, "successful validation");
+        case ValidationResultTypeExtraClosingDelimiter:
+            return snprintf(
+                buffer,
+                buffer_size,
+                "failed validation: extra '%c' at line %d, character %d",
+                closing_delimiter_to_character(validation_result.extra_closing_delimiter),
+                validation_result.error_line,
+                validation_result.error_character
+            );
+        case ValidationResultTypeWrongDelimiter:
+            return snprintf(
+                buffer,
+                buffer_size,
+                "failed validation: expected '%c' at line %d, character %d, but got '%c'",
+                closing_delimiter_to_character(validation_result.wrong_delimiter_expected),
+                validation_result.error_line,
+                validation_result.error_character,
+                closing_delimiter_to_character(validation_result.wrong_delimiter_actual)
+            );
+        case ValidationResultTypeUnmatchedDelimiters:
+            if (validation_result.unmatched_delimiters_count == 1)
+            {
+                return snprintf(
+                    buffer,
+                    buffer_size,
+                    "failed validation: unmatched '%c' at line %d, character %d",
+                    opening_delimiter_to_character(validation_result.last_unmatched_delimiter),
+                    validation_result.error_line,
+                    validation_result.error_character
+                );
+            }
+            return snprintf(
+                buffer,
+                buffer_size,
+                "failed validation: left %d unmatched delimiters, the last one '%c' at line %d, character %d",
+                validation_result.unmatched_delimiters_count,
+                opening_delimiter_to_character(validation_result.last_unmatched_delimiter),
+                validation_result.error_line,
+                validation_result.error_character
+            );
+        case ValidationResultTypeUnterminatedQuote:
+            return snprintf(
+                buffer,
+                buffer_size,
+                "failed validation: unterminated %s quote at line %d, character %d",
+                validation_result.unterminated_quote_is_single_quote ? "single" : "double",
+                validation_result.error_line,
+                validation_result.error_character
+            );
+        case ValidationResultTypeUnterminatedBlockComment:
+            return snprintf(
+                buffer,
+                buffer_size,
+                "failed validation: unterminated block comment at line %d, character %d",
+                validation_result.error_line,
+                validation_result.error_character
+            );
+        default:
+            printf(
+                "`format_validation_result` received a `ValidationResult` with an invalid `type` value: %d\n",
+                validation_result.type
+            );
+            exit(1);
+    }
+}
+
+char* validation_result_to_string(ValidationResult validation_result)
+{
+    int message_size = format_validation_result(validation_result, NULL, 0);
+    char* message = malloc(message_size + 1);
+    format_validation_result(validation_result, message, message_size + 1);
+    return message;
+}
+
+double get_percentage(size_t part, size_t whole) { return whole == 0 ? 0 : 100.0 * part / whole; }
+
+char* validation_stats_to_string(ValidationStats stats)
+{
+    int stats_string_capacity = 1024;
+    char* stats_string = malloc(stats_string_capacity);
+    snprintf(
+        stats_string,
+        stats_string_capacity,
+        "bytes scanned: %zu\n"
+        "bytes in comments: %zu (%.1f%%)\n"
+        "bytes in strings: %zu (%.1f%%)\n"
+        "max delimiter stack depth: %d\n"
+        "delimiter stack regrowths: %d\n"
+        "scan: %.6f s\n"
+        "parallel suffixes: %.6f s\n"
+        "parallel prefixes: %.6f s\n"
+        "parallel merge: %.6f s\n"
+        "total: %.6f s",
+        stats.bytes_scanned,
+        stats.bytes_in_comments,
+        get_percentage(stats.bytes_in_comments, stats.bytes_scanned),
+        stats.bytes_in_strings,
+        get_percentage(stats.bytes_in_strings, stats.bytes_scanned),
+        stats.max_delimiter_stack_depth,
+        stats.delimiter_stack_regrowth_count,
+        stats.scan_seconds,
+        stats.parallel_suffix_seconds,
+        stats.parallel_prefix_seconds,
+        stats.parallel_merge_seconds,
+        stats.total_seconds
+    );
+    return stats_string;
+}
+
+// The result messages don't contain anything that would need escaping in a JSON string
+char* validation_stats_to_json(ValidationResult result, ValidationStats stats)
+{
+    char* result_string = validation_result_to_string(result);
+    int json_capacity = 2048;
+    char* json = malloc(json_capacity);
+    snprintf(
+        json,
+        json_capacity,
+        "{\"result\": {\"successful\": %s, \"message\": \"%s\"}, \"stats\": {"
+        "\"bytes_scanned\": %zu, \"bytes_in_comments\": %zu, \"bytes_in_strings\": %zu, "
+        "\"max_delimiter_stack_depth\": %d, \"delimiter_stack_regrowth_count\": %d, "
+        "\"scan_seconds\": %.6f, \"parallel_suffix_seconds\": %.6f, \"parallel_prefix_seconds\": %.6f, "
+        "\"parallel_merge_seconds\": %.6f, \"total_seconds\": %.6f}}",
+        result.type == ValidationResultTypeSuccess ? "true" : "false",
+        result_string,
+        stats.bytes_scanned,
+        stats.bytes_in_comments,
+        stats.bytes_in_strings,
+        stats.max_delimiter_stack_depth,
+        stats.delimiter_stack_regrowth_count,
+        stats.scan_seconds,
+        stats.parallel_suffix_seconds,
+        stats.parallel_prefix_seconds,
+        stats.parallel_merge_seconds,
+        stats.total_seconds
+    );
+    free(result_string);
+    return json;
+}
+
+#define LAST_DELIMITER_COUNTING_LEXER_STATE LexerStateCodeAfterSlash
+
+typedef enum
+{
+    ByteClassOther,
+    ByteClassNewline,
+    ByteClassDoubleQuote,
+    ByteClassSingleQuote,
+    ByteClassBackslash,
+    ByteClassSlash,
+    ByteClassStar,
+    // the delimiter classes are laid out so that `Delimiter` and "is opening" can be computed from them directly
+    ByteClassOpeningParenthesis,
+    ByteClassOpeningBracket,
+    ByteClassOpeningBrace,
+    ByteClassClosingParenthesis,
+    ByteClassClosingBracket,
+    ByteClassClosingBrace,
+    ByteClassCount,
+} ByteClass;
+
+const unsigned char byte_classes[256] =
+{
+    ['\n'] = ByteClassNewline,
+    ['"'] = ByteClassDoubleQuote,
+    ['\''] = ByteClassSingleQuote,
+    ['\\'] = ByteClassBackslash,
+    ['/'] = ByteClassSlash,
+    ['*'] = ByteClassStar,
+    ['('] = ByteClassOpeningParenthesis,
+    ['['] = ByteClassOpeningBracket,
+    ['{'] = ByteClassOpeningBrace,
+    [')'] = ByteClassClosingParenthesis,
+    [']'] = ByteClassClosingBracket,
+    ['}'] = ByteClassClosingBrace,
+};
+
+// Delimiters don't affect the lexer, so they take the same transition as any other byte
+#define LEXER_TRANSITIONS(other, newline, double_quote, single_quote, backslash, slash, star) \
+    { other, newline, double_quote, single_quote, backslash, slash, star, other, other, other, other, other, other }
+
+const unsigned char lexer_transitions[LexerStateCount][ByteClassCount] =
+{
+    [LexerStateCode] = LEXER_TRANSITIONS(
+        LexerStateCode, LexerStateCode, LexerStateDoubleQuotes, LexerStateSingleQuotes,
+        LexerStateCodeAfterBackslash, LexerStateCodeAfterSlash, LexerStateCode
+    ),
+    [LexerStateCodeAfterBackslash] = LEXER_TRANSITIONS(
+        LexerStateCode, LexerStateCode, LexerStateCode, LexerStateCode,
+        LexerStateCode, LexerStateCodeAfterSlash, LexerStateCode
+    ),
+    [LexerStateCodeAfterSlash] = LEXER_TRANSITIONS(
+        LexerStateCode, LexerStateCode, LexerStateDoubleQuotes, LexerStateSingleQuotes,
+        LexerStateCodeAfterBackslash, LexerStateLineComment, LexerStateBlockComment
+    ),
+    [LexerStateDoubleQuotes] = LEXER_TRANSITIONS(
+        LexerStateDoubleQuotes, LexerStateDoubleQuotes, LexerStateCode, LexerStateDoubleQuotes,
+        LexerStateDoubleQuotesAfterBackslash, LexerStateDoubleQuotes, LexerStateDoubleQuotes
+    ),
+    [LexerStateDoubleQuotesAfterBackslash] = LEXER_TRANSITIONS(
+        LexerStateDoubleQuotes, LexerStateDoubleQuotes, LexerStateDoubleQuotes, LexerStateDoubleQuotes,
+        LexerStateDoubleQuotes, LexerStateDoubleQuotes, LexerStateDoubleQuotes
+    ),
+    [LexerStateSingleQuotes] = LEXER_TRANSITIONS(
+        LexerStateSingleQuotes, LexerStateSingleQuotes, LexerStateSingleQuotes, LexerStateCode,
+        LexerStateSingleQuotesAfterBackslash, LexerStateSingleQuotes, LexerStateSingleQuotes
+    ),
+    [LexerStateSingleQuotesAfterBackslash] = LEXER_TRANSITIONS(
+        LexerStateSingleQuotes, LexerStateSingleQuotes, LexerStateSingleQuotes, LexerStateSingleQuotes,
+        LexerStateSingleQuotes, LexerStateSingleQuotes, LexerStateSingleQuotes
+    ),
+    [LexerStateLineComment] = LEXER_TRANSITIONS(
+        LexerStateLineComment, LexerStateCode, LexerStateLineComment, LexerStateLineComment,
+        LexerStateLineComment, LexerStateLineComment, LexerStateLineComment
+    ),
+    [LexerStateBlockComment] = LEXER_TRANSITIONS(
+        LexerStateBlockComment, LexerStateBlockComment, LexerStateBlockComment, LexerStateBlockComment,
+        LexerStateBlockComment, LexerStateBlockComment, LexerStateBlockCommentAfterStar
+    ),
+    [LexerStateBlockCommentAfterStar] = LEXER_TRANSITIONS(
+        LexerStateBlockComment, LexerStateBlockComment, LexerStateBlockComment, LexerStateBlockComment,
+        LexerStateBlockComment, LexerStateCode, LexerStateBlockCommentAfterStar
+    ),
+};
+
+bool is_inside_quotes(LexerState state)
+{
+    return state >= LexerStateDoubleQuotes && state <= LexerStateSingleQuotesAfterBackslash;
+}
+
+bool is_inside_block_comment(LexerState state)
+{
+    return state == LexerStateBlockComment || state == LexerStateBlockCommentAfterStar;
+}
+
+ValidationStats make_validation_stats()
+{
+    ValidationStats result;
+    memset(&result, 0, sizeof(result));
+    return result;
+}
+
+// The statistics are gathered through `COUNT_STATS`, which drops its statement unless they are enabled
+#ifdef VALIDATION_STATS
+
+#define COUNT_STATS(statement) statement
+
+// A byte counts as being inside a comment or a string when the lexer is inside one right after it
+void count_lexer_state_bytes(LexerState lexer_state, size_t byte_count, ValidationStats* stats)
+{
+    if (lexer_state >= LexerStateLineComment) { stats->bytes_in_comments += byte_count; }
+    else if (is_inside_quotes(lexer_state)) { stats->bytes_in_strings += byte_count; }
+}
+
+#else
+
+#define COUNT_STATS(statement)
+
+#endif
+
+ValidationResultList make_validation_result_list(int max_size)
+{
+    ValidationResultList result;
+    result.data = NULL;
+    result.size = 0;
+    result.capacity = 0;
+    result.max_size = max_size;
+    result.is_truncated = false;
+    return result;
+}
+
+ValidationState make_validation_state()
+{
+    ValidationState result;
+    result.delimiter_stack_heap_words = NULL;
+    result.delimiter_heap_positions = NULL;
+    result.owns_delimiter_stack_heap = true;
+    result.delimiter_stack_size = 0;
+    result.delimiter_stack_capacity = DELIMITER_STACK_INLINE_CAPACITY;
+    result.line = 1;
+    result.character = 1;
+    result.utf8_decoder = make_utf8_decoder();
+    result.lexer_state = LexerStateCode;
+    result.has_failed = false;
+    result.records_unmatched_closing_delimiters = false;
+    result.unmatched_closing_delimiters_data = NULL;
+    result.unmatched_closing_delimiters_size = 0;
+    result.unmatched_closing_delimiters_capacity = 0;
+    result.recovers_from_errors = false;
+    result.recovered_errors = make_validation_result_list(0);
+    COUNT_STATS(result.stats = make_validation_stats());
+    return result;
+}
+
+ValidationState make_validation_state_with_storage(void* storage, size_t storage_size)
+{
+    ValidationState result = make_validation_state();
+    // every level takes a position and a quarter of a byte, and the capacity is kept to whole words
+    size_t level_size_per_word = sizeof(uint64_t) + sizeof(DelimiterPosition) * DELIMITERS_PER_WORD;
+    size_t word_count = storage_size / level_size_per_word;
+    if (word_count * DELIMITERS_PER_WORD <= DELIMITER_STACK_INLINE_CAPACITY) { return result; }
+    if (word_count * DELIMITERS_PER_WORD > INT32_MAX / 2) { word_count = INT32_MAX / 2 / DELIMITERS_PER_WORD; }
+    result.delimiter_stack_capacity = (int)(word_count * DELIMITERS_PER_WORD);
+    result.delimiter_stack_heap_words = storage;
+    result.delimiter_heap_positions = (DelimiterPosition*)(result.delimiter_stack_heap_words + word_count);
+    result.owns_delimiter_stack_heap = false;
+    return result;
+}
+
+// Prepares the state for validating another source while keeping its buffers
+void reset_validation_state(ValidationState* state)
+{
+    state->delimiter_stack_size = 0;
+    state->line = 1;
+    state->character = 1;
+    state->utf8_decoder = make_utf8_decoder();
+    state->lexer_state = LexerStateCode;
+    state->has_failed = false;
+    state->unmatched_closing_delimiters_size = 0;
+    state->recovered_errors.size = 0;
+    state->recovered_errors.is_truncated = false;
+    COUNT_STATS(state->stats = make_validation_stats());
+}
+
+void deallocate_validation_state(ValidationState state)
+{
+    if (state.owns_delimiter_stack_heap)
+    {
+        free(state.delimiter_stack_heap_words);
+        free(state.delimiter_heap_positions);
+    }
+    free(state.unmatched_closing_delimiters_data);
+    free(state.recovered_errors.data);
+}
+
+// The state can be copied, so the stack can't point into it while it's inline
+uint64_t* get_delimiter_stack_words(ValidationState* state)
+{
+    return state->delimiter_stack_capacity == DELIMITER_STACK_INLINE_CAPACITY
+        ? state->delimiter_stack_inline_words
+        : state->delimiter_stack_heap_words;
+}
+
+DelimiterPosition* get_delimiter_positions(ValidationState* state)
+{
+    return state->delimiter_stack_capacity == DELIMITER_STACK_INLINE_CAPACITY
+        ? state->delimiter_inline_positions
+        : state->delimiter_heap_positions;
+}
+
+Delimiter get_packed_delimiter(uint64_t* words, int index)
+{
+    return (words[index / DELIMITERS_PER_WORD] >> (index % DELIMITERS_PER_WORD * 2)) & 3;
+}
+
+void set_packed_delimiter(uint64_t* words, int index, Delimiter delimiter)
+{
+    int shift = index % DELIMITERS_PER_WORD * 2;
+    uint64_t* word = &words[index / DELIMITERS_PER_WORD];
+    *word = (*word & ~((uint64_t)3 << shift)) | ((uint64_t)delimiter << shift);
+}
+
+size_t get_delimiter_stack_word_count(int delimiter_count)
+{
+    return ((size_t)delimiter_count + DELIMITERS_PER_WORD - 1) / DELIMITERS_PER_WORD;
+}
+
+// Whether the first `size` delimiters of both stacks are the same, ignoring whatever is left in the last word
+bool are_delimiter_stacks_equal(uint64_t* left, uint64_t* right, int size)
+{
+    int full_word_count = size / DELIMITERS_PER_WORD;
+    if (memcmp(left, right, sizeof(uint64_t) * full_word_count) != 0) { return false; }
+    int rest_size = size % DELIMITERS_PER_WORD;
+    if (rest_size == 0) { return true; }
+    uint64_t mask = ((uint64_t)1 << (rest_size * 2)) - 1;
+    return ((left[full_word_count] ^ right[full_word_count]) & mask) == 0;
+}
+
+void grow_delimiter_stack(ValidationState* state)
+{
+    int new_capacity = state->delimiter_stack_capacity * 2;
+    size_t new_word_count = get_delimiter_stack_word_count(new_capacity);
+    if (!state->owns_delimiter_stack_heap || state->delimiter_stack_capacity == DELIMITER_STACK_INLINE_CAPACITY)
+    {
+        uint64_t* words = get_delimiter_stack_words(state);
+        DelimiterPosition* positions = get_delimiter_positions(state);
+        state->delimiter_stack_heap_words = malloc(sizeof(uint64_t) * new_word_count);
+        memcpy(
+            state->delimiter_stack_heap_words,
+            words,
+            sizeof(uint64_t) * get_delimiter_stack_word_count(state->delimiter_stack_capacity)
+        );
+        state->delimiter_heap_positions = malloc(sizeof(DelimiterPosition) * new_capacity);
+        memcpy(
+            state->delimiter_heap_positions,
+            positions,
+            sizeof(DelimiterPosition) * state->delimiter_stack_capacity
+        );
+        state->owns_delimiter_stack_heap = true;
+    }
+    else
+    {
+        state->delimiter_stack_heap_words = realloc(
+            state->delimiter_stack_heap_words,
+            sizeof(uint64_t) * new_word_count
+        );
+        state->delimiter_heap_positions = realloc(
+            state->delimiter_heap_positions,
+            sizeof(DelimiterPosition) * new_capacity
+        );
+    }
+    if (state->delimiter_stack_heap_words == NULL || state->delimiter_heap_positions == NULL)
+    {
+        printf("Failed to grow the delimiter stack to %d levels\n", new_capacity);
+        exit(1);
+    }
+    state->delimiter_stack_capacity = new_capacity;
+    COUNT_STATS(state->stats.delimiter_stack_regrowth_count++);
+}
+
+void push_delimiter(Delimiter delimiter, int line, int character, ValidationState* state)
+{
+    if (state->delimiter_stack_size == state->delimiter_stack_capacity) { grow_delimiter_stack(state); }
+    set_packed_delimiter(get_delimiter_stack_words(state), state->delimiter_stack_size, delimiter);
+    DelimiterPosition* position = &get_delimiter_positions(state)[state->delimiter_stack_size];
+    position->line = line;
+    position->character = character;
+    state->delimiter_stack_size++;
+#ifdef VALIDATION_STATS
+    // every recorded unmatched closing delimiter has closed a delimiter from before the part
+    int depth = state->delimiter_stack_size - state->unmatched_closing_delimiters_size;
+    if (depth > state->stats.max_delimiter_stack_depth) { state->stats.max_delimiter_stack_depth = depth; }
+#endif
+}
+
+int get_delimiter_stack_size(ValidationState* state) { return state->delimiter_stack_size; }
+
+bool is_delimiter_stack_empty(ValidationState* state) { return state->delimiter_stack_size == 0; }
+
+Delimiter get_last_delimiter(ValidationState* state)
+{
+    if (state->delimiter_stack_size == 0)
+    {
+        printf("`get_last_delimiter` was called on an empty delimiter stack\n");
+        exit(1);
+    }
+    return get_packed_delimiter(get_delimiter_stack_words(state), state->delimiter_stack_size - 1);
+}
+
+void pop_delimiter(ValidationState* state) { state->delimiter_stack_size--; }
+
+int get_open_delimiter_count(ValidationState* state) { return state->delimiter_stack_size; }
+
+OpenDelimiter get_open_delimiter(ValidationState* state, int index)
+{
+    if (index < 0 || index >= state->delimiter_stack_size)
+    {
+        printf(
+            "`get_open_delimiter` was called with index %d on %d open delimiters\n",
+            index,
+            state->delimiter_stack_size
+        );
+        exit(1);
+    }
+    OpenDelimiter result;
+    result.delimiter = get_packed_delimiter(get_delimiter_stack_words(state), index);
+    result.line = get_delimiter_positions(state)[index].line;
+    result.character = get_delimiter_positions(state)[index].character;
+    return result;
+}
+
+void record_unmatched_closing_delimiter(Delimiter delimiter, int line, int character, ValidationState* state)
+{
+    if (state->unmatched_closing_delimiters_size == state->unmatched_closing_delimiters_capacity)
+    {
+        state->unmatched_closing_delimiters_capacity = state->unmatched_closing_delimiters_capacity == 0
+            ? 16
+            : state->unmatched_closing_delimiters_capacity * 2;
+        state->unmatched_closing_delimiters_data = realloc(
+            state->unmatched_closing_delimiters_data,
+            sizeof(UnmatchedClosingDelimiter) * state->unmatched_closing_delimiters_capacity
+        );
+    }
+    UnmatchedClosingDelimiter* unmatched_closing_delimiter
+        = &state->unmatched_closing_delimiters_data[state->unmatched_closing_delimiters_size];
+    unmatched_closing_delimiter->delimiter = delimiter;
+    unmatched_closing_delimiter->line = line;
+    unmatched_closing_delimiter->character = character;
+    state->unmatched_closing_delimiters_size++;
+}
+
+void push_validation_result(ValidationResult result, ValidationResultList* list)
+{
+    if (list->size == list->capacity)
+    {
+        list->capacity = list->capacity == 0 ? 16 : list->capacity * 2;
+        list->data = realloc(list->data, sizeof(ValidationResult) * list->capacity);
+    }
+    list->data[list->size] = result;
+    list->size++;
+}
+
+void deallocate_validation_result_list(ValidationResultList list) { free(list.data); }
+
+// Records an error. Returns false if validation has to stop there, which in recovery mode is only once the error list
+// is full.
+bool fail_validation(ValidationResult failure, ValidationState* state)
+{
+    if (state->recovers_from_errors)
+    {
+        push_validation_result(failure, &state->recovered_errors);
+        if (state->recovered_errors.size < state->recovered_errors.max_size) { return true; }
+        state->recovered_errors.is_truncated = true;
+        failure = state->recovered_errors.data[0];
+    }
+    state->has_failed = true;
+    state->failure = failure;
+    return false;
+}
+
+// Guesses what a closing delimiter that doesn't match the last open one was meant to close and pops the stack
+// accordingly, see recovery mode. Returns false if it's taken for an extra closing delimiter.
+bool resynchronize_delimiter_stack(Delimiter delimiter, int line, ValidationState* state)
+{
+    uint64_t* words = get_delimiter_stack_words(state);
+    int last_i = state->delimiter_stack_size - 1;
+    int lowest_i = last_i - RECOVERY_SEARCH_DEPTH < 0 ? 0 : last_i - RECOVERY_SEARCH_DEPTH;
+    for (int i = last_i - 1; i >= lowest_i; i--)
+    {
+        if (get_packed_delimiter(words, i) == delimiter)
+        {
+            state->delimiter_stack_size = i;
+            return true;
+        }
+    }
+    if (get_delimiter_positions(state)[last_i].line != line) { return false; }
+    pop_delimiter(state);
+    return true;
+}
+
+// In recovery mode a newline ends a quote, unless it's escaped
+bool is_quote_cut_by_newline(LexerState lexer_state)
+{
+    return lexer_state == LexerStateDoubleQuotes || lexer_state == LexerStateSingleQuotes;
+}
+
+bool fail_unterminated_quote(LexerState lexer_state, int line, int character, ValidationState* state)
+{
+    ValidationResult failure;
+    failure.type = ValidationResultTypeUnterminatedQuote;
+    failure.error_line = line;
+    failure.error_character = character;
+    failure.unterminated_quote_is_single_quote = lexer_state == LexerStateSingleQuotes;
+    return fail_validation(failure, state);
+}
+
+// Applies an opening or closing delimiter found at the given position. Returns false and records the failure if it
+// doesn't match, unless the state recovers from errors.
+bool handle_delimiter(ByteClass byte_class, int line, int character, ValidationState* state)
+{
+    Delimiter delimiter = (byte_class - ByteClassOpeningParenthesis) % 3;
+    if (byte_class < ByteClassClosingParenthesis)
+    {
+        push_delimiter(delimiter, line, character, state);
+        return true;
+    }
+    if (is_delimiter_stack_empty(state))
+    {
+        if (state->records_unmatched_closing_delimiters)
+        {
+            record_unmatched_closing_delimiter(delimiter, line, character, state);
+            return true;
+        }
+        ValidationResult failure;
+        failure.type = ValidationResultTypeExtraClosingDelimiter;
+        failure.error_line = line;
+        failure.error_character = character;
+        failure.extra_closing_delimiter = delimiter;
+        return fail_validation(failure, state);
+    }
+    if (get_last_delimiter(state) != delimiter)
+    {
+        ValidationResult failure;
+        failure.type = ValidationResultTypeWrongDelimiter;
+        failure.error_line = line;
+        failure.error_character = character;
+        failure.wrong_delimiter_actual = delimiter;
+        failure.wrong_delimiter_expected = get_last_delimiter(state);
+        if (state->recovers_from_errors && !resynchronize_delimiter_stack(delimiter, line, state))
+        {
+            failure.type = ValidationResultTypeExtraClosingDelimiter;
+            failure.extra_closing_delimiter = delimiter;
+        }
+        return fail_validation(failure, state);
+    }
+    pop_delimiter(state);
+    return true;
+}
+
+// Scanning works on 64-byte blocks: for each block we get a bitmask of the bytes that can change the lexer state or the
+// delimiter stack (`()[]{}"'\/*`) and a separate bitmask of its newlines. Everything else is skipped without being
+// looked at individually.
+#define SCAN_BLOCK_SIZE 64
+
+void scan_block_scalar(char* block, uint64_t* specials, uint64_t* newlines)
+{
+    *specials = 0;
+    *newlines = 0;
+    for (int i = 0; i < SCAN_BLOCK_SIZE; i++)
+    {
+        ByteClass byte_class = byte_classes[(unsigned char)block[i]];
+        if (byte_class == ByteClassNewline) { *newlines |= (uint64_t)1 << i; }
+        else if (byte_class != ByteClassOther) { *specials |= (uint64_t)1 << i; }
+    }
+}
+
+#ifdef VALIDATION_HAS_SIMD
+#include <immintrin.h>
+
+void scan_block_sse2(char* block, uint64_t* specials, uint64_t* newlines)
+{
+    *specials = 0;
+    *newlines = 0;
+    for (int offset = 0; offset < SCAN_BLOCK_SIZE; offset += 16)
+    {
+        __m128i bytes = _mm_loadu_si128((__m128i*)(block + offset));
+        __m128i matches = _mm_cmpeq_epi8(bytes, _mm_set1_epi8('('));
+        matches = _mm_or_si128(matches, _mm_cmpeq_epi8(bytes, _mm_set1_epi8(')')));
+        matches = _mm_or_si128(matches, _mm_cmpeq_epi8(bytes, _mm_set1_epi8('[')));
+        matches = _mm_or_si128(matches, _mm_cmpeq_epi8(bytes, _mm_set1_epi8(']')));
+        matches = _mm_or_si128(matches, _mm_cmpeq_epi8(bytes, _mm_set1_epi8('{')));
+        matches = _mm_or_si128(matches, _mm_cmpeq_epi8(bytes, _mm_set1_epi8('}')));
+        matches = _mm_or_si128(matches, _mm_cmpeq_epi8(bytes, _mm_set1_epi8('"')));
+        matches = _mm_or_si128(matches, _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\'')));
+        matches = _mm_or_si128(matches, _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\\')));
+        matches = _mm_or_si128(matches, _mm_cmpeq_epi8(bytes, _mm_set1_epi8('/')));
+        matches = _mm_or_si128(matches, _mm_cmpeq_epi8(bytes, _mm_set1_epi8('*')));
+        *specials |= (uint64_t)(uint16_t)_mm_movemask_epi8(matches) << offset;
+        __m128i newline_matches = _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\n'));
+        *newlines |= (uint64_t)(uint16_t)_mm_movemask_epi8(newline_matches) << offset;
+    }
+}
+
+__attribute__((target("avx2")))
+void scan_block_avx2(char* block, uint64_t* specials, uint64_t* newlines)
+{
+    *specials = 0;
+    *newlines = 0;
+    for (int offset = 0; offset < SCAN_BLOCK_SIZE; offset += 32)
+    {
+        __m256i bytes = _mm256_loadu_si256((__m256i*)(block + offset));
+        __m256i matches = _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('('));
+        matches = _mm256_or_si256(matches, _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(')')));
+        matches = _mm256_or_si256(matches, _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('[')));
+        matches = _mm256_or_si256(matches, _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(']')));
+        matches = _mm256_or_si256(matches, _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('{')));
+        matches = _mm256_or_si256(matches, _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('}')));
+        matches = _mm256_or_si256(matches, _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('"')));
+        matches = _mm256_or_si256(matches, _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\'')));
+        matches = _mm256_or_si256(matches, _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\\')));
+        matches = _mm256_or_si256(matches, _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('/')));
+        matches = _mm256_or_si256(matches, _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('*')));
+        *specials |= (uint64_t)(uint32_t)_mm256_movemask_epi8(matches) << offset;
+        __m256i newline_matches = _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\n'));
+        *newlines |= (uint64_t)(uint32_t)_mm256_movemask_epi8(newline_matches) << offset;
+    }
+}
+
+__attribute__((target("avx512f,avx512bw")))
+void scan_block_avx512(char* block, uint64_t* specials, uint64_t* newlines)
+{
+    __m512i bytes = _mm512_loadu_si512((void*)block);
+    *specials = _mm512_cmpeq_epi8_mask(bytes, _mm512_set1_epi8('('))
+        | _mm512_cmpeq_epi8_mask(bytes, _mm512_set1_epi8(')'))
+        | _mm512_cmpeq_epi8_mask(bytes, _mm512_set1_epi8('['))
+        | _mm512_cmpeq_epi8_mask(bytes, _mm512_set1_epi8(']'))
+        | _mm512_cmpeq_epi8_mask(bytes, _mm512_set1_epi8('{'))
+        | _mm512_cmpeq_epi8_mask(bytes, _mm512_set1_epi8('}'))
+        | _mm512_cmpeq_epi8_mask(bytes, _mm512_set1_epi8('"'))
+        | _mm512_cmpeq_epi8_mask(bytes, _mm512_set1_epi8('\''))
+        | _mm512_cmpeq_epi8_mask(bytes, _mm512_set1_epi8('\\'))
+        | _mm512_cmpeq_epi8_mask(bytes, _mm512_set1_epi8('/'))
+        | _mm512_cmpeq_epi8_mask(bytes, _mm512_set1_epi8('*'));
+    *newlines = _mm512_cmpeq_epi8_mask(bytes, _mm512_set1_epi8('\n'));
+}
+#endif
+
+ScanBlockFunction select_scan_block_function()
+{
+#ifdef VALIDATION_HAS_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512bw")) { return scan_block_avx512; }
+    if (__builtin_cpu_supports("avx2")) { return scan_block_avx2; }
+    return scan_block_sse2;
+#else
+    return scan_block_scalar;
+#endif
+}
+
+int get_available_scan_block_functions(ScanBlockFunction* functions, char** names)
+{
+    int result = 0;
+    functions[result] = scan_block_scalar;
+    names[result++] = "scalar";
+#ifdef VALIDATION_HAS_SIMD
+    functions[result] = scan_block_sse2;
+    names[result++] = "SSE2";
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        functions[result] = scan_block_avx2;
+        names[result++] = "AVX2";
+    }
+    if (__builtin_cpu_supports("avx512bw"))
+    {
+        functions[result] = scan_block_avx512;
+        names[result++] = "AVX-512";
+    }
+#endif
+    return result;
+}
+
+ScanBlockFunction scan_block = NULL;
+
+// Keeps a scanner that was swapped in before the first use
+void select_scan_block() { if (scan_block == NULL) { scan_block = select_scan_block_function(); } }
+
+#ifdef VALIDATION_HAS_THREADS
+pthread_once_t scan_block_selection = PTHREAD_ONCE_INIT;
+#endif
+
+// Picks the scanner on first use, only once even when several threads validate at the same time
+void select_scan_block_once()
+{
+#ifdef VALIDATION_HAS_THREADS
+    pthread_once(&scan_block_selection, select_scan_block);
+#else
+    select_scan_block();
+#endif
+}
+
+// Moves the start of the line forward by the columns that the UTF-8 sequences between `from` and `to` save, so that the
+// character of a position stays its distance from the line start. A newline starts the line over.
+void advance_line_start_over_utf8(
+    char* blocks,
+    size_t from,
+    size_t to,
+    ptrdiff_t* line_start,
+    Utf8Decoder* utf8_decoder
+)
+{
+    for (size_t i = from; i < to; i++)
+    {
+        if (blocks[i] == '\n')
+        {
+            *line_start = (ptrdiff_t)i + 1;
+            utf8_decoder->remaining_size = 0;
+        }
+        else { *line_start += 1 - advance_utf8_decoder(utf8_decoder, (unsigned char)blocks[i]); }
+    }
+}
+
+// Validates the chunk a block at a time, with a partial last block scanned from a copy that is padded with plain bytes.
+// The line and the character are only materialized at the end of the chunk and for delimiters and errors: in between
+// we only remember where the current line started (relative to the chunk, so it's negative if the line started in a
+// previous chunk) and count newlines per block. Blocks with non-ASCII bytes move the line start over their UTF-8
+// sequences, up to each position that needs a character and then to their end, since those aren't a column per byte.
+bool feed_validation_blocks(ValidationState* state, char* blocks, size_t blocks_size)
+{
+    select_scan_block_once();
+    LexerState lexer_state = state->lexer_state;
+    int line = state->line;
+    ptrdiff_t line_start = 1 - (ptrdiff_t)state->character;
+    Utf8Decoder utf8_decoder = state->utf8_decoder;
+    // in recovery mode newlines matter inside quotes as well
+    bool visits_all_newlines = state->recovers_from_errors;
+    char padded_block[SCAN_BLOCK_SIZE];
+    for (size_t block_start = 0; block_start < blocks_size; block_start += SCAN_BLOCK_SIZE)
+    {
+        size_t block_end = blocks_size - block_start < SCAN_BLOCK_SIZE ? blocks_size : block_start + SCAN_BLOCK_SIZE;
+        char* block = blocks + block_start;
+        if (block_end != block_start + SCAN_BLOCK_SIZE)
+        { // the padding has no bits in the masks, so it's never visited
+            memset(padded_block, ' ', SCAN_BLOCK_SIZE);
+            memcpy(padded_block, block, block_end - block_start);
+            block = padded_block;
+        }
+        uint64_t specials;
+        uint64_t newlines;
+        scan_block(block, &specials, &newlines);
+        bool is_ascii = is_ascii_block(block);
+        size_t utf8_position = block_start; // how far the line start has been moved over UTF-8 sequences
+        // newlines only matter to the lexer at the end of a line comment, otherwise they behave like any plain byte
+        uint64_t candidates = specials | newlines;
+        size_t next_unvisited = block_start;
+        while (candidates != 0)
+        {
+            int block_offset = count_trailing_zeros(candidates);
+            candidates &= candidates - 1;
+            size_t position = block_start + block_offset;
+            ByteClass byte_class = byte_classes[(unsigned char)blocks[position]];
+            if (byte_class == ByteClassNewline && lexer_state != LexerStateLineComment && !visits_all_newlines)
+            { continue; }
+            // every byte in between is plain, and any number of plain bytes moves the lexer the same way a single one
+            // does
+            if (position != next_unvisited) { lexer_state = lexer_transitions[lexer_state][ByteClassOther]; }
+            COUNT_STATS(count_lexer_state_bytes(lexer_state, position - next_unvisited, &state->stats));
+            next_unvisited = position + 1;
+
+            bool is_counted_delimiter = byte_class >= ByteClassOpeningParenthesis
+                && lexer_state <= LAST_DELIMITER_COUNTING_LEXER_STATE;
+            bool is_cut_quote = !is_counted_delimiter
+                && visits_all_newlines
+                && byte_class == ByteClassNewline
+                && is_quote_cut_by_newline(lexer_state);
+            if (is_counted_delimiter || is_cut_quote)
+            {
+                uint64_t newlines_before = newlines & (((uint64_t)1 << block_offset) - 1);
+                ptrdiff_t current_line_start = newlines_before == 0
+                    ? line_start
+                    : (ptrdiff_t)(block_start + SCAN_BLOCK_SIZE - count_leading_zeros(newlines_before));
+                if (!is_ascii)
+                {
+                    advance_line_start_over_utf8(blocks, utf8_position, position, &line_start, &utf8_decoder);
+                    utf8_position = position;
+                    current_line_start = line_start;
+                }
+                int position_line = line + count_set_bits(newlines_before);
+                int position_character = (int)((ptrdiff_t)position - current_line_start + 1);
+                if (is_counted_delimiter && !handle_delimiter(byte_class, position_line, position_character, state))
+                {
+                    COUNT_STATS(state->stats.bytes_scanned += position + 1);
+                    return false;
+                }
+                if (is_cut_quote)
+                {
+                    if (!fail_unterminated_quote(lexer_state, position_line, position_character, state))
+                    { return false; }
+                    lexer_state = LexerStateCode;
+                }
+            }
+            lexer_state = lexer_transitions[lexer_state][byte_class];
+            COUNT_STATS(count_lexer_state_bytes(lexer_state, 1, &state->stats));
+        }
+        if (next_unvisited != block_end)
+        {
+            lexer_state = lexer_transitions[lexer_state][ByteClassOther];
+            COUNT_STATS(count_lexer_state_bytes(lexer_state, block_end - next_unvisited, &state->stats));
+        }
+
+        line += count_set_bits(newlines);
+        if (!is_ascii) { advance_line_start_over_utf8(blocks, utf8_position, block_end, &line_start, &utf8_decoder); }
+        else
+        {
+            utf8_decoder.remaining_size = 0;
+            if (newlines != 0) { line_start = block_start + SCAN_BLOCK_SIZE - count_leading_zeros(newlines); }
+        }
+    }
+    state->lexer_state = lexer_state;
+    state->line = line;
+    state->character = (int)((ptrdiff_t)blocks_size - line_start + 1);
+    state->utf8_decoder = utf8_decoder;
+    COUNT_STATS(state->stats.bytes_scanned += blocks_size);
+    return true;
+}
+
+// Feeds the next `chunk_size` bytes of the source to the validator. The whole lexer state lives in `ValidationState`, so
+// the source can be split at any byte, even in the middle of a "/*", an escape sequence or a quoted string. Returns
+// false once the outcome is already known, in which case the rest of the source doesn't need to be fed.
+bool feed_validation_state(ValidationState* state, char* chunk, size_t chunk_size)
+{
+    if (state->has_failed) { return false; }
+    return feed_validation_blocks(state, chunk, chunk_size);
+}
+
+// Counts the line and the character byte by byte, which the block scanning only does for delimiters and errors
+void update_tracking_information(unsigned char byte, ByteClass byte_class, ValidationState* state)
+{
+    // a newline resets the decoder like any ASCII byte
+    int width = advance_utf8_decoder(&state->utf8_decoder, byte);
+    if (byte_class == ByteClassNewline)
+    {
+        state->line++;
+        state->character = 1;
+    }
+    else { state->character += width; }
+
+    state->lexer_state = lexer_transitions[state->lexer_state][byte_class];
+}
+
+bool feed_validation_state_bytewise(ValidationState* state, char* chunk, size_t chunk_size)
+{
+    if (state->has_failed) { return false; }
+    for (size_t i = 0; i < chunk_size; i++)
+    {
+        ByteClass byte_class = byte_classes[(unsigned char)chunk[i]];
+        COUNT_STATS(state->stats.bytes_scanned++);
+        if (
+            byte_class >= ByteClassOpeningParenthesis
+                && state->lexer_state <= LAST_DELIMITER_COUNTING_LEXER_STATE
+                && !handle_delimiter(byte_class, state->line, state->character, state)
+        )
+        { return false; }
+        if (
+            state->recovers_from_errors
+                && byte_class == ByteClassNewline
+                && is_quote_cut_by_newline(state->lexer_state)
+        )
+        {
+            if (!fail_unterminated_quote(state->lexer_state, state->line, state->character, state)) { return false; }
+            state->lexer_state = LexerStateCode;
+        }
+        update_tracking_information((unsigned char)chunk[i], byte_class, state);
+        COUNT_STATS(count_lexer_state_bytes(state->lexer_state, 1, &state->stats));
+    }
+    return true;
+}
+
+// Produces the result for everything fed so far
+// Whether the source ends inside a quote or a block comment, which is then reported at the end of the source
+bool get_unterminated_failure(ValidationState* state, ValidationResult* failure)
+{
+    if (is_inside_quotes(state->lexer_state))
+    {
+        failure->type = ValidationResultTypeUnterminatedQuote;
+        failure->unterminated_quote_is_single_quote = state->lexer_state >= LexerStateSingleQuotes;
+    }
+    else if (is_inside_block_comment(state->lexer_state))
+    { failure->type = ValidationResultTypeUnterminatedBlockComment; }
+    else { return false; }
+    failure->error_line = state->line;
+    failure->error_character = state->character;
+    return true;
+}
+
+ValidationResult get_validation_result(ValidationState* state)
+{
+    ValidationResult result;
+    if (state->has_failed) { result = state->failure; }
+    else if (!is_delimiter_stack_empty(state))
+    {
+        OpenDelimiter last_open_delimiter = get_open_delimiter(state, get_delimiter_stack_size(state) - 1);
+        result.type = ValidationResultTypeUnmatchedDelimiters;
+        result.unmatched_delimiters_count = get_delimiter_stack_size(state);
+        result.last_unmatched_delimiter = last_open_delimiter.delimiter;
+        result.error_line = last_open_delimiter.line;
+        result.error_character = last_open_delimiter.character;
+    }
+    else if (!get_unterminated_failure(state, &result)) { result = make_successful_validation_result(); }
+    return result;
+}
+
+// Produces the result for everything fed so far and releases the state
+ValidationResult finish_validation(ValidationState* state)
+{
+    ValidationResult result = get_validation_result(state);
+    deallocate_validation_state(*state);
+    return result;
+}
+
+// Parallel validation splits the source into chunks. A chunk can't know the lexer state it starts in, so each one first
+// runs the lexer from every possible entry state at once until all of them agree, which in real code happens within
+// the first line that has a comment with a quote in it. After that point nothing in the chunk depends on what came
+// before it except for the delimiter stack, so the rest of the chunk (the suffix) is validated right away from that
+// state on a stack of its own, in parallel. What's left of it is a summary: the closing delimiters that have to match
+// delimiters opened in earlier chunks, the first error inside it if there is one, and the delimiters it leaves open.
+// Once all chunks are done their exit states are known, which gives the real entry state of every chunk, and the
+// prefixes before the convergence points are summarized the same way, also in parallel. The summaries are then reduced
+// in order, which gives exactly the result and the error position of a serial run.
+typedef struct
+{
+    char* data;
+    size_t size;
+    size_t offset; // in the source, whose bytes before the chunk can complete a UTF-8 sequence that the chunk starts in
+    // the size of the prefix after which the lexer state no longer depends on the entry state, or the whole size if that
+    // never happens
+    size_t prefix_size;
+    unsigned char prefix_exit_lexer_states[LexerStateCount]; // indexed by the entry lexer state
+    LexerState entry_lexer_state;
+    ValidationState prefix_summary;
+    ValidationState suffix_summary;
+} ValidationChunk;
+
+void apply_byte_class_to_lexer_states(ByteClass byte_class, unsigned char* lexer_states)
+{
+    for (int i = 0; i < LexerStateCount; i++) { lexer_states[i] = lexer_transitions[lexer_states[i]][byte_class]; }
+}
+
+bool have_lexer_states_converged(unsigned char* lexer_states)
+{
+    for (int i = 1; i < LexerStateCount; i++)
+    {
+        if (lexer_states[i] != lexer_states[0]) { return false; }
+    }
+    return true;
+}
+
+void find_chunk_convergence(ValidationChunk* chunk)
+{
+    unsigned char* lexer_states = chunk->prefix_exit_lexer_states;
+    for (int i = 0; i < LexerStateCount; i++) { lexer_states[i] = i; }
+    size_t blocks_size = chunk->size - chunk->size % SCAN_BLOCK_SIZE;
+    for (size_t block_start = 0; block_start < blocks_size; block_start += SCAN_BLOCK_SIZE)
+    {
+        uint64_t specials;
+        uint64_t newlines;
+        scan_block(chunk->data + block_start, &specials, &newlines);
+        uint64_t candidates = specials | newlines;
+        size_t next_unvisited = block_start;
+        while (candidates != 0)
+        {
+            size_t position = block_start + count_trailing_zeros(candidates);
+            candidates &= candidates - 1;
+            if (position != next_unvisited) { apply_byte_class_to_lexer_states(ByteClassOther, lexer_states); }
+            next_unvisited = position + 1;
+            apply_byte_class_to_lexer_states(byte_classes[(unsigned char)chunk->data[position]], lexer_states);
+        }
+        if (next_unvisited != block_start + SCAN_BLOCK_SIZE)
+        { apply_byte_class_to_lexer_states(ByteClassOther, lexer_states); }
+
+        if (have_lexer_states_converged(lexer_states))
+        {
+            chunk->prefix_size = block_start + SCAN_BLOCK_SIZE;
+            return;
+        }
+    }
+    for (size_t i = blocks_size; i < chunk->size; i++)
+    { apply_byte_class_to_lexer_states(byte_classes[(unsigned char)chunk->data[i]], lexer_states); }
+    chunk->prefix_size = chunk->size;
+}
+
+ValidationState summarize_validation_chunk_part(
+    char* part,
+    size_t part_size,
+    size_t part_offset,
+    LexerState entry_lexer_state
+)
+{
+    ValidationState result = make_validation_state();
+    result.lexer_state = entry_lexer_state;
+    result.utf8_decoder = make_utf8_decoder_before(part, part_offset);
+    result.records_unmatched_closing_delimiters = true;
+    feed_validation_state(&result, part, part_size);
+    return result;
+}
+
+void summarize_validation_chunk_suffix(ValidationChunk* chunk)
+{
+    find_chunk_convergence(chunk);
+    chunk->suffix_summary = summarize_validation_chunk_part(
+        chunk->data + chunk->prefix_size,
+        chunk->size - chunk->prefix_size,
+        chunk->offset + chunk->prefix_size,
+        chunk->prefix_exit_lexer_states[0]
+    );
+}
+
+void summarize_validation_chunk_prefix(ValidationChunk* chunk)
+{
+    chunk->prefix_summary = summarize_validation_chunk_part(
+        chunk->data,
+        chunk->prefix_size,
+        chunk->offset,
+        chunk->entry_lexer_state
+    );
+}
+
+typedef struct
+{
+    ValidationChunk* chunks;
+    int chunk_count;
+    atomic_int next_chunk_i;
+    void (*process_chunk)(ValidationChunk* chunk);
+} ValidationChunkQueue;
+
+void* run_validation_chunk_worker(void* queue_pointer)
+{
+    ValidationChunkQueue* queue = queue_pointer;
+    while (true)
+    {
+        int chunk_i = atomic_fetch_add(&queue->next_chunk_i, 1);
+        if (chunk_i >= queue->chunk_count) { break; }
+        queue->process_chunk(&queue->chunks[chunk_i]);
+    }
+    return NULL;
+}
+
+void process_validation_chunks(
+    ValidationChunk* chunks,
+    int chunk_count,
+    int thread_count,
+    void (*process_chunk)(ValidationChunk* chunk)
+)
+{
+    ValidationChunkQueue queue;
+    queue.chunks = chunks;
+    queue.chunk_count = chunk_count;
+    atomic_init(&queue.next_chunk_i, 0);
+    queue.process_chunk = process_chunk;
+#ifdef VALIDATION_HAS_THREADS
+    if (thread_count > chunk_count) { thread_count = chunk_count; }
+    pthread_t* threads = malloc(sizeof(pthread_t) * thread_count);
+    int started_thread_count = 0;
+    // the calling thread is a worker too
+    for (int i = 1; i < thread_count; i++)
+    {
+        if (pthread_create(&threads[started_thread_count], NULL, run_validation_chunk_worker, &queue) != 0) { break; }
+        started_thread_count++;
+    }
+    run_validation_chunk_worker(&queue);
+    for (int i = 0; i < started_thread_count; i++) { pthread_join(threads[i], NULL); }
+    free(threads);
+#else
+    (void)thread_count;
+    run_validation_chunk_worker(&queue);
+#endif
+}
+
+// Moves an absolute position forward by a position that is relative to the start of a chunk
+void advance_position(int relative_line, int relative_character, int* line, int* character)
+{
+    if (relative_line == 1) { *character += relative_character - 1; }
+    else
+    {
+        *line += relative_line - 1;
+        *character = relative_character;
+    }
+}
+
+// Applies the summary of the next part of the source to the state of everything before it. Returns false if that
+// results in a failure.
+bool merge_validation_summary(ValidationState* summary, ValidationState* state)
+{
+#ifdef VALIDATION_STATS
+    int entry_depth = state->delimiter_stack_size;
+    if (entry_depth + summary->stats.max_delimiter_stack_depth > state->stats.max_delimiter_stack_depth)
+    { state->stats.max_delimiter_stack_depth = entry_depth + summary->stats.max_delimiter_stack_depth; }
+#endif
+    for (int i = 0; i < summary->unmatched_closing_delimiters_size; i++)
+    {
+        UnmatchedClosingDelimiter unmatched_closing_delimiter = summary->unmatched_closing_delimiters_data[i];
+        int line = state->line;
+        int character = state->character;
+        advance_position(unmatched_closing_delimiter.line, unmatched_closing_delimiter.character, &line, &character);
+        ByteClass byte_class = ByteClassClosingParenthesis + unmatched_closing_delimiter.delimiter;
+        if (!handle_delimiter(byte_class, line, character, state)) { return false; }
+    }
+    if (summary->has_failed)
+    { // only wrong delimiters can fail a summary, closing delimiters without a pair are recorded instead
+        state->has_failed = true;
+        state->failure = summary->failure;
+        advance_position(
+            summary->failure.error_line,
+            summary->failure.error_character,
+            &state->line,
+            &state->character
+        );
+        state->failure.error_line = state->line;
+        state->failure.error_character = state->character;
+        return false;
+    }
+    int line = state->line;
+    int character = state->character;
+    for (int i = 0; i < summary->delimiter_stack_size; i++)
+    {
+        OpenDelimiter open_delimiter = get_open_delimiter(summary, i);
+        int delimiter_line = line;
+        int delimiter_character = character;
+        advance_position(open_delimiter.line, open_delimiter.character, &delimiter_line, &delimiter_character);
+        push_delimiter(open_delimiter.delimiter, delimiter_line, delimiter_character, state);
+    }
+    advance_position(summary->line, summary->character, &state->line, &state->character);
+    state->lexer_state = summary->lexer_state;
+    return true;
+}
+
+ValidationResult run_parallel_validation(
+    char* source,
+    size_t source_size,
+    int chunk_count,
+    int thread_count,
+    ValidationStats* stats
+)
+{
+    COUNT_STATS(double start_time = get_seconds());
+    select_scan_block_once();
+    if ((size_t)chunk_count > source_size) { chunk_count = source_size == 0 ? 1 : (int)source_size; }
+    ValidationChunk* chunks = malloc(sizeof(ValidationChunk) * chunk_count);
+    for (int i = 0; i < chunk_count; i++)
+    {
+        size_t chunk_start = source_size / chunk_count * i;
+        size_t chunk_end = i == chunk_count - 1 ? source_size : source_size / chunk_count * (i + 1);
+        chunks[i].data = source + chunk_start;
+        chunks[i].size = chunk_end - chunk_start;
+        chunks[i].offset = chunk_start;
+    }
+
+    process_validation_chunks(chunks, chunk_count, thread_count, summarize_validation_chunk_suffix);
+    COUNT_STATS(double suffix_end_time = get_seconds());
+    LexerState lexer_state = LexerStateCode;
+    for (int i = 0; i < chunk_count; i++)
+    {
+        chunks[i].entry_lexer_state = lexer_state;
+        lexer_state = chunks[i].prefix_size == chunks[i].size
+            ? chunks[i].prefix_exit_lexer_states[lexer_state]
+            : chunks[i].suffix_summary.lexer_state;
+    }
+    process_validation_chunks(chunks, chunk_count, thread_count, summarize_validation_chunk_prefix);
+    COUNT_STATS(double prefix_end_time = get_seconds());
+
+    ValidationState state = make_validation_state();
+    for (int i = 0; i < chunk_count; i++)
+    {
+        if (!merge_validation_summary(&chunks[i].prefix_summary, &state)) { break; }
+        // without a convergence point the prefix is the whole chunk and the suffix summary is meaningless
+        if (chunks[i].prefix_size == chunks[i].size) { continue; }
+        if (!merge_validation_summary(&chunks[i].suffix_summary, &state)) { break; }
+    }
+
+#ifdef VALIDATION_STATS
+    // every chunk has been scanned whole, even when the merge stopped early
+    for (int i = 0; i < chunk_count; i++)
+    {
+        ValidationState* summaries[] = {&chunks[i].prefix_summary, &chunks[i].suffix_summary};
+        for (int j = 0; j < 2; j++)
+        {
+            state.stats.bytes_scanned += summaries[j]->stats.bytes_scanned;
+            state.stats.bytes_in_comments += summaries[j]->stats.bytes_in_comments;
+            state.stats.bytes_in_strings += summaries[j]->stats.bytes_in_strings;
+            state.stats.delimiter_stack_regrowth_count += summaries[j]->stats.delimiter_stack_regrowth_count;
+        }
+    }
+    double end_time = get_seconds();
+    state.stats.parallel_suffix_seconds = suffix_end_time - start_time;
+    state.stats.parallel_prefix_seconds = prefix_end_time - suffix_end_time;
+    state.stats.parallel_merge_seconds = end_time - prefix_end_time;
+    state.stats.total_seconds = end_time - start_time;
+    if (stats != NULL) { *stats = state.stats; }
+#else
+    (void)stats;
+#endif
+    for (int i = 0; i < chunk_count; i++)
+    {
+        deallocate_validation_state(chunks[i].prefix_summary);
+        deallocate_validation_state(chunks[i].suffix_summary);
+    }
+    free(chunks);
+    return finish_validation(&state);
+}
+
+ValidationResult validate_in_parallel(char* source, size_t source_size, int chunk_count, int thread_count)
+{
+    return run_parallel_validation(source, source_size, chunk_count, thread_count, NULL);
+}
+
+ValidationResult run_validation(char* source, size_t source_size, ValidationStats* stats)
+{
+    // asking for the processor count is a system call, which small sources shouldn't pay for
+    if (source_size >= PARALLEL_VALIDATION_MIN_SIZE)
+    {
+        int processor_count = get_processor_count();
+        if (processor_count > 1)
+        { return run_parallel_validation(source, source_size, processor_count, processor_count, stats); }
+    }
+
+    COUNT_STATS(double start_time = get_seconds());
+    ValidationState state = make_validation_state();
+    feed_validation_state(&state, source, source_size);
+#ifdef VALIDATION_STATS
+    state.stats.scan_seconds = get_seconds() - start_time;
+    state.stats.total_seconds = state.stats.scan_seconds;
+    if (stats != NULL) { *stats = state.stats; }
+#else
+    (void)stats;
+#endif
+    return finish_validation(&state);
+}
+
+ValidationResult validate(char* source, size_t source_size) { return run_validation(source, source_size, NULL); }
+
+ValidationResult validate_reusing_state(ValidationState* state, char* source, size_t source_size)
+{
+    reset_validation_state(state);
+    feed_validation_state(state, source, source_size);
+    return get_validation_result(state);
+}
+
+#ifdef VALIDATION_STATS
+ValidationResult validate_with_stats(char* source, size_t source_size, ValidationStats* stats)
+{
+    return run_validation(source, source_size, stats);
+}
+
+ValidationResult validate_in_parallel_with_stats(
+    char* source,
+    size_t source_size,
+    int chunk_count,
+    int thread_count,
+    ValidationStats* stats
+)
+{
+    return run_parallel_validation(source, source_size, chunk_count, thread_count, stats);
+}
+#endif
+
+ValidationState make_recovering_validation_state(int max_error_count)
+{
+    if (max_error_count < 1) { printf("The error limit has to be positive, got %d\n", max_error_count); exit(1); }
+    ValidationState result = make_validation_state();
+    result.recovers_from_errors = true;
+    result.recovered_errors.max_size = max_error_count;
+    return result;
+}
+
+bool is_validation_result_before(ValidationResult left, ValidationResult right)
+{
+    return left.error_line < right.error_line
+        || (left.error_line == right.error_line && left.error_character < right.error_character);
+}
+
+ValidationResultList finish_validation_with_recovery(ValidationState* state)
+{
+    ValidationResultList found_errors = state->recovered_errors;
+    state->recovered_errors.data = NULL;
+    ValidationResultList end_errors = make_validation_result_list(found_errors.max_size);
+    if (!found_errors.is_truncated)
+    {
+        for (int i = 0; i < get_open_delimiter_count(state); i++)
+        {
+            OpenDelimiter open_delimiter = get_open_delimiter(state, i);
+            ValidationResult failure;
+            failure.type = ValidationResultTypeUnmatchedDelimiters;
+            failure.error_line = open_delimiter.line;
+            failure.error_character = open_delimiter.character;
+            failure.unmatched_delimiters_count = 1;
+            failure.last_unmatched_delimiter = open_delimiter.delimiter;
+            push_validation_result(failure, &end_errors);
+        }
+        ValidationResult failure;
+        if (get_unterminated_failure(state, &failure)) { push_validation_result(failure, &end_errors); }
+    }
+    deallocate_validation_state(*state);
+
+    // both lists are sorted already
+    ValidationResultList result = make_validation_result_list(found_errors.max_size);
+    result.is_truncated = found_errors.is_truncated;
+    int found_i = 0;
+    int end_i = 0;
+    while (found_i < found_errors.size || end_i < end_errors.size)
+    {
+        if (result.size == result.max_size)
+        {
+            result.is_truncated = true;
+            break;
+        }
+        bool takes_found_error = end_i == end_errors.size
+            || (found_i < found_errors.size
+                && !is_validation_result_before(end_errors.data[end_i], found_errors.data[found_i]));
+        push_validation_result(
+            takes_found_error ? found_errors.data[found_i++] : end_errors.data[end_i++],
+            &result
+        );
+    }
+    deallocate_validation_result_list(found_errors);
+    deallocate_validation_result_list(end_errors);
+    return result;
+}
+
+ValidationResultList validate_with_recovery(char* source, size_t source_size, int max_error_count)
+{
+    ValidationState state = make_recovering_validation_state(max_error_count);
+    feed_validation_state(&state, source, source_size);
+    return finish_validation_with_recovery(&state);
+}
+
+#define VALIDATION_CHUNK_SIZE (64 * 1024)
+
+// Validates a file of any size while only ever holding a single chunk of it in memory
+ValidationResult validate_file(char* file_path)
+{
+    FILE* file_handle = fopen(file_path, "rb");
+    if (file_handle == NULL) { printf("Failed to open file '%s'\n", file_path); exit(1); }
+    char* chunk = malloc(VALIDATION_CHUNK_SIZE);
+    ValidationState state = make_validation_state();
+    size_t chunk_size;
+    while ((chunk_size = fread(chunk, 1, VALIDATION_CHUNK_SIZE, file_handle)) > 0)
+    {
+        if (!feed_validation_state(&state, chunk, chunk_size)) { break; }
+    }
+    free(chunk);
+    fclose(file_handle);
+    return finish_validation(&state);
+}
+
+ValidationResult validate_in_chunks(char* source, size_t source_size, size_t chunk_size)
+{
+    ValidationState state = make_validation_state();
+    for (size_t offset = 0; offset < source_size; offset += chunk_size)
+    {
+        size_t remaining_size = source_size - offset;
+        if (!feed_validation_state(&state, source + offset, remaining_size < chunk_size ? remaining_size : chunk_size))
+        { break; }
+    }
+    return finish_validation(&state);
+}
+
+ValidationCheckpoint make_validation_checkpoint(ValidationState* state, size_t offset)
+{
+    ValidationCheckpoint result;
+    result.offset = offset;
+    result.line = state->line;
+    result.character = state->character;
+    result.utf8_decoder = state->utf8_decoder;
+    result.lexer_state = state->lexer_state;
+    result.delimiter_stack_size = state->delimiter_stack_size;
+    size_t word_count = get_delimiter_stack_word_count(state->delimiter_stack_size);
+    result.delimiter_stack_words = malloc(sizeof(uint64_t) * (word_count + 1));
+    memcpy(result.delimiter_stack_words, get_delimiter_stack_words(state), sizeof(uint64_t) * word_count);
+    result.delimiter_positions = malloc(sizeof(DelimiterPosition) * (state->delimiter_stack_size + 1));
+    memcpy(
+        result.delimiter_positions,
+        get_delimiter_positions(state),
+        sizeof(DelimiterPosition) * state->delimiter_stack_size
+    );
+    return result;
+}
+
+void deallocate_validation_checkpoint(ValidationCheckpoint checkpoint)
+{
+    free(checkpoint.delimiter_stack_words);
+    free(checkpoint.delimiter_positions);
+}
+
+ValidationState make_validation_state_from_checkpoint(ValidationCheckpoint checkpoint)
+{
+    ValidationState result = make_validation_state();
+    for (int i = 0; i < checkpoint.delimiter_stack_size; i++)
+    {
+        push_delimiter(
+            get_packed_delimiter(checkpoint.delimiter_stack_words, i),
+            checkpoint.delimiter_positions[i].line,
+            checkpoint.delimiter_positions[i].character,
+            &result
+        );
+    }
+    result.line = checkpoint.line;
+    result.character = checkpoint.character;
+    result.utf8_decoder = checkpoint.utf8_decoder;
+    result.lexer_state = checkpoint.lexer_state;
+    return result;
+}
+
+// Whether validating on from the checkpoint and from the state would give the same results, apart from the positions
+bool does_validation_state_match_checkpoint(ValidationState* state, ValidationCheckpoint checkpoint)
+{
+    return state->lexer_state == checkpoint.lexer_state
+        && state->character == checkpoint.character
+        && are_utf8_decoders_equal(state->utf8_decoder, checkpoint.utf8_decoder)
+        && state->delimiter_stack_size == checkpoint.delimiter_stack_size
+        && are_delimiter_stacks_equal(
+            get_delimiter_stack_words(state),
+            checkpoint.delimiter_stack_words,
+            state->delimiter_stack_size
+        );
+}
+
+// Gives the position of an open delimiter recorded before an edit, once validation after the edit has converged on an
+// old checkpoint. If the delimiter was already open at that checkpoint it's the one at the same depth in the current
+// state, otherwise it was opened after the checkpoint and only its line has moved.
+DelimiterPosition rebase_delimiter_position(
+    DelimiterPosition position,
+    int index,
+    ValidationCheckpoint converged_checkpoint,
+    ValidationState* state
+)
+{
+    if (
+        position.line < converged_checkpoint.line
+            || (position.line == converged_checkpoint.line && position.character < converged_checkpoint.character)
+    )
+    { return get_delimiter_positions(state)[index]; }
+    position.line += state->line - converged_checkpoint.line;
+    return position;
+}
+
+void push_validation_checkpoint(ValidationCheckpoint checkpoint, IncrementalValidation* validation)
+{
+    if (validation->checkpoints_size == validation->checkpoints_capacity)
+    {
+        validation->checkpoints_capacity *= 2;
+        validation->checkpoints_data = realloc(
+            validation->checkpoints_data,
+            sizeof(ValidationCheckpoint) * validation->checkpoints_capacity
+        );
+    }
+    validation->checkpoints_data[validation->checkpoints_size] = checkpoint;
+    validation->checkpoints_size++;
+}
+
+// Validates the source from the state at `offset` on, recording a checkpoint every `checkpoint_interval` bytes. If
+// `old_checkpoints` is given, which have to be sorted and shifted to the current offsets, it stops at the first one the
+// state matches, and keeps it and the ones after it with their line numbers adjusted.
+void continue_incremental_validation(
+    char* source,
+    size_t source_size,
+    size_t offset,
+    ValidationState* state,
+    ValidationCheckpoint* old_checkpoints,
+    int old_checkpoint_count,
+    ValidationResult old_result,
+    IncrementalValidation* validation
+)
+{
+    size_t next_checkpoint_offset = offset + validation->checkpoint_interval;
+    int old_checkpoint_i = 0;
+    while (true)
+    {
+        while (old_checkpoint_i < old_checkpoint_count && old_checkpoints[old_checkpoint_i].offset < offset)
+        { old_checkpoint_i++; }
+        if (old_checkpoint_i < old_checkpoint_count && old_checkpoints[old_checkpoint_i].offset == offset)
+        {
+            ValidationCheckpoint old_checkpoint = old_checkpoints[old_checkpoint_i];
+            if (does_validation_state_match_checkpoint(state, old_checkpoint))
+            {
+                int line_delta = state->line - old_checkpoint.line;
+                for (int i = old_checkpoint_i; i < old_checkpoint_count; i++)
+                {
+                    for (int j = 0; j < old_checkpoints[i].delimiter_stack_size; j++)
+                    {
+                        old_checkpoints[i].delimiter_positions[j] = rebase_delimiter_position(
+                            old_checkpoints[i].delimiter_positions[j],
+                            j,
+                            old_checkpoint,
+                            state
+                        );
+                    }
+                    old_checkpoints[i].line += line_delta;
+                    push_validation_checkpoint(old_checkpoints[i], validation);
+                }
+                for (int i = 0; i < old_checkpoint_i; i++) { deallocate_validation_checkpoint(old_checkpoints[i]); }
+                validation->result = old_result;
+                if (
+                    old_result.type == ValidationResultTypeExtraClosingDelimiter
+                        || old_result.type == ValidationResultTypeWrongDelimiter
+                        || old_result.type == ValidationResultTypeUnterminatedQuote
+                        || old_result.type == ValidationResultTypeUnterminatedBlockComment
+                )
+                { validation->result.error_line += line_delta; }
+                else if (old_result.type == ValidationResultTypeUnmatchedDelimiters)
+                {
+                    DelimiterPosition position;
+                    position.line = old_result.error_line;
+                    position.character = old_result.error_character;
+                    position = rebase_delimiter_position(
+                        position,
+                        old_result.unmatched_delimiters_count - 1,
+                        old_checkpoint,
+                        state
+                    );
+                    validation->result.error_line = position.line;
+                    validation->result.error_character = position.character;
+                }
+                return;
+            }
+            old_checkpoint_i++;
+        }
+        if (offset == next_checkpoint_offset)
+        {
+            push_validation_checkpoint(make_validation_checkpoint(state, offset), validation);
+            next_checkpoint_offset += validation->checkpoint_interval;
+        }
+        if (offset == source_size) { break; }
+
+        size_t target_offset = next_checkpoint_offset < source_size ? next_checkpoint_offset : source_size;
+        if (old_checkpoint_i < old_checkpoint_count && old_checkpoints[old_checkpoint_i].offset < target_offset)
+        { target_offset = old_checkpoints[old_checkpoint_i].offset; }
+        if (!feed_validation_state(state, source + offset, target_offset - offset)) { break; }
+        offset = target_offset;
+    }
+    for (int i = 0; i < old_checkpoint_count; i++) { deallocate_validation_checkpoint(old_checkpoints[i]); }
+    validation->result = get_validation_result(state);
+}
+
+IncrementalValidation make_incremental_validation(char* source, size_t source_size, size_t checkpoint_interval)
+{
+    IncrementalValidation result;
+    result.checkpoint_interval = checkpoint_interval;
+    result.checkpoints_size = 0;
+    result.checkpoints_capacity = 16;
+    result.checkpoints_data = malloc(sizeof(ValidationCheckpoint) * result.checkpoints_capacity);
+    ValidationState state = make_validation_state();
+    push_validation_checkpoint(make_validation_checkpoint(&state, 0), &result);
+    continue_incremental_validation(
+        source,
+        source_size,
+        0,
+        &state,
+        NULL,
+        0,
+        make_successful_validation_result(),
+        &result
+    );
+    deallocate_validation_state(state);
+    return result;
+}
+
+// Brings the validation up to date with an edit that replaced `removed_size` bytes at `edit_offset` with
+// `inserted_size` bytes, `source` being the source after the edit
+ValidationResult revalidate_after_edit(
+    char* source,
+    size_t source_size,
+    size_t edit_offset,
+    size_t removed_size,
+    size_t inserted_size,
+    IncrementalValidation* validation
+)
+{
+    // the checkpoint at offset 0 always exists, so there's always one to resume from
+    int resume_checkpoint_i = 0;
+    while (
+        resume_checkpoint_i + 1 < validation->checkpoints_size
+            && validation->checkpoints_data[resume_checkpoint_i + 1].offset <= edit_offset
+    )
+    { resume_checkpoint_i++; }
+
+    // the checkpoints after the edited range still describe the state before the same bytes, just at other offsets
+    int old_checkpoints_start_i = resume_checkpoint_i + 1;
+    while (
+        old_checkpoints_start_i < validation->checkpoints_size
+            && validation->checkpoints_data[old_checkpoints_start_i].offset < edit_offset + removed_size
+    )
+    {
+        deallocate_validation_checkpoint(validation->checkpoints_data[old_checkpoints_start_i]);
+        old_checkpoints_start_i++;
+    }
+    int old_checkpoint_count = validation->checkpoints_size - old_checkpoints_start_i;
+    ValidationCheckpoint* old_checkpoints = malloc(sizeof(ValidationCheckpoint) * (old_checkpoint_count + 1));
+    for (int i = 0; i < old_checkpoint_count; i++)
+    {
+        old_checkpoints[i] = validation->checkpoints_data[old_checkpoints_start_i + i];
+        old_checkpoints[i].offset = old_checkpoints[i].offset - removed_size + inserted_size;
+    }
+    validation->checkpoints_size = resume_checkpoint_i + 1;
+
+    ValidationCheckpoint resume_checkpoint = validation->checkpoints_data[resume_checkpoint_i];
+    ValidationState state = make_validation_state_from_checkpoint(resume_checkpoint);
+    continue_incremental_validation(
+        source,
+        source_size,
+        resume_checkpoint.offset,
+        &state,
+        old_checkpoints,
+        old_checkpoint_count,
+        validation->result,
+        validation
+    );
+    deallocate_validation_state(state);
+    free(old_checkpoints);
+    return validation->result;
+}
+
+void deallocate_incremental_validation(IncrementalValidation validation)
+{
+    for (int i = 0; i < validation.checkpoints_size; i++)
+    { deallocate_validation_checkpoint(validation.checkpoints_data[i]); }
+    free(validation.checkpoints_data);
+}
+
+void push_line_start(size_t line_start, LineIndex* index)
+{
+    if (index->line_count == index->line_starts_capacity)
+    {
+        index->line_starts_capacity *= 2;
+        index->line_starts = realloc(index->line_starts, sizeof(size_t) * index->line_starts_capacity);
+    }
+    index->line_starts[index->line_count] = line_start;
+    index->line_count++;
+}
+
+LineIndex make_line_index(char* source, size_t source_size)
+{
+    select_scan_block_once();
+    LineIndex result;
+    result.line_starts_capacity = 64;
+    result.line_starts = malloc(sizeof(size_t) * result.line_starts_capacity);
+    result.line_count = 0;
+    push_line_start(0, &result);
+    char padded_block[SCAN_BLOCK_SIZE];
+    for (size_t block_start = 0; block_start < source_size; block_start += SCAN_BLOCK_SIZE)
+    {
+        char* block = source + block_start;
+        if (source_size - block_start < SCAN_BLOCK_SIZE)
+        {
+            memset(padded_block, ' ', SCAN_BLOCK_SIZE);
+            memcpy(padded_block, block, source_size - block_start);
+            block = padded_block;
+        }
+        uint64_t specials;
+        uint64_t newlines;
+        scan_block(block, &specials, &newlines);
+        for (; newlines != 0; newlines &= newlines - 1)
+        { push_line_start(block_start + count_trailing_zeros(newlines) + 1, &result); }
+    }
+    return result;
+}
+
+SourcePosition get_source_position(LineIndex* index, char* source, size_t offset)
+{
+    // the last line that starts at or before the offset
+    int first_line_i = 0;
+    int last_line_i = index->line_count - 1;
+    while (first_line_i < last_line_i)
+    {
+        int middle_line_i = first_line_i + (last_line_i - first_line_i + 1) / 2;
+        if (index->line_starts[middle_line_i] <= offset) { first_line_i = middle_line_i; }
+        else { last_line_i = middle_line_i - 1; }
+    }
+    size_t line_start = index->line_starts[first_line_i];
+    Utf8Decoder utf8_decoder = make_utf8_decoder();
+    SourcePosition result;
+    result.line = first_line_i + 1;
+    result.character = get_display_width(&utf8_decoder, source + line_start, offset - line_start) + 1;
+    return result;
+}
+
+size_t get_line_start_offset(LineIndex* index, int line) { return index->line_starts[line - 1]; }
+
+void deallocate_line_index(LineIndex index) { free(index.line_starts); }
+
+#ifdef VALIDATION_HAS_CACHE
+
+#define VALIDATION_CACHE_MAGIC "knrcache"
+
+void encode_validation_result(ValidationResult result, int32_t* fields)
+{
+    for (int i = 0; i < 6; i++) { fields[i] = 0; }
+    fields[0] = result.type;
+    if (result.type == ValidationResultTypeSuccess) { return; }
+    fields[1] = result.error_line;
+    fields[2] = result.error_character;
+    switch (result.type)
+    {
+        case ValidationResultTypeSuccess: break;
+        case ValidationResultTypeExtraClosingDelimiter: fields[3] = result.extra_closing_delimiter; break;
+        case ValidationResultTypeWrongDelimiter:
+            fields[3] = result.wrong_delimiter_expected;
+            fields[4] = result.wrong_delimiter_actual;
+            break;
+        case ValidationResultTypeUnmatchedDelimiters:
+            fields[3] = result.unmatched_delimiters_count;
+            fields[4] = result.last_unmatched_delimiter;
+            break;
+        case ValidationResultTypeUnterminatedQuote: fields[3] = result.unterminated_quote_is_single_quote; break;
+        case ValidationResultTypeUnterminatedBlockComment: break;
+    }
+}
+
+bool is_encoded_delimiter(int32_t field) { return field >= DelimiterParenthesis && field <= DelimiterBrace; }
+
+// Returns false for fields that no result encodes to, from a damaged cache file
+bool decode_validation_result(int32_t* fields, ValidationResult* result)
+{
+    result->type = (ValidationResultType)fields[0];
+    result->error_line = fields[1];
+    result->error_character = fields[2];
+    switch (fields[0])
+    {
+        case ValidationResultTypeSuccess: return true;
+        case ValidationResultTypeExtraClosingDelimiter:
+            result->extra_closing_delimiter = (Delimiter)fields[3];
+            return is_encoded_delimiter(fields[3]);
+        case ValidationResultTypeWrongDelimiter:
+            result->wrong_delimiter_expected = (Delimiter)fields[3];
+            result->wrong_delimiter_actual = (Delimiter)fields[4];
+            return is_encoded_delimiter(fields[3]) && is_encoded_delimiter(fields[4]);
+        case ValidationResultTypeUnmatchedDelimiters:
+            result->unmatched_delimiters_count = fields[3];
+            result->last_unmatched_delimiter = (Delimiter)fields[4];
+            return is_encoded_delimiter(fields[4]);
+        case ValidationResultTypeUnterminatedQuote:
+            result->unterminated_quote_is_single_quote = fields[3] != 0;
+            return true;
+        case ValidationResultTypeUnterminatedBlockComment: return true;
+        default: return false;
+    }
+}
+
+size_t get_validation_cache_file_size(uint32_t set_count)
+{
+    return sizeof(ValidationCacheHeader) + sizeof(ValidationCacheEntry) * VALIDATION_CACHE_WAYS * (size_t)set_count;
+}
+
+bool is_validation_cache_usable(ValidationCacheHeader* header, size_t file_size)
+{
+    return memcmp(header->magic, VALIDATION_CACHE_MAGIC, sizeof(header->magic)) == 0
+        && header->version == VALIDATION_CACHE_VERSION
+        && header->set_count > 0
+        && get_validation_cache_file_size(header->set_count) == file_size;
+}
+
+// Maps the existing cache file, returns false if there is none or it can't be used
+bool map_validation_cache(ValidationCache* cache)
+{
+    int file_descriptor = open(cache->path, O_RDONLY);
+    if (file_descriptor < 0) { return false; }
+    struct stat file_status;
+    bool result = fstat(file_descriptor, &file_status) == 0
+        && S_ISREG(file_status.st_mode)
+        && (size_t)file_status.st_size >= sizeof(ValidationCacheHeader);
+    if (result)
+    { // private, so that the changes stay in memory until the whole cache is written back
+        cache->file_size = (size_t)file_status.st_size;
+        void* mapping = mmap(NULL, cache->file_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file_descriptor, 0);
+        result = mapping != MAP_FAILED;
+        if (result && !is_validation_cache_usable(mapping, cache->file_size))
+        {
+            munmap(mapping, cache->file_size);
+            result = false;
+        }
+        if (result) { cache->header = mapping; }
+    }
+    close(file_descriptor);
+    return result;
+}
+
+ValidationCache open_validation_cache(char* path, int capacity)
+{
+    ValidationCache result;
+    result.path = copy_string(path);
+    result.is_modified = false;
+    result.is_mapped = map_validation_cache(&result);
+    if (!result.is_mapped)
+    {
+        int set_count = capacity < 1 ? 1 : (capacity + VALIDATION_CACHE_WAYS - 1) / VALIDATION_CACHE_WAYS;
+        result.file_size = get_validation_cache_file_size((uint32_t)set_count);
+        result.header = calloc(1, result.file_size);
+        memcpy(result.header->magic, VALIDATION_CACHE_MAGIC, sizeof(result.header->magic));
+        result.header->version = VALIDATION_CACHE_VERSION;
+        result.header->set_count = (uint32_t)set_count;
+        result.header->clock = 0;
+    }
+    result.entries = (ValidationCacheEntry*)(result.header + 1);
+    return result;
+}
+
+ValidationCacheKey make_validation_cache_key(char* source, size_t source_size)
+{
+    ValidationCacheKey result;
+    result.source_hash = hash_bytes(source, source_size, 0);
+    result.source_size = source_size;
+    return result;
+}
+
+ValidationCacheEntry* get_validation_cache_set(ValidationCache* cache, ValidationCacheKey key)
+{ return cache->entries + (size_t)(key.source_hash % cache->header->set_count) * VALIDATION_CACHE_WAYS; }
+
+bool is_validation_cache_entry_for(ValidationCacheEntry* entry, ValidationCacheKey key)
+{
+    return entry->last_use != 0 && entry->source_hash == key.source_hash && entry->source_size == key.source_size;
+}
+
+bool look_up_validation_result(ValidationCache* cache, ValidationCacheKey key, ValidationResult* result)
+{
+    ValidationCacheEntry* set = get_validation_cache_set(cache, key);
+    for (int i = 0; i < VALIDATION_CACHE_WAYS; i++)
+    {
+        ValidationCacheEntry* entry = &set[i];
+        if (!is_validation_cache_entry_for(entry, key)) { continue; }
+        if (!decode_validation_result(entry->result_fields, result))
+        {
+            entry->last_use = 0;
+            cache->is_modified = true;
+            return false;
+        }
+        // only written back along with a change, a run of nothing but hits leaves the file alone
+        entry->last_use = ++cache->header->clock;
+        return true;
+    }
+    return false;
+}
+
+void store_validation_result(ValidationCache* cache, ValidationCacheKey key, ValidationResult result)
+{
+    ValidationCacheEntry* set = get_validation_cache_set(cache, key);
+    ValidationCacheEntry* replaced_entry = &set[0];
+    for (int i = 0; i < VALIDATION_CACHE_WAYS; i++)
+    {
+        if (is_validation_cache_entry_for(&set[i], key)) { replaced_entry = &set[i]; break; }
+        if (set[i].last_use < replaced_entry->last_use) { replaced_entry = &set[i]; }
+    }
+    replaced_entry->source_hash = key.source_hash;
+    replaced_entry->source_size = key.source_size;
+    replaced_entry->last_use = ++cache->header->clock;
+    encode_validation_result(result, replaced_entry->result_fields);
+    cache->is_modified = true;
+}
+
+ValidationResult validate_with_cache(ValidationCache* cache, char* source, size_t source_size)
+{
+    ValidationCacheKey key = make_validation_cache_key(source, source_size);
+    ValidationResult result;
+    if (look_up_validation_result(cache, key, &result)) { return result; }
+    result = validate(source, source_size);
+    store_validation_result(cache, key, result);
+    return result;
+}
+
+// Writes the cache to a temporary file next to it and renames that over it, which replaces the file atomically
+bool write_validation_cache(ValidationCache* cache)
+{
+    char temporary_path[4096];
+    int path_size = snprintf(temporary_path, sizeof(temporary_path), "%s.%ld.tmp", cache->path, (long)getpid());
+    if (path_size < 0 || (size_t)path_size >= sizeof(temporary_path)) { return false; }
+    int file_descriptor = open(temporary_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (file_descriptor < 0) { return false; }
+
+    char* data = (char*)cache->header;
+    size_t written_size = 0;
+    while (written_size < cache->file_size)
+    {
+        ssize_t bytes_written = write(file_descriptor, data + written_size, cache->file_size - written_size);
+        if (bytes_written < 0)
+        {
+            if (errno == EINTR) { continue; }
+            break;
+        }
+        written_size += (size_t)bytes_written;
+    }
+    // synced before the rename, so that a crash can't leave the new name on a file whose data never made it to disk
+    bool has_written = written_size == cache->file_size && fsync(file_descriptor) == 0;
+    has_written = close(file_descriptor) == 0 && has_written;
+    if (has_written && rename(temporary_path, cache->path) == 0) { return true; }
+    unlink(temporary_path);
+    return false;
+}
+
+bool close_validation_cache(ValidationCache cache)
+{
+    bool result = !cache.is_modified || write_validation_cache(&cache);
+    if (cache.is_mapped) { munmap(cache.header, cache.file_size); }
+    else { free(cache.header); }
+    free(cache.path);
+    return result;
+}
+
+#endif
+
+#ifdef VALIDATION_HAS_THREADS
+
+PathList make_path_list()
+{
+    PathList result;
+    result.size = 0;
+    result.capacity = 64;
+    result.data = malloc(sizeof(char*) * result.capacity);
+    return result;
+}
+
+void push_path(char* path, PathList* list)
+{
+    if (list->size == list->capacity)
+    {
+        list->capacity *= 2;
+        list->data = realloc(list->data, sizeof(char*) * list->capacity);
+    }
+    list->data[list->size] = copy_string(path);
+    list->size++;
+}
+
+void deallocate_path_list(PathList list)
+{
+    for (int i = 0; i < list.size; i++) { free(list.data[i]); }
+    free(list.data);
+}
+
+int compare_paths(const void* left, const void* right) { return strcmp(*(char**)left, *(char**)right); }
+
+bool is_c_source_path(char* path)
+{
+    size_t path_size = strlen(path);
+    return path_size >= 2 && path[path_size - 2] == '.' && (path[path_size - 1] == 'c' || path[path_size - 1] == 'h');
+}
+
+// Adds all C sources and headers under the directory, sorted by name so that the output doesn't depend on the order in
+// which the file system lists them. Symbolic links to directories aren't followed to avoid cycles.
+void collect_directory_paths(char* directory_path, PathList* list)
+{
+    DIR* directory = opendir(directory_path);
+    if (directory == NULL) { printf("Failed to open directory '%s'\n", directory_path); exit(1); }
+    PathList entry_paths = make_path_list();
+    struct dirent* entry;
+    while ((entry = readdir(directory)) != NULL)
+    {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) { continue; }
+        char entry_path[4096];
+        snprintf(entry_path, sizeof(entry_path), "%s/%s", directory_path, entry->d_name);
+        push_path(entry_path, &entry_paths);
+    }
+    closedir(directory);
+    qsort(entry_paths.data, entry_paths.size, sizeof(char*), compare_paths);
+
+    for (int i = 0; i < entry_paths.size; i++)
+    {
+        struct stat entry_status;
+        if (lstat(entry_paths.data[i], &entry_status) != 0) { continue; }
+        if (S_ISDIR(entry_status.st_mode)) { collect_directory_paths(entry_paths.data[i], list); }
+        else if (is_c_source_path(entry_paths.data[i]))
+        { // symbolic links to regular files are fine
+            if (S_ISLNK(entry_status.st_mode) && stat(entry_paths.data[i], &entry_status) != 0) { continue; }
+            if (S_ISREG(entry_status.st_mode)) { push_path(entry_paths.data[i], list); }
+        }
+    }
+    deallocate_path_list(entry_paths);
+}
+
+// Every line of the list file is a path
+void collect_list_file_paths(char* list_file_path, PathList* list)
+{
+    InputView list_file = open_input_view(list_file_path);
+    size_t line_start = 0;
+    for (size_t i = 0; i <= list_file.size; i++)
+    {
+        if (i != list_file.size && list_file.data[i] != '\n') { continue; }
+        size_t line_end = i;
+        if (line_end > line_start && list_file.data[line_end - 1] == '\r') { line_end--; }
+        if (line_end > line_start)
+        {
+            char path[4096];
+            snprintf(path, sizeof(path), "%.*s", (int)(line_end - line_start), list_file.data + line_start);
+            push_path(path, list);
+        }
+        line_start = i + 1;
+    }
+    close_input_view(list_file);
+}
+
+void collect_argument_paths(char* argument, PathList* list)
+{
+    if (argument[0] == '@') { collect_list_file_paths(argument + 1, list); return; }
+    struct stat argument_status;
+    if (stat(argument, &argument_status) == 0 && S_ISDIR(argument_status.st_mode))
+    { collect_directory_paths(argument, list); }
+    else { push_path(argument, list); }
+}
+
+// Every worker owns a range of the files. It takes files from the front of its own range, and once that is empty it
+// steals the back half of the largest range it can find, so that a few big files don't leave the other workers idle.
+typedef struct
+{
+    pthread_mutex_t lock;
+    int next_i;
+    int end_i;
+} BatchValidationRange;
+
+typedef struct
+{
+    char** paths;
+    BatchValidationEntry* entries;
+    BatchValidationRange* ranges;
+    int worker_count;
+    int read_ahead_depth;
+} BatchValidation;
+
+typedef struct
+{
+    BatchValidation* batch;
+    int worker_i;
+} BatchValidationWorker;
+
+bool take_batch_validation_file(BatchValidationRange* range, int* file_i)
+{
+    pthread_mutex_lock(&range->lock);
+    bool result = range->next_i < range->end_i;
+    if (result) { *file_i = range->next_i++; }
+    pthread_mutex_unlock(&range->lock);
+    return result;
+}
+
+int get_remaining_batch_validation_file_count(BatchValidationRange* range)
+{
+    pthread_mutex_lock(&range->lock);
+    int result = range->end_i - range->next_i;
+    pthread_mutex_unlock(&range->lock);
+    return result;
+}
+
+// Returns false once there is nothing left to steal. Only one lock is ever held at a time, so thieves stealing from
+// each other can't deadlock, and the thief's own range is empty while it steals, so nobody else touches it in between.
+bool steal_batch_validation_files(BatchValidation* batch, int thief_i)
+{
+    int victim_i = -1;
+    int victim_remaining = 0;
+    for (int i = 0; i < batch->worker_count; i++)
+    {
+        int remaining = i == thief_i ? 0 : get_remaining_batch_validation_file_count(&batch->ranges[i]);
+        if (remaining > victim_remaining)
+        {
+            victim_i = i;
+            victim_remaining = remaining;
+        }
+    }
+    if (victim_i == -1) { return false; }
+
+    BatchValidationRange* victim = &batch->ranges[victim_i];
+    pthread_mutex_lock(&victim->lock);
+    int remaining = victim->end_i - victim->next_i;
+    int stolen_start_i = victim->end_i - (remaining + 1) / 2;
+    int stolen_end_i = victim->end_i;
+    if (remaining > 0) { victim->end_i = stolen_start_i; }
+    pthread_mutex_unlock(&victim->lock);
+    if (remaining <= 0) { return true; } // somebody else got there first, but there may be other ranges to steal from
+
+    BatchValidationRange* thief = &batch->ranges[thief_i];
+    pthread_mutex_lock(&thief->lock);
+    thief->next_i = stolen_start_i;
+    thief->end_i = stolen_end_i;
+    pthread_mutex_unlock(&thief->lock);
+    return true;
+}
+
+void* run_batch_validation_worker(void* worker_pointer)
+{
+    BatchValidationWorker* worker = worker_pointer;
+    BatchValidation* batch = worker->batch;
+    BatchValidationRange* range = &batch->ranges[worker->worker_i];
+    ValidationState state = make_validation_state(); // reused for every file this worker validates
+    // the files that are being read ahead, in the order of the pipeline, which only takes them from the worker's own
+    // range so that the others can still steal the rest of it
+    InputPipeline* pipeline = make_input_pipeline(batch->read_ahead_depth);
+    int* queued_file_is = malloc(sizeof(int) * batch->read_ahead_depth);
+    int first_queued_i = 0;
+    int queued_count = 0;
+    while (true)
+    {
+        int file_i;
+        while (queued_count < batch->read_ahead_depth && take_batch_validation_file(range, &file_i))
+        {
+            queued_file_is[(first_queued_i + queued_count) % batch->read_ahead_depth] = file_i;
+            queued_count++;
+            queue_pipeline_input(pipeline, batch->paths[file_i]);
+        }
+        if (queued_count == 0)
+        { // ranges can get emptied by others between stealing and taking, so keep going until there is nothing left
+            bool has_file = false;
+            while (!has_file && steal_batch_validation_files(batch, worker->worker_i))
+            { has_file = take_batch_validation_file(range, &file_i); }
+            if (!has_file) { break; }
+            queued_file_is[first_queued_i] = file_i;
+            queued_count++;
+            queue_pipeline_input(pipeline, batch->paths[file_i]);
+        }
+
+        file_i = queued_file_is[first_queued_i];
+        first_queued_i = (first_queued_i + 1) % batch->read_ahead_depth;
+        queued_count--;
+        InputView file = take_pipeline_input(pipeline);
+        batch->entries[file_i].result = validate_reusing_state(&state, file.data, file.size);
+        batch->entries[file_i].size = file.size;
+        close_input_view(file);
+    }
+    free(queued_file_is);
+    deallocate_input_pipeline(pipeline);
+    deallocate_validation_state(state);
+    return NULL;
+}
+
+BatchValidationEntry* validate_in_batch(char** paths, int path_count, int thread_count, int read_ahead_depth)
+{
+    BatchValidation batch;
+    batch.paths = paths;
+    batch.read_ahead_depth = read_ahead_depth < 1 ? 1 : read_ahead_depth;
+    batch.entries = malloc(sizeof(BatchValidationEntry) * (path_count == 0 ? 1 : path_count));
+    batch.worker_count = thread_count < 1 ? 1 : thread_count;
+    batch.ranges = malloc(sizeof(BatchValidationRange) * batch.worker_count);
+    for (int i = 0; i < batch.worker_count; i++)
+    {
+        pthread_mutex_init(&batch.ranges[i].lock, NULL);
+        batch.ranges[i].next_i = (int)((long long)path_count * i / batch.worker_count);
+        batch.ranges[i].end_i = (int)((long long)path_count * (i + 1) / batch.worker_count);
+    }
+    select_scan_block_once();
+
+    BatchValidationWorker* workers = malloc(sizeof(BatchValidationWorker) * batch.worker_count);
+    pthread_t* threads = malloc(sizeof(pthread_t) * batch.worker_count);
+    for (int i = 0; i < batch.worker_count; i++)
+    {
+        workers[i].batch = &batch;
+        workers[i].worker_i = i;
+    }
+    // the calling thread is the first worker, the rest of the workers steal its range if their threads fail to start
+    int started_thread_count = 0;
+    for (int i = 1; i < batch.worker_count; i++)
+    {
+        if (pthread_create(&threads[started_thread_count], NULL, run_batch_validation_worker, &workers[i]) != 0)
+        { break; }
+        started_thread_count++;
+    }
+    run_batch_validation_worker(&workers[0]);
+    for (int i = 0; i < started_thread_count; i++) { pthread_join(threads[i], NULL); }
+
+    for (int i = 0; i < batch.worker_count; i++) { pthread_mutex_destroy(&batch.ranges[i].lock); }
+    free(threads);
+    free(workers);
+    free(batch.ranges);
+    return batch.entries;
+}
+
+#endif
@@ -0,0 +1,385 @@
+#ifndef KNR_VALIDATION_H
+#define KNR_VALIDATION_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../common/utf8.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define VALIDATION_HAS_THREADS
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define VALIDATION_HAS_SIMD
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#define VALIDATION_HAS_CACHE
+#endif
+
+typedef enum
+{
+    DelimiterParenthesis,
+    DelimiterBracket,
+    DelimiterBrace,
+} Delimiter;
+
+typedef enum
+{
+    ValidationResultTypeSuccess,
+    ValidationResultTypeExtraClosingDelimiter,
+    ValidationResultTypeWrongDelimiter,
+    ValidationResultTypeUnmatchedDelimiters,
+    ValidationResultTypeUnterminatedQuote,
+    ValidationResultTypeUnterminatedBlockComment,
+} ValidationResultType;
+
+typedef struct
+{
+    ValidationResultType type;
+    int error_line;
+    int error_character; // counted in display width, like editors do, so a wide character takes two
+    union
+    {
+        Delimiter extra_closing_delimiter;
+        struct
+        {
+            Delimiter wrong_delimiter_expected;
+            Delimiter wrong_delimiter_actual;
+        };
+        struct
+        {
+            int unmatched_delimiters_count;
+            Delimiter last_unmatched_delimiter; // the innermost one, opened at the error line and character
+        };
+        bool unterminated_quote_is_single_quote;
+    };
+} ValidationResult;
+
+ValidationResult make_successful_validation_result();
+bool are_validation_results_equal(ValidationResult left, ValidationResult right);
+// Writes the message into the buffer like `snprintf` does, returns the length of the whole message
+int format_validation_result(ValidationResult validation_result, char* buffer, size_t buffer_size);
+char* validation_result_to_string(ValidationResult validation_result);
+
+// The lexer is a single DFA: every combination of "inside quotes", "escaped", "inside a comment" and "just saw the first
+// half of a comment opener/closer" that can actually occur is its own state. The states in which delimiters count come
+// first so that checking for them is a single comparison.
+typedef enum
+{
+    LexerStateCode,
+    LexerStateCodeAfterBackslash, // an escaped quote outside of quotes doesn't start a string
+    LexerStateCodeAfterSlash,
+    LexerStateDoubleQuotes,
+    LexerStateDoubleQuotesAfterBackslash,
+    LexerStateSingleQuotes,
+    LexerStateSingleQuotesAfterBackslash,
+    LexerStateLineComment,
+    LexerStateBlockComment,
+    LexerStateBlockCommentAfterStar,
+    LexerStateCount,
+} LexerState;
+
+typedef struct
+{
+    Delimiter delimiter;
+    int line;
+    int character;
+} UnmatchedClosingDelimiter;
+
+typedef struct
+{
+    int line;
+    int character;
+} DelimiterPosition;
+
+typedef struct
+{
+    Delimiter delimiter;
+    int line;
+    int character;
+} OpenDelimiter;
+
+// Where validation spends its time. Only collected when built with `VALIDATION_STATS` defined (the
+// `KNR_VALIDATION_STATS` CMake option), otherwise the counting isn't compiled in at all.
+typedef struct
+{
+    size_t bytes_scanned;
+    size_t bytes_in_comments;
+    size_t bytes_in_strings;
+    int max_delimiter_stack_depth;
+    int delimiter_stack_regrowth_count; // how many times `push_delimiter` had to grow the stack
+    double scan_seconds; // serial validation only
+    double parallel_suffix_seconds; // finding the convergence points and validating the suffixes
+    double parallel_prefix_seconds;
+    double parallel_merge_seconds;
+    double total_seconds;
+} ValidationStats;
+
+ValidationStats make_validation_stats();
+// These return a NUL-terminated result
+char* validation_stats_to_string(ValidationStats stats);
+char* validation_stats_to_json(ValidationResult result, ValidationStats stats);
+
+typedef struct
+{
+    ValidationResult* data;
+    int size;
+    int capacity;
+    int max_size;
+    bool is_truncated; // the limit was reached, so the rest of the source wasn't looked at
+} ValidationResultList;
+
+void deallocate_validation_result_list(ValidationResultList list);
+
+// The delimiter stack is packed 2 bits per delimiter, 32 to a word, with the positions of the delimiters in a separate
+// array. Its first levels live in the state itself, so that validating shallow sources doesn't allocate, and once it
+// outgrows them it moves to the heap, doubling whenever it's full.
+#define DELIMITER_STACK_INLINE_CAPACITY 64
+#define DELIMITERS_PER_WORD 32
+
+typedef struct
+{
+    uint64_t delimiter_stack_inline_words[DELIMITER_STACK_INLINE_CAPACITY / DELIMITERS_PER_WORD];
+    DelimiterPosition delimiter_inline_positions[DELIMITER_STACK_INLINE_CAPACITY];
+    uint64_t* delimiter_stack_heap_words; // only used once the capacity is larger than the inline one
+    DelimiterPosition* delimiter_heap_positions;
+    bool owns_delimiter_stack_heap; // false for storage given by the caller, which is neither freed nor grown in place
+    int delimiter_stack_size;
+    int delimiter_stack_capacity;
+    int line; // 1-based
+    int character; // 1-based
+    Utf8Decoder utf8_decoder; // the UTF-8 sequence that the source so far ends in, if any
+    LexerState lexer_state;
+    bool has_failed; // set once an error has been found, the rest of the input is then ignored
+    ValidationResult failure;
+    // When validating a part of the source without knowing the delimiters that were opened before it, closing
+    // delimiters that find the stack empty are recorded here instead of failing the validation
+    bool records_unmatched_closing_delimiters;
+    UnmatchedClosingDelimiter* unmatched_closing_delimiters_data;
+    int unmatched_closing_delimiters_size;
+    int unmatched_closing_delimiters_capacity;
+    // In recovery mode errors are recorded here and validation goes on, until there are as many as the list can hold
+    bool recovers_from_errors;
+    ValidationResultList recovered_errors;
+#ifdef VALIDATION_STATS
+    // the stack depth in here is relative to the start of the part for states that record unmatched closing delimiters
+    ValidationStats stats;
+#endif
+} ValidationState;
+
+// Streaming validation: feed the source in chunks of any size, `feed_validation_state` returns false once the result is
+// known
+ValidationState make_validation_state();
+// The delimiter stack starts out in the given storage, which has to be aligned for a `uint64_t` and outlive the state,
+// instead of on the heap once it outgrows the inline levels. Only deeper stacks than it can hold allocate.
+ValidationState make_validation_state_with_storage(void* storage, size_t storage_size);
+void reset_validation_state(ValidationState* state);
+void deallocate_validation_state(ValidationState state);
+bool feed_validation_state(ValidationState* state, char* chunk, size_t chunk_size);
+// The same, a byte at a time without the block scanner. Much slower, it's the reference that the scanning is checked
+// against.
+bool feed_validation_state_bytewise(ValidationState* state, char* chunk, size_t chunk_size);
+// The delimiters that are open after everything fed so far, from the outermost one
+int get_open_delimiter_count(ValidationState* state);
+OpenDelimiter get_open_delimiter(ValidationState* state, int index);
+ValidationResult finish_validation(ValidationState* state);
+
+// Recovery mode finds all the errors in one pass instead of stopping at the first one. After an error it guesses what
+// was meant and goes on from there:
+// - a closing delimiter that doesn't match the last open one closes the nearest matching one a few levels down, if
+//   there is one, as if the closing delimiters in between were missing; otherwise it replaces the closing delimiter
+//   of the last open one if that was opened on the same line, and is ignored as an extra one if not
+// - a newline ends a quote, which is reported there, because a C string or character constant can't span lines
+//   without a backslash
+// The delimiters left open at the end are reported one by one, at the positions where they were opened. The list is
+// sorted by position. Recovery mode is always serial.
+#define DEFAULT_MAX_RECOVERED_ERROR_COUNT 100
+#define RECOVERY_SEARCH_DEPTH 8
+
+ValidationState make_recovering_validation_state(int max_error_count);
+// Releases the state, except for the returned list
+ValidationResultList finish_validation_with_recovery(ValidationState* state);
+ValidationResultList validate_with_recovery(char* source, size_t source_size, int max_error_count);
+
+// Finds the bytes of a 64-byte block that can change the lexer state or the delimiter stack, and its newlines
+typedef void (*ScanBlockFunction)(char* block, uint64_t* specials, uint64_t* newlines);
+
+void scan_block_scalar(char* block, uint64_t* specials, uint64_t* newlines);
+#ifdef VALIDATION_HAS_SIMD
+void scan_block_sse2(char* block, uint64_t* specials, uint64_t* newlines);
+void scan_block_avx2(char* block, uint64_t* specials, uint64_t* newlines);
+void scan_block_avx512(char* block, uint64_t* specials, uint64_t* newlines);
+#endif
+ScanBlockFunction select_scan_block_function();
+#define MAX_SCAN_BLOCK_FUNCTION_COUNT 4
+// Fills in every scanner that the processor can run, and its name, for comparing them. Returns how many there are.
+int get_available_scan_block_functions(ScanBlockFunction* functions, char** names);
+// Picked once on first use, from whichever thread gets there first. Can be swapped to compare the scanners while no
+// other thread is validating.
+extern ScanBlockFunction scan_block;
+
+// Sources of at least this size are validated on all cores
+#define PARALLEL_VALIDATION_MIN_SIZE (4 * 1024 * 1024)
+
+ValidationResult validate_in_parallel(char* source, size_t source_size, int chunk_count, int thread_count);
+ValidationResult validate(char* source, size_t source_size);
+// Validates the source serially with a state that is reset first and kept afterwards, so that validating many sources
+// with the same state doesn't allocate once its buffers are large enough
+ValidationResult validate_reusing_state(ValidationState* state, char* source, size_t source_size);
+#ifdef VALIDATION_STATS
+ValidationResult validate_with_stats(char* source, size_t source_size, ValidationStats* stats);
+ValidationResult validate_in_parallel_with_stats(
+    char* source,
+    size_t source_size,
+    int chunk_count,
+    int thread_count,
+    ValidationStats* stats
+);
+#endif
+ValidationResult validate_file(char* file_path);
+ValidationResult validate_in_chunks(char* source, size_t source_size, size_t chunk_size);
+
+// Incremental validation keeps a snapshot of the validation state every `checkpoint_interval` bytes. After an edit it
+// resumes from the last snapshot before the edit, and stops as soon as its state matches one of the old snapshots after
+// the edit: from there on everything plays out the same way as before, just shifted by the size of the edit.
+typedef struct
+{
+    size_t offset; // the state is the one before the byte at this offset
+    int line;
+    int character;
+    Utf8Decoder utf8_decoder;
+    LexerState lexer_state;
+    uint64_t* delimiter_stack_words;
+    DelimiterPosition* delimiter_positions;
+    int delimiter_stack_size;
+} ValidationCheckpoint;
+
+typedef struct
+{
+    size_t checkpoint_interval;
+    ValidationCheckpoint* checkpoints_data;
+    int checkpoints_size;
+    int checkpoints_capacity;
+    ValidationResult result;
+} IncrementalValidation;
+
+IncrementalValidation make_incremental_validation(char* source, size_t source_size, size_t checkpoint_interval);
+ValidationResult revalidate_after_edit(
+    char* source,
+    size_t source_size,
+    size_t edit_offset,
+    size_t removed_size,
+    size_t inserted_size,
+    IncrementalValidation* validation
+);
+void deallocate_incremental_validation(IncrementalValidation validation);
+
+// The offsets at which the lines of a source start, found with the block scanner, so that code that keeps byte offsets
+// (like an editor's cursor) can turn them into the line and character that validation results use only when it needs
+// them. A lookup is a binary search for the line and the display width of the line up to the offset.
+typedef struct
+{
+    size_t* line_starts; // line_starts[0] is 0
+    int line_count;
+    int line_starts_capacity;
+} LineIndex;
+
+typedef struct
+{
+    int line; // 1-based
+    int character; // 1-based, in display width
+} SourcePosition;
+
+LineIndex make_line_index(char* source, size_t source_size);
+// The offset can be anything up to the source size, which is the position right after the last byte
+SourcePosition get_source_position(LineIndex* index, char* source, size_t offset);
+size_t get_line_start_offset(LineIndex* index, int line);
+void deallocate_line_index(LineIndex index);
+
+// Results of earlier validations keyed by the hash and size of the source, so that unchanged files cost only a hash.
+// The cache file is a header and a fixed number of entries, in sets of `VALIDATION_CACHE_WAYS`: a source can only be
+// in the set that its hash picks, and storing into a full set replaces the entry that was used longest ago. The file is
+// mapped copy-on-write and written back as a whole through a temporary file that replaces it, so that a crash or a
+// concurrent run never leaves a torn cache, just the last complete one. Hits alone don't write it back, so their uses
+// only count towards the replacements if the same run also stores a result. A cache from another version of the
+// validator, whose results may differ, is started over.
+#define VALIDATION_CACHE_VERSION 1 // bump whenever a change to the validator can change its results
+#define DEFAULT_VALIDATION_CACHE_CAPACITY 4096
+#define VALIDATION_CACHE_WAYS 8
+
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t set_count;
+    uint64_t clock; // ticks once per lookup or store, for finding the least recently used entries
+} ValidationCacheHeader;
+
+typedef struct
+{
+    uint64_t source_hash;
+    uint64_t source_size;
+    uint64_t last_use; // 0 for an empty entry
+    int32_t result_fields[6]; // the result in a fixed layout, independent of the compiler's
+} ValidationCacheEntry;
+
+typedef struct
+{
+    uint64_t source_hash;
+    uint64_t source_size;
+} ValidationCacheKey;
+
+typedef struct
+{
+    char* path;
+    ValidationCacheHeader* header;
+    ValidationCacheEntry* entries;
+    size_t file_size;
+    bool is_mapped;
+    bool is_modified;
+} ValidationCache;
+
+#ifdef VALIDATION_HAS_CACHE
+
+// The capacity is rounded up to whole sets, and only applies to a new cache or one that is started over
+ValidationCache open_validation_cache(char* path, int capacity);
+ValidationCacheKey make_validation_cache_key(char* source, size_t source_size);
+bool look_up_validation_result(ValidationCache* cache, ValidationCacheKey key, ValidationResult* result);
+void store_validation_result(ValidationCache* cache, ValidationCacheKey key, ValidationResult result);
+// Returns the cached result for the source, or validates it and stores the result
+ValidationResult validate_with_cache(ValidationCache* cache, char* source, size_t source_size);
+// Writes the cache back if it changed. Returns false if that failed, which leaves the file as it was.
+bool close_validation_cache(ValidationCache cache);
+
+#endif
+
+#ifdef VALIDATION_HAS_THREADS
+
+typedef struct
+{
+    char** data;
+    int size;
+    int capacity;
+} PathList;
+
+PathList make_path_list();
+void deallocate_path_list(PathList list);
+// Adds the file, the C sources under the directory, or the files listed in the @list file
+void collect_argument_paths(char* argument, PathList* list);
+
+typedef struct
+{
+    ValidationResult result;
+    size_t size;
+} BatchValidationEntry;
+
+// Every worker reads up to `read_ahead_depth` of its next files while it validates the current one
+BatchValidationEntry* validate_in_batch(char** paths, int path_count, int thread_count, int read_ahead_depth);
+
+#endif
+
+#endif
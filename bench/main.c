@@ -0,0 +1,439 @@
+/*
+Throughput benchmarks for the validator, detab and entab on deterministic synthetic corpora. Results are written as
+JSON, so that runs of different versions can be compared by a script.
+
+Usage: knr_bench [--sizes 64K,1M,16M] [--corpora nested,comments,...] [--operations validate,detab,entab]
+                 [--warmup 1] [--repetitions 5] [--output results.json]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#define BENCH_HAS_RUSAGE
+#endif
+
+#include "../1-20/detab.h"
+#include "../1-21/entab.h"
+#include "../1-24/validation.h"
+#include "../common/output.h"
+#include "../common/system.h"
+#include "../common/tab_stops.h"
+#include "../common/testing.h"
+
+// seeded from the corpus type, so that the corpora are the same on every run
+uint64_t random_state;
+
+int get_random_number_below(int limit) { return (int)(get_random_number(&random_state) % (uint64_t)limit); }
+
+// Corpora are built from whole lines that are appended until the size is reached, and then cut at exactly that size.
+// Every line keeps its delimiters balanced, so the validator always has to get through the whole corpus: cutting the
+// end off can only leave delimiters unclosed, which is reported at the end.
+typedef struct
+{
+    char* data;
+    size_t size;
+    size_t capacity;
+} Corpus;
+
+void append_text(Corpus* corpus, char* text, size_t text_size)
+{
+    size_t copied_size = corpus->capacity - corpus->size < text_size ? corpus->capacity - corpus->size : text_size;
+    memcpy(corpus->data + corpus->size, text, copied_size);
+    corpus->size += copied_size;
+}
+
+void append_string(Corpus* corpus, char* text) { append_text(corpus, text, strlen(text)); }
+
+void append_repeated(Corpus* corpus, char character, int count)
+{
+    for (int i = 0; i < count && corpus->size < corpus->capacity; i++) { corpus->data[corpus->size++] = character; }
+}
+
+char* identifiers[] = {"i", "count", "buffer", "node->next", "table[index]", "result", "state", "x1", "size"};
+int identifier_count = sizeof(identifiers) / sizeof(identifiers[0]);
+
+void append_identifier(Corpus* corpus) { append_string(corpus, identifiers[get_random_number_below(identifier_count)]); }
+
+// Blocks nested hundreds of levels deep, with calls and subscripts on every level
+void generate_nested_lines(Corpus* corpus)
+{
+    int depth = 1 + get_random_number_below(256);
+    char closers[256];
+    for (int level = 0; level < depth; level++)
+    {
+        append_repeated(corpus, ' ', level % 32 * 4);
+        switch (get_random_number_below(3))
+        {
+            case 0: append_string(corpus, "if (f("); closers[level] = ')'; break;
+            case 1: append_string(corpus, "a["); closers[level] = ']'; break;
+            default: append_string(corpus, "{"); closers[level] = '}'; break;
+        }
+        append_identifier(corpus);
+        append_string(corpus, "\n");
+    }
+    for (int level = depth - 1; level >= 0; level--)
+    {
+        append_repeated(corpus, ' ', level % 32 * 4);
+        append_text(corpus, &closers[level], 1);
+        if (closers[level] == ')') { append_string(corpus, ")"); }
+        append_string(corpus, "\n");
+    }
+}
+
+// Mostly comments, full of quotes and delimiters that don't count
+void generate_comment_lines(Corpus* corpus)
+{
+    switch (get_random_number_below(3))
+    {
+        case 0: append_string(corpus, "// don't count (these [ or { even \"when quoted\n"); break;
+        case 1: append_string(corpus, "/* a block comment with a ' quote, a ) and a * star */ x = y;\n"); break;
+        default:
+            append_string(corpus, "/*\n * Several lines of documentation about `f(x)` and a[i].\n");
+            append_string(corpus, " * Returns -1 on error.\n */\n");
+            break;
+    }
+}
+
+// String and character literals with escapes and delimiters inside them
+void generate_string_lines(Corpus* corpus)
+{
+    append_string(corpus, "    printf(\"");
+    int piece_count = 1 + get_random_number_below(8);
+    for (int i = 0; i < piece_count; i++)
+    {
+        switch (get_random_number_below(4))
+        {
+            case 0: append_string(corpus, "value (%d) "); break;
+            case 1: append_string(corpus, "\\\"quoted\\\" "); break;
+            case 2: append_string(corpus, "[not a bracket] {or a brace} "); break;
+            default: append_string(corpus, "path\\\\to\\\\file "); break;
+        }
+    }
+    append_string(corpus, "\\n\", c == '\\'' ? '\"' : '(');\n");
+}
+
+// Tab-indented code with tab-aligned trailing comments
+void generate_tab_lines(Corpus* corpus)
+{
+    append_repeated(corpus, '\t', get_random_number_below(8));
+    append_identifier(corpus);
+    append_string(corpus, " = ");
+    append_identifier(corpus);
+    append_string(corpus, ";");
+    append_repeated(corpus, '\t', 1 + get_random_number_below(4));
+    append_string(corpus, "// note\n");
+}
+
+// Lines of thousands of bytes, with runs of blanks of all lengths between the tokens
+void generate_long_lines(Corpus* corpus)
+{
+    int token_count = 500 + get_random_number_below(8000);
+    for (int i = 0; i < token_count; i++)
+    {
+        append_identifier(corpus);
+        append_repeated(corpus, ' ', 1 + get_random_number_below(12));
+        append_string(corpus, i % 2 == 0 ? "+" : "(x)");
+        append_repeated(corpus, ' ', get_random_number_below(3));
+    }
+    append_string(corpus, ";\n");
+}
+
+typedef struct
+{
+    char* name;
+    void (*generate_lines)(Corpus* corpus);
+} CorpusType;
+
+CorpusType corpus_types[] = {
+    {"nested", generate_nested_lines},
+    {"comments", generate_comment_lines},
+    {"strings", generate_string_lines},
+    {"tabs", generate_tab_lines},
+    {"long_lines", generate_long_lines},
+};
+int corpus_type_count = sizeof(corpus_types) / sizeof(corpus_types[0]);
+
+Corpus generate_corpus(CorpusType corpus_type, size_t size)
+{
+    Corpus result;
+    result.size = 0;
+    result.capacity = size;
+    result.data = malloc(size == 0 ? 1 : size);
+    random_state = 88172645463325252ull;
+    for (char* name_i = corpus_type.name; *name_i != '\0'; name_i++) { random_state = random_state * 31 + *name_i; }
+    while (result.size < result.capacity) { corpus_type.generate_lines(&result); }
+    return result;
+}
+
+typedef enum
+{
+    OperationValidate,
+    OperationDetab,
+    OperationEntab,
+    OperationCount,
+} Operation;
+
+char* operation_names[OperationCount] = {"validate", "detab", "entab"};
+
+// Holds what the operations need between runs, so that the timed runs don't include growing the output buffer
+typedef struct
+{
+    TabStops tab_stops;
+    OutputBuffer output;
+    size_t checksum; // depends on every result, so that no run can be optimized away
+} BenchmarkContext;
+
+void run_operation(Operation operation, Corpus corpus, BenchmarkContext* context)
+{
+    context->output.size = 0;
+    switch (operation)
+    {
+        case OperationValidate:
+        {
+            ValidationResult result = validate(corpus.data, corpus.size);
+            context->checksum += result.type;
+            break;
+        }
+        case OperationDetab:
+        {
+            DetabState state = make_detab_state(&context->tab_stops);
+            detab_chunk(&state, corpus.data, corpus.size, &context->output);
+            context->checksum += context->output.size;
+            break;
+        }
+        case OperationEntab:
+        {
+            retab_to_output(corpus.data, corpus.size, &context->tab_stops, &context->tab_stops, &context->output);
+            context->checksum += context->output.size;
+            break;
+        }
+        default: printf("Invalid operation %d\n", operation); exit(1);
+    }
+}
+
+// Peak resident memory of the process in bytes, or 0 where it isn't available. On Linux the peak is reset before every
+// benchmark, elsewhere it's the peak of the whole run so far.
+void reset_peak_memory_usage()
+{
+    FILE* file_handle = fopen("/proc/self/clear_refs", "w");
+    if (file_handle == NULL) { return; }
+    fputs("5", file_handle);
+    fclose(file_handle);
+}
+
+size_t get_peak_memory_usage()
+{
+    FILE* file_handle = fopen("/proc/self/status", "r");
+    if (file_handle != NULL)
+    {
+        char line[256];
+        size_t result = 0;
+        while (fgets(line, sizeof(line), file_handle) != NULL)
+        {
+            if (strncmp(line, "VmHWM:", 6) == 0) { result = strtoull(line + 6, NULL, 10) * 1024; }
+        }
+        fclose(file_handle);
+        if (result != 0) { return result; }
+    }
+#ifdef BENCH_HAS_RUSAGE
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return (size_t)usage.ru_maxrss;
+#else
+    return (size_t)usage.ru_maxrss * 1024;
+#endif
+#else
+    return 0;
+#endif
+}
+
+int compare_doubles(const void* left, const void* right)
+{
+    double left_value = *(double*)left;
+    double right_value = *(double*)right;
+    return left_value < right_value ? -1 : left_value > right_value;
+}
+
+typedef struct
+{
+    size_t* sizes;
+    int size_count;
+    bool is_corpus_type_selected[sizeof(corpus_types) / sizeof(corpus_types[0])];
+    bool is_operation_selected[OperationCount];
+    int warmup_count;
+    int repetition_count;
+    char* output_file_path;
+} BenchmarkOptions;
+
+// Sizes like 64K, 16M or 1G
+size_t parse_size(char* text)
+{
+    char* end;
+    unsigned long long result = strtoull(text, &end, 10);
+    if (end == text) { printf("Invalid size '%s'\n", text); exit(1); }
+    if (*end == 'K' || *end == 'k') { result *= 1024; end++; }
+    else if (*end == 'M' || *end == 'm') { result *= 1024 * 1024; end++; }
+    else if (*end == 'G' || *end == 'g') { result *= 1024 * 1024 * 1024; end++; }
+    if (*end != '\0' || result == 0) { printf("Invalid size '%s'\n", text); exit(1); }
+    return (size_t)result;
+}
+
+// Returns the comma-separated items in place, by replacing the commas with NULs
+int split_list(char* text, char** items, int max_item_count)
+{
+    int item_count = 0;
+    while (item_count < max_item_count)
+    {
+        items[item_count++] = text;
+        char* comma = strchr(text, ',');
+        if (comma == NULL) { break; }
+        *comma = '\0';
+        text = comma + 1;
+    }
+    return item_count;
+}
+
+#define MAX_LIST_ITEM_COUNT 32
+
+BenchmarkOptions parse_benchmark_options(int argument_count, char** arguments)
+{
+    BenchmarkOptions result;
+    char default_sizes[] = "64K,1M,16M";
+    char* size_texts[MAX_LIST_ITEM_COUNT];
+    result.size_count = split_list(default_sizes, size_texts, MAX_LIST_ITEM_COUNT);
+    for (int i = 0; i < corpus_type_count; i++) { result.is_corpus_type_selected[i] = true; }
+    for (int i = 0; i < OperationCount; i++) { result.is_operation_selected[i] = true; }
+    result.warmup_count = 1;
+    result.repetition_count = 5;
+    result.output_file_path = NULL;
+
+    for (int i = 1; i < argument_count; i++)
+    {
+        if (i + 1 == argument_count) { printf("Expected a value after %s\n", arguments[i]); exit(1); }
+        char* value = arguments[++i];
+        char* items[MAX_LIST_ITEM_COUNT];
+        if (strcmp(arguments[i - 1], "--sizes") == 0)
+        { result.size_count = split_list(value, size_texts, MAX_LIST_ITEM_COUNT); }
+        else if (strcmp(arguments[i - 1], "--corpora") == 0)
+        {
+            int item_count = split_list(value, items, MAX_LIST_ITEM_COUNT);
+            for (int j = 0; j < corpus_type_count; j++) { result.is_corpus_type_selected[j] = false; }
+            for (int j = 0; j < item_count; j++)
+            {
+                int corpus_type_i = 0;
+                while (corpus_type_i < corpus_type_count && strcmp(corpus_types[corpus_type_i].name, items[j]) != 0)
+                { corpus_type_i++; }
+                if (corpus_type_i == corpus_type_count) { printf("Unknown corpus '%s'\n", items[j]); exit(1); }
+                result.is_corpus_type_selected[corpus_type_i] = true;
+            }
+        }
+        else if (strcmp(arguments[i - 1], "--operations") == 0)
+        {
+            int item_count = split_list(value, items, MAX_LIST_ITEM_COUNT);
+            for (int j = 0; j < OperationCount; j++) { result.is_operation_selected[j] = false; }
+            for (int j = 0; j < item_count; j++)
+            {
+                int operation_i = 0;
+                while (operation_i < OperationCount && strcmp(operation_names[operation_i], items[j]) != 0)
+                { operation_i++; }
+                if (operation_i == OperationCount) { printf("Unknown operation '%s'\n", items[j]); exit(1); }
+                result.is_operation_selected[operation_i] = true;
+            }
+        }
+        else if (strcmp(arguments[i - 1], "--warmup") == 0) { result.warmup_count = atoi(value); }
+        else if (strcmp(arguments[i - 1], "--repetitions") == 0) { result.repetition_count = atoi(value); }
+        else if (strcmp(arguments[i - 1], "--output") == 0) { result.output_file_path = value; }
+        else { printf("Unknown option '%s'\n", arguments[i - 1]); exit(1); }
+    }
+    if (result.warmup_count < 0 || result.repetition_count < 1)
+    { printf("Expected at least one repetition and no negative warmup\n"); exit(1); }
+    result.sizes = malloc(sizeof(size_t) * result.size_count);
+    for (int i = 0; i < result.size_count; i++) { result.sizes[i] = parse_size(size_texts[i]); }
+    return result;
+}
+
+int main(int argument_count, char** arguments)
+{
+    BenchmarkOptions options = parse_benchmark_options(argument_count, arguments);
+    FILE* output_file_handle = stdout;
+    if (options.output_file_path != NULL)
+    {
+        output_file_handle = fopen(options.output_file_path, "w");
+        if (output_file_handle == NULL) { printf("Failed to open file '%s'\n", options.output_file_path); exit(1); }
+    }
+
+    BenchmarkContext context;
+    context.tab_stops = make_uniform_tab_stops(DEFAULT_TAB_SIZE);
+    context.output = make_output_buffer(NULL);
+    context.checksum = 0;
+    double* run_times = malloc(sizeof(double) * options.repetition_count);
+
+    fprintf(
+        output_file_handle,
+        "{\n  \"processor_count\": %d,\n  \"warmup\": %d,\n  \"repetitions\": %d,\n  \"results\": [",
+        get_processor_count(),
+        options.warmup_count,
+        options.repetition_count
+    );
+    bool is_first_result = true;
+    for (int corpus_type_i = 0; corpus_type_i < corpus_type_count; corpus_type_i++)
+    {
+        if (!options.is_corpus_type_selected[corpus_type_i]) { continue; }
+        for (int size_i = 0; size_i < options.size_count; size_i++)
+        {
+            Corpus corpus = generate_corpus(corpus_types[corpus_type_i], options.sizes[size_i]);
+            for (int operation = 0; operation < OperationCount; operation++)
+            {
+                if (!options.is_operation_selected[operation]) { continue; }
+                reset_peak_memory_usage();
+                for (int i = 0; i < options.warmup_count; i++) { run_operation(operation, corpus, &context); }
+                for (int i = 0; i < options.repetition_count; i++)
+                {
+                    double start_time = get_seconds();
+                    run_operation(operation, corpus, &context);
+                    run_times[i] = get_seconds() - start_time;
+                }
+                size_t peak_memory_usage = get_peak_memory_usage();
+                qsort(run_times, options.repetition_count, sizeof(double), compare_doubles);
+                double median_time = options.repetition_count % 2 == 1
+                    ? run_times[options.repetition_count / 2]
+                    : (run_times[options.repetition_count / 2 - 1] + run_times[options.repetition_count / 2]) / 2;
+                if (median_time <= 0) { median_time = 1e-9; }
+
+                fprintf(
+                    output_file_handle,
+                    "%s\n    {\"operation\": \"%s\", \"corpus\": \"%s\", \"size_bytes\": %zu, "
+                        "\"median_seconds\": %.9f, \"min_seconds\": %.9f, \"max_seconds\": %.9f, "
+                        "\"mb_per_second\": %.3f, \"ns_per_byte\": %.4f, \"peak_rss_bytes\": %zu}",
+                    is_first_result ? "" : ",",
+                    operation_names[operation],
+                    corpus_types[corpus_type_i].name,
+                    corpus.size,
+                    median_time,
+                    run_times[0],
+                    run_times[options.repetition_count - 1],
+                    corpus.size / 1e6 / median_time,
+                    median_time * 1e9 / (corpus.size == 0 ? 1 : corpus.size),
+                    peak_memory_usage
+                );
+                fflush(output_file_handle);
+                is_first_result = false;
+            }
+            free(corpus.data);
+        }
+    }
+    fprintf(output_file_handle, "\n  ],\n  \"checksum\": %zu\n}\n", context.checksum);
+
+    if (output_file_handle != stdout) { fclose(output_file_handle); }
+    free(run_times);
+    free(options.sizes);
+    deallocate_output_buffer(context.output);
+    deallocate_tab_stops(context.tab_stops);
+    return 0;
+}
@@ -0,0 +1,64 @@
+# Runs the filter on the exercises' test files and compares what it writes with their expected output. Run with
+# `cmake -DKNR=<knr> -DSOURCE_DIR=<source dir> -DWORK_DIR=<scratch dir> -P compare_filter_output.cmake`.
+
+set(detab_files "${SOURCE_DIR}/1-20/test files")
+set(entab_files "${SOURCE_DIR}/1-21/test files")
+file(MAKE_DIRECTORY "${WORK_DIR}")
+
+# Runs knr with the arguments (standard input comes from `INPUT` if given) and fails unless it exits with 0
+function(run_knr output_file)
+    cmake_parse_arguments(PARSE_ARGV 1 run "" "INPUT" "")
+    if(run_INPUT)
+        execute_process(COMMAND "${KNR}" ${run_UNPARSED_ARGUMENTS} INPUT_FILE "${run_INPUT}"
+            OUTPUT_FILE "${output_file}" RESULT_VARIABLE result)
+    else()
+        execute_process(COMMAND "${KNR}" ${run_UNPARSED_ARGUMENTS} OUTPUT_FILE "${output_file}" RESULT_VARIABLE result)
+    endif()
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "knr ${run_UNPARSED_ARGUMENTS} failed: ${result}")
+    endif()
+endfunction()
+
+function(expect_same_files actual_file expected_file description)
+    execute_process(COMMAND "${CMAKE_COMMAND}" -E compare_files "${actual_file}" "${expected_file}"
+        RESULT_VARIABLE result)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "${description}: '${actual_file}' differs from '${expected_file}'")
+    endif()
+endfunction()
+
+# Every file on its own, named and on standard input, and all of them in one run, which writes their outputs one after
+# the other
+foreach(command detab entab)
+    set(files "${${command}_files}")
+    file(GLOB inputs "${files}/test * input.txt")
+    list(SORT inputs)
+    set(all_expected "")
+    foreach(input IN LISTS inputs)
+        string(REPLACE " input.txt" " output.txt" expected "${input}")
+        run_knr("${WORK_DIR}/${command} named.txt" ${command} "${input}")
+        expect_same_files("${WORK_DIR}/${command} named.txt" "${expected}" "${command} of a named file")
+        run_knr("${WORK_DIR}/${command} standard input.txt" ${command} INPUT "${input}")
+        expect_same_files("${WORK_DIR}/${command} standard input.txt" "${expected}" "${command} of standard input")
+        file(READ "${expected}" expected_output)
+        string(APPEND all_expected "${expected_output}")
+    endforeach()
+    set(all_expected_file "${WORK_DIR}/${command} all expected.txt")
+    file(WRITE "${all_expected_file}" "${all_expected}")
+    run_knr("${WORK_DIR}/${command} all.txt" ${command} ${inputs})
+    expect_same_files("${WORK_DIR}/${command} all.txt" "${all_expected_file}" "${command} of all files")
+    run_knr("${WORK_DIR}/${command} all unread.txt" ${command} --read-ahead 0 ${inputs})
+    expect_same_files("${WORK_DIR}/${command} all unread.txt" "${all_expected_file}" "${command} without read-ahead")
+endforeach()
+
+# Entab with spaces only expands tabs like detab, and retabbing to other tab stops and back gives plain entab's output
+file(GLOB inputs "${entab_files}/test * input.txt")
+foreach(input IN LISTS inputs)
+    string(REPLACE " input.txt" " output.txt" expected "${input}")
+    run_knr("${WORK_DIR}/entab spaces.txt" entab -s "${input}")
+    run_knr("${WORK_DIR}/detab.txt" detab "${input}")
+    expect_same_files("${WORK_DIR}/entab spaces.txt" "${WORK_DIR}/detab.txt" "entab -s")
+    run_knr("${WORK_DIR}/retab 8.txt" entab -i 4 -t 8 "${input}")
+    run_knr("${WORK_DIR}/retab 4.txt" entab -i 8 -t 4 INPUT "${WORK_DIR}/retab 8.txt")
+    expect_same_files("${WORK_DIR}/retab 4.txt" "${expected}" "entab -i 4 -t 8 and back")
+endforeach()
@@ -0,0 +1,522 @@
+#include "daemon.h"
+
+DaemonHeader make_daemon_header(uint32_t kind, uint32_t argument_size, uint64_t payload_size)
+{
+    DaemonHeader result;
+    result.kind = kind;
+    result.argument_size = argument_size;
+    result.payload_size = payload_size;
+    return result;
+}
+
+void write_daemon_header(char* destination, DaemonHeader header)
+{
+    for (int i = 0; i < 4; i++) { destination[i] = (char)(header.kind >> (8 * i)); }
+    for (int i = 0; i < 4; i++) { destination[4 + i] = (char)(header.argument_size >> (8 * i)); }
+    for (int i = 0; i < 8; i++) { destination[8 + i] = (char)(header.payload_size >> (8 * i)); }
+}
+
+DaemonHeader read_daemon_header(char* source)
+{
+    DaemonHeader result;
+    result.kind = 0;
+    result.argument_size = 0;
+    result.payload_size = 0;
+    for (int i = 0; i < 4; i++) { result.kind |= (uint32_t)(unsigned char)source[i] << (8 * i); }
+    for (int i = 0; i < 4; i++) { result.argument_size |= (uint32_t)(unsigned char)source[4 + i] << (8 * i); }
+    for (int i = 0; i < 8; i++) { result.payload_size |= (uint64_t)(unsigned char)source[8 + i] << (8 * i); }
+    return result;
+}
+
+#ifdef DAEMON_IS_SUPPORTED
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "../1-20/detab.h"
+#include "../1-21/entab.h"
+#include "../1-24/validation.h"
+#include "../common/input.h"
+#include "../common/output.h"
+#include "../common/system.h"
+#include "../common/tab_stops.h"
+
+#define DAEMON_INPUT_BUFFER_SIZE (64 * 1024)
+// Buffers that a large request grew past this are shrunk again once it's answered
+#define DAEMON_MAX_KEPT_BUFFER_SIZE (16 * 1024 * 1024)
+#define DAEMON_MAX_MESSAGE_SIZE 256
+// Connections that send nothing or read nothing for this many seconds are closed
+#define DAEMON_IDLE_TIMEOUT 30
+// Milliseconds before a worker looks again whether a client is still waiting that another worker was about to take
+#define DAEMON_RECHECK_INTERVAL 100
+
+// The workers that are waiting for a connection
+atomic_int daemon_accepting_worker_count;
+
+// Returns false if the other side went away
+bool write_to_socket(int connection, char* data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t bytes_written = write(connection, data, size);
+        if (bytes_written < 0 && errno == EINTR) { continue; }
+        if (bytes_written <= 0) { return false; }
+        data += bytes_written;
+        size -= (size_t)bytes_written;
+    }
+    return true;
+}
+
+bool read_from_socket(int connection, char* data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t bytes_read = read(connection, data, size);
+        if (bytes_read < 0 && errno == EINTR) { continue; }
+        if (bytes_read <= 0) { return false; }
+        data += bytes_read;
+        size -= (size_t)bytes_read;
+    }
+    return true;
+}
+
+// Everything a worker keeps from one request to the next, so that serving a small request doesn't allocate
+typedef struct
+{
+    int listening_socket;
+    ValidationState validation_state;
+    char* input; // the requests that have arrived but haven't been answered yet
+    size_t input_capacity;
+    OutputBuffer responses; // without a file, so it grows to hold the answers to all the requests in the input
+    char tab_stops_text[DAEMON_MAX_ARGUMENT_SIZE + 1]; // of the last tab stops, which are kept parsed
+    TabStops tab_stops;
+} DaemonWorker;
+
+DaemonWorker make_daemon_worker(int listening_socket)
+{
+    DaemonWorker result;
+    result.listening_socket = listening_socket;
+    result.validation_state = make_validation_state();
+    result.input_capacity = DAEMON_INPUT_BUFFER_SIZE;
+    result.input = malloc(result.input_capacity);
+    result.responses = make_output_buffer(NULL);
+    result.tab_stops_text[0] = '\0';
+    result.tab_stops = make_uniform_tab_stops(DEFAULT_TAB_SIZE);
+    return result;
+}
+
+// Returns NULL for invalid tab stops, and for ones past `DAEMON_MAX_TAB_STOP`
+TabStops* get_daemon_tab_stops(DaemonWorker* worker, char* argument, size_t argument_size)
+{
+    if (strlen(worker->tab_stops_text) == argument_size && memcmp(worker->tab_stops_text, argument, argument_size) == 0)
+    { return &worker->tab_stops; }
+    char text[DAEMON_MAX_ARGUMENT_SIZE + 1];
+    memcpy(text, argument, argument_size);
+    text[argument_size] = '\0';
+    bool is_valid = argument_size == 0
+        || (strlen(text) == argument_size && are_tab_stops_valid(text, DAEMON_MAX_TAB_STOP));
+    if (!is_valid) { return NULL; }
+    deallocate_tab_stops(worker->tab_stops);
+    worker->tab_stops = argument_size == 0 ? make_uniform_tab_stops(DEFAULT_TAB_SIZE) : parse_tab_stops(text);
+    strcpy(worker->tab_stops_text, text);
+    return &worker->tab_stops;
+}
+
+// The payload of a response is produced right after its header in the responses buffer, which is then filled in. The
+// returned offset is that of the header, since the buffer can move as it grows.
+size_t begin_daemon_response(DaemonWorker* worker)
+{
+    size_t result = worker->responses.size;
+    reserve_output(&worker->responses, DAEMON_HEADER_SIZE);
+    worker->responses.size += DAEMON_HEADER_SIZE;
+    return result;
+}
+
+void end_daemon_response(DaemonWorker* worker, size_t header_offset, DaemonResponseStatus status)
+{
+    uint64_t payload_size = worker->responses.size - header_offset - DAEMON_HEADER_SIZE;
+    write_daemon_header(worker->responses.data + header_offset, make_daemon_header(status, 0, payload_size));
+}
+
+void respond_with_daemon_message(DaemonWorker* worker, DaemonResponseStatus status, char* message)
+{
+    size_t header_offset = begin_daemon_response(worker);
+    write_output(&worker->responses, message, strlen(message));
+    end_daemon_response(worker, header_offset, status);
+}
+
+void handle_daemon_request(DaemonWorker* worker, DaemonHeader header, char* argument, char* payload)
+{
+    size_t payload_size = (size_t)header.payload_size;
+    if (header.kind == DaemonRequestTypeCheck)
+    {
+        ValidationResult result = validate_reusing_state(&worker->validation_state, payload, payload_size);
+        size_t header_offset = begin_daemon_response(worker);
+        char* message = reserve_output(&worker->responses, DAEMON_MAX_MESSAGE_SIZE);
+        int message_size = format_validation_result(result, message, DAEMON_MAX_MESSAGE_SIZE);
+        if (message_size >= DAEMON_MAX_MESSAGE_SIZE) { message_size = DAEMON_MAX_MESSAGE_SIZE - 1; }
+        worker->responses.size += (size_t)message_size;
+        bool has_passed = result.type == ValidationResultTypeSuccess;
+        end_daemon_response(
+            worker,
+            header_offset,
+            has_passed ? DaemonResponseStatusSuccess : DaemonResponseStatusFailedCheck
+        );
+        return;
+    }
+    if (header.kind != DaemonRequestTypeDetab && header.kind != DaemonRequestTypeEntab)
+    {
+        respond_with_daemon_message(worker, DaemonResponseStatusBadRequest, "Unknown request type");
+        return;
+    }
+    TabStops* tab_stops = get_daemon_tab_stops(worker, argument, header.argument_size);
+    if (tab_stops == NULL)
+    {
+        respond_with_daemon_message(worker, DaemonResponseStatusBadRequest, "Invalid tab stops");
+        return;
+    }
+    if (header.payload_size * (uint64_t)tab_stops->max_distance > DAEMON_MAX_RESPONSE_SIZE)
+    {
+        respond_with_daemon_message(worker, DaemonResponseStatusBadRequest, "Response too large");
+        return;
+    }
+    size_t header_offset = begin_daemon_response(worker);
+    if (header.kind == DaemonRequestTypeDetab)
+    {
+        DetabState state = make_detab_state(tab_stops);
+        detab_chunk(&state, payload, payload_size, &worker->responses);
+    }
+    else { retab_to_output(payload, payload_size, tab_stops, tab_stops, &worker->responses); }
+    end_daemon_response(worker, header_offset, DaemonResponseStatusSuccess);
+}
+
+// Waits until more of the requests arrive. Gives up on a connection that has been idle for `DAEMON_IDLE_TIMEOUT`, and
+// between requests as soon as another client is waiting and no other worker is free, so that clients that keep their
+// connections open can't take every worker. They find the connection closed and connect again.
+bool wait_for_daemon_requests(DaemonWorker* worker, int connection, bool is_between_requests)
+{
+    double deadline = get_seconds() + DAEMON_IDLE_TIMEOUT;
+    struct pollfd sockets[2];
+    sockets[0].fd = connection;
+    sockets[0].events = POLLIN;
+    sockets[1].fd = worker->listening_socket;
+    sockets[1].events = POLLIN;
+    bool is_watching_clients = is_between_requests;
+    while (true)
+    {
+        double remaining_time = deadline - get_seconds();
+        if (remaining_time <= 0) { return false; }
+        int timeout = (int)(remaining_time * 1000) + 1;
+        if (is_between_requests && !is_watching_clients && timeout > DAEMON_RECHECK_INTERVAL)
+        { timeout = DAEMON_RECHECK_INTERVAL; }
+        sockets[0].revents = 0;
+        sockets[1].revents = 0;
+        int ready_count = poll(sockets, is_watching_clients ? 2 : 1, timeout);
+        if (ready_count < 0 && errno != EINTR) { return false; }
+        if (sockets[0].revents != 0) { return true; } // including the client closing it, which the read finds out
+        if ((sockets[1].revents & POLLIN) != 0)
+        {
+            if (atomic_load(&daemon_accepting_worker_count) == 0) { return false; }
+            is_watching_clients = false; // the free worker takes the client, unless it's still there after a while
+        }
+        else { is_watching_clients = is_between_requests; }
+    }
+}
+
+// Keeps the buffers at their usual sizes, once a large request has been answered and the next one fits again
+void shrink_daemon_buffers(DaemonWorker* worker, size_t next_request_size)
+{
+    if (worker->input_capacity > DAEMON_MAX_KEPT_BUFFER_SIZE && next_request_size <= DAEMON_INPUT_BUFFER_SIZE)
+    {
+        char* input = realloc(worker->input, DAEMON_INPUT_BUFFER_SIZE);
+        if (input != NULL)
+        { // otherwise it just stays as large as it is
+            worker->input = input;
+            worker->input_capacity = DAEMON_INPUT_BUFFER_SIZE;
+        }
+    }
+    if (worker->responses.size == 0 && worker->responses.capacity > DAEMON_MAX_KEPT_BUFFER_SIZE)
+    {
+        deallocate_output_buffer(worker->responses);
+        worker->responses = make_output_buffer(NULL);
+    }
+}
+
+// Answers the requests as they come in. Every read can bring any number of requests, whose answers are written out
+// together, so pipelined requests share their system calls. Only answers past `DAEMON_MAX_KEPT_BUFFER_SIZE` are written
+// out before the rest of the requests are answered, so that the buffer doesn't have to hold all of them.
+void serve_daemon_connection(DaemonWorker* worker, int connection)
+{
+    size_t input_size = 0;
+    bool is_open = true;
+    while (is_open && wait_for_daemon_requests(worker, connection, input_size == 0))
+    {
+        ssize_t bytes_read = read(connection, worker->input + input_size, worker->input_capacity - input_size);
+        if (bytes_read < 0 && errno == EINTR) { continue; }
+        if (bytes_read <= 0) { break; }
+        input_size += (size_t)bytes_read;
+
+        size_t request_start = 0;
+        size_t next_request_size = DAEMON_HEADER_SIZE; // as far as we know
+        while (input_size - request_start >= DAEMON_HEADER_SIZE)
+        {
+            DaemonHeader header = read_daemon_header(worker->input + request_start);
+            if (header.argument_size > DAEMON_MAX_ARGUMENT_SIZE || header.payload_size > DAEMON_MAX_PAYLOAD_SIZE)
+            {
+                respond_with_daemon_message(worker, DaemonResponseStatusBadRequest, "Request too large");
+                is_open = false;
+                break;
+            }
+            next_request_size = DAEMON_HEADER_SIZE + header.argument_size + (size_t)header.payload_size;
+            if (input_size - request_start < next_request_size) { break; } // the rest of it is still on its way
+            char* argument = worker->input + request_start + DAEMON_HEADER_SIZE;
+            handle_daemon_request(worker, header, argument, argument + header.argument_size);
+            request_start += next_request_size;
+            next_request_size = DAEMON_HEADER_SIZE;
+            if (worker->responses.size > DAEMON_MAX_KEPT_BUFFER_SIZE)
+            {
+                if (!write_to_socket(connection, worker->responses.data, worker->responses.size)) { is_open = false; }
+                worker->responses.size = 0;
+                if (!is_open) { break; }
+            }
+        }
+        memmove(worker->input, worker->input + request_start, input_size - request_start);
+        input_size -= request_start;
+        if (is_open && next_request_size > worker->input_capacity)
+        { // exactly as large as the request, which the limits keep from growing any further
+            char* input = realloc(worker->input, next_request_size);
+            if (input == NULL)
+            {
+                respond_with_daemon_message(worker, DaemonResponseStatusBadRequest, "Out of memory");
+                is_open = false;
+            }
+            else
+            {
+                worker->input = input;
+                worker->input_capacity = next_request_size;
+            }
+        }
+
+        if (!write_to_socket(connection, worker->responses.data, worker->responses.size)) { is_open = false; }
+        worker->responses.size = 0;
+        shrink_daemon_buffers(worker, next_request_size);
+    }
+    shrink_daemon_buffers(worker, DAEMON_HEADER_SIZE);
+}
+
+void* run_daemon_worker(void* worker_pointer)
+{
+    DaemonWorker* worker = worker_pointer;
+    while (true)
+    {
+        atomic_fetch_add(&daemon_accepting_worker_count, 1);
+        int connection = accept(worker->listening_socket, NULL, NULL);
+        atomic_fetch_sub(&daemon_accepting_worker_count, 1);
+        if (connection < 0)
+        { // out of descriptors, most likely, which takes other connections closing
+            if (errno != EINTR && errno != ECONNABORTED) { usleep(1000); }
+            continue;
+        }
+        // a client that stops reading the answers doesn't keep the worker either
+        struct timeval send_timeout;
+        send_timeout.tv_sec = DAEMON_IDLE_TIMEOUT;
+        send_timeout.tv_usec = 0;
+        setsockopt(connection, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+        serve_daemon_connection(worker, connection);
+        close(connection);
+    }
+    return NULL;
+}
+
+// For removing the socket when the daemon is stopped
+char* daemon_socket_path = NULL;
+
+void stop_daemon(int signal_number)
+{
+    (void)signal_number;
+    unlink(daemon_socket_path);
+    _exit(0);
+}
+
+int run_daemon(char* socket_path, int worker_count)
+{
+    // bound under a temporary name and renamed once it's listening, so that clients never find a socket that isn't
+    // ready for them yet
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    int path_size = snprintf(address.sun_path, sizeof(address.sun_path), "%s.%ld", socket_path, (long)getpid());
+    if (path_size < 0 || (size_t)path_size >= sizeof(address.sun_path))
+    {
+        printf("Socket path too long: '%s'\n", socket_path);
+        return 1;
+    }
+    struct stat existing_status;
+    if (lstat(socket_path, &existing_status) == 0 && !S_ISSOCK(existing_status.st_mode))
+    { // a socket that a previous daemon left behind is replaced, anything else isn't
+        printf("'%s' exists and isn't a socket\n", socket_path);
+        return 1;
+    }
+    int listening_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(address.sun_path);
+    if (
+        listening_socket < 0
+            || bind(listening_socket, (struct sockaddr*)&address, sizeof(address)) != 0
+            || listen(listening_socket, SOMAXCONN) != 0
+            || rename(address.sun_path, socket_path) != 0
+    )
+    {
+        printf("Failed to listen on '%s'\n", socket_path);
+        unlink(address.sun_path);
+        return 1;
+    }
+    daemon_socket_path = socket_path;
+    signal(SIGPIPE, SIG_IGN); // a client that goes away only ends its own connection
+    signal(SIGINT, stop_daemon);
+    signal(SIGTERM, stop_daemon);
+
+    if (worker_count < 1) { worker_count = 1; }
+    DaemonWorker* workers = malloc(sizeof(DaemonWorker) * worker_count);
+    for (int i = 0; i < worker_count; i++) { workers[i] = make_daemon_worker(listening_socket); }
+    // the calling thread is the first worker, workers whose threads fail to start just aren't there
+    for (int i = 1; i < worker_count; i++)
+    {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, run_daemon_worker, &workers[i]) == 0) { pthread_detach(thread); }
+    }
+    run_daemon_worker(&workers[0]);
+    return 0;
+}
+
+typedef struct
+{
+    int connection;
+    DaemonRequestType request_type;
+    char* tab_stops_text;
+    char** paths;
+    int path_count;
+} DaemonClient;
+
+bool is_daemon_standard_input(char* path) { return strcmp(path, "-") == 0; }
+
+// Sends all the requests from a thread of its own, so that the daemon never has to wait for the client to read the
+// answers before it can read more requests
+void* send_daemon_requests(void* client_pointer)
+{
+    DaemonClient* client = client_pointer;
+    for (int i = 0; i < client->path_count; i++)
+    {
+        char* path = client->paths[i];
+        InputView input = is_daemon_standard_input(path)
+            ? open_input_view_from_descriptor(STDIN_FILENO, "standard input")
+            : open_input_view(path);
+        char header[DAEMON_HEADER_SIZE];
+        uint32_t argument_size = (uint32_t)strlen(client->tab_stops_text);
+        write_daemon_header(header, make_daemon_header(client->request_type, argument_size, input.size));
+        bool has_sent = write_to_socket(client->connection, header, sizeof(header))
+            && write_to_socket(client->connection, client->tab_stops_text, argument_size)
+            && write_to_socket(client->connection, input.data, input.size);
+        close_input_view(input);
+        if (!has_sent) { break; } // the answers stop there as well, which the reading side reports
+    }
+    shutdown(client->connection, SHUT_WR);
+    return NULL;
+}
+
+int run_daemon_client(
+    char* socket_path,
+    DaemonRequestType request_type,
+    char* tab_stops_text,
+    char** paths,
+    int path_count
+)
+{
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address.sun_path))
+    {
+        printf("Socket path too long: '%s'\n", socket_path);
+        return 1;
+    }
+    strcpy(address.sun_path, socket_path);
+    int connection = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (connection < 0 || connect(connection, (struct sockaddr*)&address, sizeof(address)) != 0)
+    {
+        printf("Failed to connect to the daemon at '%s'\n", socket_path);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    DaemonClient client;
+    client.connection = connection;
+    client.request_type = request_type;
+    client.tab_stops_text = tab_stops_text == NULL ? "" : tab_stops_text;
+    client.paths = paths;
+    client.path_count = path_count;
+    pthread_t sending_thread;
+    if (pthread_create(&sending_thread, NULL, send_daemon_requests, &client) != 0)
+    {
+        printf("Failed to start sending requests\n");
+        return 1;
+    }
+
+    bool have_all_passed = true;
+    size_t payload_capacity = DAEMON_INPUT_BUFFER_SIZE;
+    char* payload = malloc(payload_capacity);
+    for (int i = 0; i < path_count; i++)
+    {
+        char header_data[DAEMON_HEADER_SIZE];
+        if (!read_from_socket(connection, header_data, sizeof(header_data)))
+        {
+            printf("Lost the connection to the daemon\n");
+            exit(1);
+        }
+        DaemonHeader header = read_daemon_header(header_data);
+        if (header.payload_size > payload_capacity)
+        {
+            while (header.payload_size > payload_capacity) { payload_capacity *= 2; }
+            payload = realloc(payload, payload_capacity);
+            if (payload == NULL) { printf("Failed to allocate %zu bytes for a response\n", payload_capacity); exit(1); }
+        }
+        size_t payload_size = (size_t)header.payload_size;
+        if (!read_from_socket(connection, payload, payload_size))
+        {
+            printf("Lost the connection to the daemon\n");
+            exit(1);
+        }
+        char* display_name = is_daemon_standard_input(paths[i]) ? "standard input" : paths[i];
+        if (header.kind == DaemonResponseStatusBadRequest)
+        {
+            printf("%s: %.*s\n", display_name, (int)payload_size, payload);
+            have_all_passed = false;
+        }
+        else if (request_type == DaemonRequestTypeCheck)
+        {
+            printf("%s: %.*s\n", display_name, (int)payload_size, payload);
+            have_all_passed = have_all_passed && header.kind == DaemonResponseStatusSuccess;
+        }
+        else if (fwrite(payload, 1, payload_size, stdout) != payload_size)
+        {
+            printf("Failed to write %zu bytes of output\n", payload_size);
+            exit(1);
+        }
+    }
+    pthread_join(sending_thread, NULL);
+    free(payload);
+    close(connection);
+    return have_all_passed ? 0 : 1;
+}
+
+#endif
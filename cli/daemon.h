@@ -0,0 +1,73 @@
+#ifndef KNR_CLI_DAEMON_H
+#define KNR_CLI_DAEMON_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define DAEMON_IS_SUPPORTED
+#endif
+
+// The daemon serves requests over a Unix domain socket, so that editors and hooks that check many small buffers don't
+// start a process for every one of them. A connection carries any number of requests, and a client can send the next
+// ones before the answers to the previous ones arrive: the answers come back in order. Every request and every
+// response is a 16-byte header followed by its data, with the numbers in little-endian:
+// - request: u32 type, u32 argument size, u64 payload size, then the argument (the tab stops, in `-t` syntax, for
+//   detab and entab, where an empty one means the default) and the payload (the text to check or convert)
+// - response: u32 status, u32 reserved (0), u64 payload size, then the payload (the validation message for check, the
+//   converted text for detab and entab, what was wrong for a bad request)
+// A request with an argument or a payload over the limits gets a bad request response, after which the connection is
+// closed. So do tab stops past `DAEMON_MAX_TAB_STOP`, which every client shares the memory for, and detab and entab
+// requests whose answer could be larger than `DAEMON_MAX_RESPONSE_SIZE`, with every tab as wide as the widest one, but
+// the connection stays open after those.
+#define DAEMON_HEADER_SIZE 16
+#define DAEMON_MAX_ARGUMENT_SIZE 4096
+#define DAEMON_MAX_TAB_STOP 4096
+#define DAEMON_MAX_PAYLOAD_SIZE ((uint64_t)64 * 1024 * 1024)
+#define DAEMON_MAX_RESPONSE_SIZE ((uint64_t)256 * 1024 * 1024)
+#define DAEMON_MIN_WORKER_COUNT 4
+
+typedef enum
+{
+    DaemonRequestTypeCheck = 1,
+    DaemonRequestTypeDetab = 2,
+    DaemonRequestTypeEntab = 3,
+} DaemonRequestType;
+
+typedef enum
+{
+    DaemonResponseStatusSuccess,
+    DaemonResponseStatusFailedCheck,
+    DaemonResponseStatusBadRequest,
+} DaemonResponseStatus;
+
+typedef struct
+{
+    uint32_t kind; // the request type or the response status
+    uint32_t argument_size;
+    uint64_t payload_size;
+} DaemonHeader;
+
+DaemonHeader make_daemon_header(uint32_t kind, uint32_t argument_size, uint64_t payload_size);
+// Encode and decode the `DAEMON_HEADER_SIZE` bytes of a header
+void write_daemon_header(char* destination, DaemonHeader header);
+DaemonHeader read_daemon_header(char* source);
+
+#ifdef DAEMON_IS_SUPPORTED
+// Serves until it's killed. Every worker handles a connection at a time with its own warm state and buffers, so this
+// many clients are served at once and the others wait for a worker. A connection is closed when it has been idle for a
+// while, and between requests when another client is waiting for a worker. Returns only if the socket can't be set up.
+int run_daemon(char* socket_path, int worker_count);
+// Sends every file (or standard input, for "-") as a request to the daemon and prints the answers like the local
+// commands do. Returns the exit code.
+int run_daemon_client(
+    char* socket_path,
+    DaemonRequestType request_type,
+    char* tab_stops_text,
+    char** paths,
+    int path_count
+);
+#endif
+
+#endif
@@ -0,0 +1,295 @@
+/*
+Tests the daemon over its socket: starts one in a child process, sends it every given file as a check, detab and entab
+request, along with bad requests, all pipelined on one connection, and compares the answers with what the libraries
+give locally. Then checks that connections left idle don't keep other clients from being served.
+
+Usage: knr_daemon_test SOCKET FILE...
+*/
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../1-20/detab.h"
+#include "../1-21/entab.h"
+#include "../1-24/validation.h"
+#include "../common/input.h"
+#include "../common/output.h"
+#include "../common/tab_stops.h"
+#include "daemon.h"
+
+bool all_test_cases_passed = true;
+
+// The requests to send and the responses to expect for them, in the same order
+typedef struct
+{
+    OutputBuffer requests;
+    OutputBuffer responses;
+    int count;
+} DaemonTestExchange;
+
+void add_daemon_message(OutputBuffer* output, uint32_t kind, char* argument, char* payload, size_t payload_size)
+{
+    uint32_t argument_size = (uint32_t)strlen(argument);
+    char* header = reserve_output(output, DAEMON_HEADER_SIZE);
+    write_daemon_header(header, make_daemon_header(kind, argument_size, payload_size));
+    output->size += DAEMON_HEADER_SIZE;
+    write_output(output, argument, argument_size);
+    write_output(output, payload, payload_size);
+}
+
+void add_daemon_exchange(
+    DaemonTestExchange* exchange,
+    DaemonRequestType request_type,
+    char* tab_stops_text,
+    char* payload,
+    size_t payload_size,
+    DaemonResponseStatus expected_status,
+    char* expected_payload,
+    size_t expected_payload_size
+)
+{
+    add_daemon_message(&exchange->requests, request_type, tab_stops_text, payload, payload_size);
+    add_daemon_message(&exchange->responses, expected_status, "", expected_payload, expected_payload_size);
+    exchange->count++;
+}
+
+void add_daemon_check_exchange(DaemonTestExchange* exchange, char* source, size_t source_size)
+{
+    ValidationResult result = validate(source, source_size);
+    char message[256];
+    int message_size = format_validation_result(result, message, sizeof(message));
+    DaemonResponseStatus status = result.type == ValidationResultTypeSuccess
+        ? DaemonResponseStatusSuccess
+        : DaemonResponseStatusFailedCheck;
+    add_daemon_exchange(
+        exchange, DaemonRequestTypeCheck, "", source, source_size, status, message, (size_t)message_size
+    );
+}
+
+void add_daemon_tab_exchange(
+    DaemonTestExchange* exchange,
+    DaemonRequestType request_type,
+    char* tab_stops_text,
+    char* source,
+    size_t source_size
+)
+{
+    TabStops tab_stops = tab_stops_text[0] == '\0'
+        ? make_uniform_tab_stops(DEFAULT_TAB_SIZE)
+        : parse_tab_stops(tab_stops_text);
+    char* output = request_type == DaemonRequestTypeDetab
+        ? detab(source, source_size, &tab_stops)
+        : entab(source, source_size, &tab_stops);
+    add_daemon_exchange(
+        exchange, request_type, tab_stops_text, source, source_size, DaemonResponseStatusSuccess, output, strlen(output)
+    );
+    free(output);
+    deallocate_tab_stops(tab_stops);
+}
+
+void add_daemon_bad_exchange(DaemonTestExchange* exchange, uint32_t request_type, char* tab_stops_text, char* message)
+{
+    add_daemon_message(&exchange->requests, request_type, tab_stops_text, "a\tb\n", 4);
+    add_daemon_message(&exchange->responses, DaemonResponseStatusBadRequest, "", message, strlen(message));
+    exchange->count++;
+}
+
+void report_failed_daemon_test(char* reason)
+{
+    all_test_cases_passed = false;
+    printf("Daemon test failed: %s\n", reason);
+}
+
+typedef struct
+{
+    int connection;
+    OutputBuffer* requests;
+} DaemonTestSender;
+
+// Sends from a thread of its own, like the client does, so that neither side waits for the other to read once the
+// requests and the responses are more than the socket buffers hold
+void* send_daemon_test_requests(void* sender_pointer)
+{
+    DaemonTestSender* sender = sender_pointer;
+    char* data = sender->requests->data;
+    size_t size = sender->requests->size;
+    while (size > 0)
+    {
+        ssize_t bytes_written = write(sender->connection, data, size);
+        if (bytes_written < 0 && errno == EINTR) { continue; }
+        if (bytes_written <= 0) { break; } // the missing responses are reported by the reading side
+        data += bytes_written;
+        size -= (size_t)bytes_written;
+    }
+    return NULL;
+}
+
+// Reads until the connection is closed
+OutputBuffer read_all_responses(int connection)
+{
+    OutputBuffer result = make_output_buffer(NULL);
+    while (true)
+    {
+        char* destination = reserve_output(&result, 64 * 1024);
+        ssize_t bytes_read = read(connection, destination, 64 * 1024);
+        if (bytes_read <= 0) { break; }
+        result.size += (size_t)bytes_read;
+    }
+    return result;
+}
+
+int connect_to_daemon(char* socket_path)
+{
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socket_path, sizeof(address.sun_path) - 1);
+    int connection = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (connection < 0 || connect(connection, (struct sockaddr*)&address, sizeof(address)) != 0)
+    {
+        printf("Failed to connect to the daemon at '%s'\n", socket_path);
+        exit(1);
+    }
+    return connection;
+}
+
+void test_daemon_exchange(char* socket_path, char** paths, int path_count)
+{
+    DaemonTestExchange exchange;
+    exchange.requests = make_output_buffer(NULL);
+    exchange.responses = make_output_buffer(NULL);
+    exchange.count = 0;
+    for (int i = 0; i < path_count; i++)
+    {
+        InputView input = open_input_view(paths[i]);
+        add_daemon_check_exchange(&exchange, input.data, input.size);
+        add_daemon_tab_exchange(&exchange, DaemonRequestTypeDetab, "", input.data, input.size);
+        add_daemon_tab_exchange(&exchange, DaemonRequestTypeDetab, "2,5,13", input.data, input.size);
+        add_daemon_tab_exchange(&exchange, DaemonRequestTypeEntab, "", input.data, input.size);
+        add_daemon_tab_exchange(&exchange, DaemonRequestTypeEntab, "8", input.data, input.size);
+        close_input_view(input);
+    }
+    // more than the socket buffers hold, both ways
+    size_t large_source_size = 1024 * 1024;
+    char* large_source = malloc(large_source_size);
+    for (size_t i = 0; i < large_source_size; i++) { large_source[i] = "ab\tcd\t\n"[i % 7]; }
+    add_daemon_tab_exchange(&exchange, DaemonRequestTypeDetab, "8", large_source, large_source_size);
+    add_daemon_tab_exchange(&exchange, DaemonRequestTypeEntab, "2", large_source, large_source_size);
+    free(large_source);
+    add_daemon_bad_exchange(&exchange, 9, "", "Unknown request type");
+    add_daemon_bad_exchange(&exchange, DaemonRequestTypeDetab, "4,x", "Invalid tab stops");
+    add_daemon_bad_exchange(&exchange, DaemonRequestTypeEntab, "0", "Invalid tab stops");
+    // valid, but past the daemon's limit
+    add_daemon_bad_exchange(&exchange, DaemonRequestTypeDetab, "1,5000", "Invalid tab stops");
+    // the widest tab for every byte would make the answer one byte too large
+    size_t wide_source_size = DAEMON_MAX_RESPONSE_SIZE / DAEMON_MAX_TAB_STOP + 1;
+    char* wide_source = calloc(wide_source_size, 1);
+    add_daemon_message(&exchange.requests, DaemonRequestTypeDetab, "4096", wide_source, wide_source_size);
+    add_daemon_message(&exchange.responses, DaemonResponseStatusBadRequest, "", "Response too large", 18);
+    exchange.count++;
+    free(wide_source);
+    // the connection goes on after bad requests, but not after one that's too large
+    add_daemon_tab_exchange(&exchange, DaemonRequestTypeDetab, "3", "\tx\n", 3);
+    char header[DAEMON_HEADER_SIZE];
+    write_daemon_header(header, make_daemon_header(DaemonRequestTypeCheck, 0, DAEMON_MAX_PAYLOAD_SIZE + 1));
+    write_output(&exchange.requests, header, sizeof(header));
+    add_daemon_message(&exchange.responses, DaemonResponseStatusBadRequest, "", "Request too large", 17);
+
+    int connection = connect_to_daemon(socket_path);
+    DaemonTestSender sender;
+    sender.connection = connection;
+    sender.requests = &exchange.requests;
+    pthread_t sending_thread;
+    if (pthread_create(&sending_thread, NULL, send_daemon_test_requests, &sender) != 0)
+    {
+        printf("Failed to start sending requests\n");
+        exit(1);
+    }
+    OutputBuffer responses = read_all_responses(connection);
+    pthread_join(sending_thread, NULL);
+    close(connection);
+    size_t offset = 0;
+    for (int i = 0; i <= exchange.count; i++)
+    { // the one past the count is the answer to the request that's too large
+        size_t size = DAEMON_HEADER_SIZE + read_daemon_header(exchange.responses.data + offset).payload_size;
+        char* expected_response = exchange.responses.data + offset;
+        if (offset + size > responses.size || memcmp(responses.data + offset, expected_response, size) != 0)
+        {
+            printf("Daemon test failed: response %d of %d differs\n", i + 1, exchange.count + 1);
+            all_test_cases_passed = false;
+            break;
+        }
+        offset += size;
+    }
+    if (all_test_cases_passed && offset != responses.size) { report_failed_daemon_test("more responses than requests"); }
+    deallocate_output_buffer(responses);
+    deallocate_output_buffer(exchange.requests);
+    deallocate_output_buffer(exchange.responses);
+}
+
+// Every worker of the daemon gets a connection that stays idle, and a client that comes after them still gets its
+// answer, from a worker that gave up an idle connection for it
+void test_daemon_idle_connections(char* socket_path, int worker_count)
+{
+    int* idle_connections = malloc(sizeof(int) * worker_count);
+    for (int i = 0; i < worker_count; i++) { idle_connections[i] = connect_to_daemon(socket_path); }
+    usleep(100 * 1000); // for the workers to take them
+
+    OutputBuffer request = make_output_buffer(NULL);
+    add_daemon_message(&request, DaemonRequestTypeDetab, "", "\tx\n", 3);
+    int connection = connect_to_daemon(socket_path);
+    if (write(connection, request.data, request.size) != (ssize_t)request.size)
+    { report_failed_daemon_test("couldn't send the request after the idle connections"); }
+    struct pollfd answer;
+    answer.fd = connection;
+    answer.events = POLLIN;
+    char response[DAEMON_HEADER_SIZE + 6];
+    bool is_answered = poll(&answer, 1, 5000) == 1
+        && read(connection, response, sizeof(response)) == (ssize_t)sizeof(response)
+        && memcmp(response + DAEMON_HEADER_SIZE, "    x\n", 6) == 0;
+    if (!is_answered) { report_failed_daemon_test("idle connections kept a client from being served"); }
+
+    close(connection);
+    for (int i = 0; i < worker_count; i++) { close(idle_connections[i]); }
+    free(idle_connections);
+    deallocate_output_buffer(request);
+}
+
+int main(int argument_count, char** arguments)
+{
+    if (argument_count < 3) { printf("Usage: knr_daemon_test SOCKET FILE...\n"); return 1; }
+    char* socket_path = arguments[1];
+    unlink(socket_path);
+    pid_t daemon_pid = fork();
+    if (daemon_pid < 0) { printf("Failed to start the daemon\n"); return 1; }
+    int worker_count = 2;
+    if (daemon_pid == 0) { exit(run_daemon(socket_path, worker_count)); }
+    struct stat socket_status;
+    for (int i = 0; i < 100 && (stat(socket_path, &socket_status) != 0 || !S_ISSOCK(socket_status.st_mode)); i++)
+    { usleep(50 * 1000); }
+
+    signal(SIGPIPE, SIG_IGN); // the daemon closes the connection after the request that's too large
+    test_daemon_exchange(socket_path, arguments + 2, argument_count - 2);
+    test_daemon_idle_connections(socket_path, worker_count);
+
+    kill(daemon_pid, SIGTERM);
+    int daemon_status;
+    waitpid(daemon_pid, &daemon_status, 0);
+    if (!WIFEXITED(daemon_status) || WEXITSTATUS(daemon_status) != 0)
+    { report_failed_daemon_test("the daemon didn't exit cleanly"); }
+    if (access(socket_path, F_OK) == 0) { report_failed_daemon_test("the socket was left behind"); }
+
+    if (all_test_cases_passed) { printf("All test cases passed!\n"); }
+    return all_test_cases_passed ? 0 : 1;
+}
@@ -0,0 +1,374 @@
+/*
+Detab, entab and check as one Unix filter. Every subcommand reads the named files, or standard input if there are none
+or for "-", and writes to standard output. Named files are read ahead, `--read-ahead` of them at a time (0 reads each
+one only when it's its turn), so that reading the next files overlaps with processing the current one; files too large
+to read ahead are memory mapped. Standard input is read in large blocks, and all the output of a run goes through a
+single output buffer, so there are no system calls per line. Detab writes mapped files out with `writev` instead,
+straight from the mapping.
+
+Usage: knr detab [-t LIST] [--read-ahead COUNT] [--server SOCKET] [FILE...]
+       knr entab [-t LIST] [-i LIST] [-s] [--read-ahead COUNT] [--server SOCKET] [FILE...]
+       knr check [--all-errors] [--cache CACHE_FILE] [--read-ahead COUNT] [--server SOCKET] [FILE...]
+       knr serve [--workers COUNT] SOCKET
+
+`-t` takes expand's tab stops. For entab they are the output tab stops, and the input ones too unless `-i` gives them
+separately; `-s` makes the output use spaces only. Check prints the result for every file, or every error with
+`--all-errors`, and fails if any of the files did. With `--cache` the results for named files are kept in the cache
+file, keyed by a hash of their contents, so that checking them again unchanged only costs the hash.
+
+`serve` runs a daemon on the Unix socket, with `--workers` connections served at once, and `--server` sends the files
+to it instead of processing them here, which saves starting up for every small input. Entab through the daemon only
+takes `-t`, and check doesn't take `--all-errors` or `--cache`.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "../1-20/detab.h"
+#include "../1-21/entab.h"
+#include "../1-24/validation.h"
+#include "../common/input.h"
+#include "../common/output.h"
+#include "../common/pipeline.h"
+#include "../common/system.h"
+#include "../common/tab_stops.h"
+#include "daemon.h"
+
+// Large enough for the validator and entab to split the input between threads
+#define FILTER_INPUT_BLOCK_SIZE (8 * 1024 * 1024)
+
+typedef struct
+{
+    char* data;
+    size_t size; // the bytes carried over from the previous block come first
+    size_t capacity;
+} InputBlock;
+
+InputBlock make_input_block()
+{
+    InputBlock result;
+    result.capacity = FILTER_INPUT_BLOCK_SIZE;
+    result.data = malloc(result.capacity);
+    result.size = 0;
+    return result;
+}
+
+// Reads from standard input until the block is full or the input ends. Returns false once there is nothing more to read.
+bool read_input_block(InputBlock* block)
+{
+    if (block->size == block->capacity)
+    { // a line that doesn't fit into the block
+        block->capacity *= 2;
+        block->data = realloc(block->data, block->capacity);
+    }
+    size_t previous_size = block->size;
+    while (block->size < block->capacity)
+    {
+        size_t bytes_read = fread(block->data + block->size, 1, block->capacity - block->size, stdin);
+        if (bytes_read == 0) { break; }
+        block->size += bytes_read;
+    }
+    if (ferror(stdin)) { printf("Failed to read from standard input\n"); exit(1); }
+    return block->size != previous_size;
+}
+
+bool is_standard_input(char* path) { return strcmp(path, "-") == 0; }
+
+// Named files are taken from the pipeline, which has them queued in the order of the arguments
+void detab_path(char* path, InputPipeline* pipeline, TabStops* tab_stops, InputBlock* block, OutputBuffer* output)
+{
+    DetabState state = make_detab_state(tab_stops);
+    if (!is_standard_input(path))
+    {
+        InputView input = take_pipeline_input(pipeline);
+#ifdef DETAB_HAS_WRITEV
+        if (input.is_mapped)
+        { // written out from the mapping, after everything before it
+            flush_output(output);
+            fflush(stdout);
+            detab_to_descriptor(input.data, input.size, tab_stops, fileno(stdout));
+            close_input_view(input);
+            return;
+        }
+#endif
+        detab_chunk(&state, input.data, input.size, output);
+        close_input_view(input);
+        return;
+    }
+    block->size = 0;
+    while (read_input_block(block))
+    {
+        detab_chunk(&state, block->data, block->size, output);
+        block->size = 0;
+    }
+}
+
+// Retabbing only carries state within a line, so standard input is retabbed a block of whole lines at a time
+void retab_path(
+    char* path,
+    InputPipeline* pipeline,
+    TabStops* input_tab_stops,
+    TabStops* output_tab_stops,
+    InputBlock* block,
+    OutputBuffer* output
+)
+{
+    if (!is_standard_input(path))
+    {
+        InputView input = take_pipeline_input(pipeline);
+        retab_to_output(input.data, input.size, input_tab_stops, output_tab_stops, output);
+        close_input_view(input);
+        return;
+    }
+    block->size = 0;
+    while (read_input_block(block))
+    {
+        size_t lines_size = block->size;
+        while (lines_size > 0 && block->data[lines_size - 1] != '\n') { lines_size--; }
+        retab_to_output(block->data, lines_size, input_tab_stops, output_tab_stops, output);
+        memmove(block->data, block->data + lines_size, block->size - lines_size);
+        block->size -= lines_size;
+    }
+    retab_to_output(block->data, block->size, input_tab_stops, output_tab_stops, output);
+}
+
+char* get_display_name(char* path) { return is_standard_input(path) ? "standard input" : path; }
+
+void print_validation_result(char* path, ValidationResult result)
+{
+    char message[256];
+    format_validation_result(result, message, sizeof(message));
+    printf("%s: %s\n", get_display_name(path), message);
+}
+
+// Returns whether the source passed. The cache is NULL when there is none.
+bool check_path(
+    char* path,
+    bool reports_all_errors,
+    ValidationCache* cache,
+    InputPipeline* pipeline,
+    InputBlock* block
+)
+{
+    if (!reports_all_errors && !is_standard_input(path))
+    { // validated as a whole, so that it can be split between threads
+        InputView input = take_pipeline_input(pipeline);
+#ifdef VALIDATION_HAS_CACHE
+        ValidationResult result = cache == NULL
+            ? validate(input.data, input.size)
+            : validate_with_cache(cache, input.data, input.size);
+#else
+        ValidationResult result = validate(input.data, input.size);
+#endif
+        close_input_view(input);
+        print_validation_result(path, result);
+        return result.type == ValidationResultTypeSuccess;
+    }
+
+    ValidationState state = reports_all_errors
+        ? make_recovering_validation_state(DEFAULT_MAX_RECOVERED_ERROR_COUNT)
+        : make_validation_state();
+    if (is_standard_input(path))
+    {
+        block->size = 0;
+        while (read_input_block(block))
+        {
+            bool needs_more_input = feed_validation_state(&state, block->data, block->size);
+            block->size = 0;
+            if (!needs_more_input) { break; }
+        }
+    }
+    else
+    {
+        InputView input = take_pipeline_input(pipeline);
+        feed_validation_state(&state, input.data, input.size);
+        close_input_view(input);
+    }
+
+    if (!reports_all_errors)
+    {
+        ValidationResult result = finish_validation(&state);
+        print_validation_result(path, result);
+        return result.type == ValidationResultTypeSuccess;
+    }
+    ValidationResultList errors = finish_validation_with_recovery(&state);
+    for (int i = 0; i < errors.size; i++) { print_validation_result(path, errors.data[i]); }
+    if (errors.is_truncated) { printf("%s: stopped after %d errors\n", get_display_name(path), errors.size); }
+    if (errors.size == 0) { print_validation_result(path, make_successful_validation_result()); }
+    bool has_passed = errors.size == 0;
+    deallocate_validation_result_list(errors);
+    return has_passed;
+}
+
+void print_usage()
+{
+    printf(
+        "Usage: knr detab [-t LIST] [--read-ahead COUNT] [--server SOCKET] [FILE...]\n"
+        "       knr entab [-t LIST] [-i LIST] [-s] [--read-ahead COUNT] [--server SOCKET] [FILE...]\n"
+        "       knr check [--all-errors] [--cache CACHE_FILE] [--read-ahead COUNT] [--server SOCKET] [FILE...]\n"
+        "       knr serve [--workers COUNT] SOCKET\n"
+    );
+}
+
+int serve(int argument_count, char** arguments)
+{
+    int worker_count = get_processor_count();
+    if (worker_count < DAEMON_MIN_WORKER_COUNT) { worker_count = DAEMON_MIN_WORKER_COUNT; }
+    int argument_i = 2;
+    if (argument_i < argument_count && strcmp(arguments[argument_i], "--workers") == 0)
+    {
+        char* count_text = argument_i + 1 < argument_count ? arguments[argument_i + 1] : "";
+        char* end;
+        worker_count = (int)strtol(count_text, &end, 10);
+        if (*end != '\0' || end == count_text || worker_count < 1)
+        { printf("Expected a number of workers after --workers\n"); exit(1); }
+        argument_i += 2;
+    }
+    if (argument_i + 1 != argument_count) { print_usage(); return 1; }
+#ifdef DAEMON_IS_SUPPORTED
+    return run_daemon(arguments[argument_i], worker_count);
+#else
+    printf("The daemon isn't supported on this platform\n");
+    return 1;
+#endif
+}
+
+int main(int argument_count, char** arguments)
+{
+    if (argument_count < 2) { print_usage(); return 1; }
+    char* command = arguments[1];
+    if (strcmp(command, "serve") == 0) { return serve(argument_count, arguments); }
+    bool is_detab = strcmp(command, "detab") == 0;
+    bool is_entab = strcmp(command, "entab") == 0;
+    bool is_check = strcmp(command, "check") == 0;
+    if (!is_detab && !is_entab && !is_check) { print_usage(); return 1; }
+
+    char* input_tab_stops_text = NULL;
+    char* output_tab_stops_text = NULL;
+    bool is_output_spaces_only = false;
+    bool reports_all_errors = false;
+    char* cache_path = NULL;
+    int read_ahead_depth = DEFAULT_READ_AHEAD_DEPTH;
+    char* server_path = NULL;
+    int argument_i = 2;
+    for (; argument_i < argument_count && arguments[argument_i][0] == '-' && arguments[argument_i][1] != '\0';
+         argument_i++)
+    {
+        char* option = arguments[argument_i];
+        if (is_entab && strcmp(option, "-s") == 0) { is_output_spaces_only = true; }
+        else if (!is_check && (strcmp(option, "-t") == 0 || (is_entab && strcmp(option, "-i") == 0)))
+        {
+            if (argument_i + 1 == argument_count) { printf("Expected tab stops after %s\n", option); exit(1); }
+            if (option[1] == 't') { output_tab_stops_text = arguments[argument_i + 1]; }
+            else { input_tab_stops_text = arguments[argument_i + 1]; }
+            argument_i++;
+        }
+        else if (is_check && strcmp(option, "--all-errors") == 0) { reports_all_errors = true; }
+        else if (is_check && strcmp(option, "--cache") == 0)
+        {
+            if (argument_i + 1 == argument_count) { printf("Expected a cache file after %s\n", option); exit(1); }
+#ifndef VALIDATION_HAS_CACHE
+            printf("Caching results isn't supported on this platform\n");
+            exit(1);
+#endif
+            cache_path = arguments[argument_i + 1];
+            argument_i++;
+        }
+        else if (strcmp(option, "--read-ahead") == 0)
+        {
+            char* count_text = argument_i + 1 < argument_count ? arguments[argument_i + 1] : "";
+            char* end;
+            read_ahead_depth = (int)strtol(count_text, &end, 10);
+            if (*end != '\0' || end == count_text || read_ahead_depth < 0)
+            { printf("Expected a number of files after %s\n", option); exit(1); }
+            argument_i++;
+        }
+        else if (strcmp(option, "--server") == 0)
+        {
+            if (argument_i + 1 == argument_count) { printf("Expected a socket after %s\n", option); exit(1); }
+#ifndef DAEMON_IS_SUPPORTED
+            printf("The daemon isn't supported on this platform\n");
+            exit(1);
+#endif
+            server_path = arguments[argument_i + 1];
+            argument_i++;
+        }
+        else { printf("Unknown option '%s' for %s\n", option, command); exit(1); }
+    }
+    char* standard_input_path = "-";
+    char** paths = argument_i == argument_count ? &standard_input_path : arguments + argument_i;
+    int path_count = argument_i == argument_count ? 1 : argument_count - argument_i;
+
+#ifdef DAEMON_IS_SUPPORTED
+    if (server_path != NULL)
+    {
+        if (input_tab_stops_text != NULL || is_output_spaces_only || reports_all_errors || cache_path != NULL)
+        { printf("-i, -s, --all-errors and --cache can't be used with --server\n"); exit(1); }
+        DaemonRequestType request_type = is_check ? DaemonRequestTypeCheck
+            : is_detab ? DaemonRequestTypeDetab
+            : DaemonRequestTypeEntab;
+        return run_daemon_client(server_path, request_type, output_tab_stops_text, paths, path_count);
+    }
+#endif
+
+    InputPipeline* pipeline = read_ahead_depth == 0
+        ? make_input_pipeline_with_backend(1, InputPipelineBackendSynchronous)
+        : make_input_pipeline(read_ahead_depth);
+    for (int i = 0; i < path_count; i++)
+    {
+        if (!is_standard_input(paths[i])) { queue_pipeline_input(pipeline, paths[i]); }
+    }
+    InputBlock block = make_input_block();
+    bool have_all_passed = true;
+    if (is_check)
+    {
+        ValidationCache cache;
+        ValidationCache* cache_pointer = NULL;
+#ifdef VALIDATION_HAS_CACHE
+        if (cache_path != NULL)
+        {
+            cache = open_validation_cache(cache_path, DEFAULT_VALIDATION_CACHE_CAPACITY);
+            cache_pointer = &cache;
+        }
+#endif
+        for (int i = 0; i < path_count; i++)
+        {
+            bool has_passed = check_path(paths[i], reports_all_errors, cache_pointer, pipeline, &block);
+            have_all_passed = has_passed && have_all_passed;
+        }
+#ifdef VALIDATION_HAS_CACHE
+        // the results are right either way, a cache that can't be written just doesn't speed up the next run
+        if (cache_pointer != NULL && !close_validation_cache(cache))
+        { fprintf(stderr, "Failed to write the cache file '%s'\n", cache_path); }
+#endif
+    }
+    else
+    {
+        TabStops output_tab_stops = output_tab_stops_text == NULL
+            ? make_uniform_tab_stops(DEFAULT_TAB_SIZE)
+            : parse_tab_stops(output_tab_stops_text);
+        if (input_tab_stops_text == NULL) { input_tab_stops_text = output_tab_stops_text; }
+        TabStops input_tab_stops = input_tab_stops_text == NULL
+            ? make_uniform_tab_stops(DEFAULT_TAB_SIZE)
+            : parse_tab_stops(input_tab_stops_text);
+        OutputBuffer output = make_output_buffer(stdout);
+        for (int i = 0; i < path_count; i++)
+        {
+            if (is_detab) { detab_path(paths[i], pipeline, &output_tab_stops, &block, &output); }
+            else
+            {
+                TabStops* output_tab_stops_pointer = is_output_spaces_only ? NULL : &output_tab_stops;
+                retab_path(paths[i], pipeline, &input_tab_stops, output_tab_stops_pointer, &block, &output);
+            }
+        }
+        flush_output(&output);
+        deallocate_output_buffer(output);
+        deallocate_tab_stops(input_tab_stops);
+        deallocate_tab_stops(output_tab_stops);
+    }
+    free(block.data);
+    deallocate_input_pipeline(pipeline);
+    return have_all_passed ? 0 : 1;
+}
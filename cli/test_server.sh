@@ -0,0 +1,46 @@
+#!/bin/sh
+# Starts a daemon and checks that check, detab and entab through it print what they print locally, for several files
+# sent over one connection, for standard input, and for tab stops that the daemon turns down.
+# Usage: test_server.sh KNR SOCKET FILE...
+knr=$1
+socket=$2
+shift 2
+rm -f "$socket"
+"$knr" serve --workers 2 "$socket" &
+server=$!
+trap 'kill $server 2>/dev/null' EXIT
+i=0
+while [ ! -S "$socket" ]; do
+    if [ $i -eq 100 ]; then echo "The daemon didn't start"; exit 1; fi
+    sleep 0.05
+    i=$((i + 1))
+done
+
+status=0
+# Runs knr with the options (unquoted, so that they split) locally and through the daemon, and compares the output and
+# the exit code
+compare() {
+    options=$1
+    input=$2
+    shift 2
+    "$knr" $options "$@" < "$input" > local.out
+    local_status=$?
+    "$knr" $options --server "$socket" "$@" < "$input" > server.out
+    server_status=$?
+    if [ $local_status -ne $server_status ] || ! cmp -s local.out server.out; then
+        echo "knr $options differs through the daemon"
+        status=1
+    fi
+}
+for options in "check" "detab" "detab -t 2,5,13" "entab" "entab -t 8"; do
+    compare "$options" /dev/null "$@"
+    compare "$options" "$1"
+done
+
+"$knr" detab -t 1,5000 --server "$socket" "$1" > server.out
+if [ $? -eq 0 ] || ! grep -q "Invalid tab stops" server.out; then
+    echo "Tab stops past the daemon's limit weren't turned down"
+    status=1
+fi
+rm -f local.out server.out
+exit $status
@@ -0,0 +1,6 @@
+#include "bits.h"
+
+// The out-of-line copies, for calls that don't get inlined
+extern inline int count_trailing_zeros(uint64_t source);
+extern inline int count_leading_zeros(uint64_t source);
+extern inline int count_set_bits(uint64_t source);
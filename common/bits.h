@@ -0,0 +1,33 @@
+#ifndef KNR_COMMON_BITS_H
+#define KNR_COMMON_BITS_H
+
+#include <stdint.h>
+
+// Bit scans for the bitmasks of the block scanners, defined here so that they get inlined into the scanning loops.
+// `count_trailing_zeros` and `count_leading_zeros` need a non-zero source.
+#if defined(__GNUC__)
+inline int count_trailing_zeros(uint64_t source) { return __builtin_ctzll(source); }
+inline int count_leading_zeros(uint64_t source) { return __builtin_clzll(source); }
+inline int count_set_bits(uint64_t source) { return __builtin_popcountll(source); }
+#else
+inline int count_trailing_zeros(uint64_t source)
+{
+    int result = 0;
+    while ((source & 1) == 0) { source >>= 1; result++; }
+    return result;
+}
+inline int count_leading_zeros(uint64_t source)
+{
+    int result = 0;
+    while ((source & ((uint64_t)1 << 63)) == 0) { source <<= 1; result++; }
+    return result;
+}
+inline int count_set_bits(uint64_t source)
+{
+    int result = 0;
+    for (; source != 0; source &= source - 1) { result++; }
+    return result;
+}
+#endif
+
+#endif
@@ -0,0 +1,81 @@
+#include "hash.h"
+
+#include <string.h>
+
+#define HASH_PRIME_1 0x9E3779B185EBCA87ULL
+#define HASH_PRIME_2 0xC2B2AE3D27D4EB4FULL
+#define HASH_PRIME_3 0x165667B19E3779F9ULL
+#define HASH_PRIME_4 0x85EBCA77C2B2AE63ULL
+#define HASH_PRIME_5 0x27D4EB2F165667C5ULL
+
+uint64_t rotate_hash_bits(uint64_t value, int count) { return (value << count) | (value >> (64 - count)); }
+
+uint64_t read_hash_word(char* data)
+{
+    uint64_t result;
+    memcpy(&result, data, sizeof(result));
+    return result;
+}
+
+uint32_t read_hash_half_word(char* data)
+{
+    uint32_t result;
+    memcpy(&result, data, sizeof(result));
+    return result;
+}
+
+uint64_t mix_hash_round(uint64_t accumulator, uint64_t word)
+{
+    accumulator += word * HASH_PRIME_2;
+    return rotate_hash_bits(accumulator, 31) * HASH_PRIME_1;
+}
+
+uint64_t merge_hash_round(uint64_t hash, uint64_t accumulator)
+{
+    hash ^= mix_hash_round(0, accumulator);
+    return hash * HASH_PRIME_1 + HASH_PRIME_4;
+}
+
+uint64_t hash_bytes(char* data, size_t size, uint64_t seed)
+{
+    char* end = data + size;
+    uint64_t result;
+    if (size >= 32)
+    { // four independent lanes of 8 bytes, so that the multiplications overlap
+        uint64_t accumulators[4] = {seed + HASH_PRIME_1 + HASH_PRIME_2, seed + HASH_PRIME_2, seed, seed - HASH_PRIME_1};
+        for (; end - data >= 32; data += 32)
+        {
+            for (int i = 0; i < 4; i++)
+            { accumulators[i] = mix_hash_round(accumulators[i], read_hash_word(data + 8 * i)); }
+        }
+        result = rotate_hash_bits(accumulators[0], 1) + rotate_hash_bits(accumulators[1], 7)
+            + rotate_hash_bits(accumulators[2], 12) + rotate_hash_bits(accumulators[3], 18);
+        for (int i = 0; i < 4; i++) { result = merge_hash_round(result, accumulators[i]); }
+    }
+    else { result = seed + HASH_PRIME_5; }
+    result += size;
+
+    for (; end - data >= 8; data += 8)
+    {
+        result ^= mix_hash_round(0, read_hash_word(data));
+        result = rotate_hash_bits(result, 27) * HASH_PRIME_1 + HASH_PRIME_4;
+    }
+    if (end - data >= 4)
+    {
+        result ^= read_hash_half_word(data) * HASH_PRIME_1;
+        result = rotate_hash_bits(result, 23) * HASH_PRIME_2 + HASH_PRIME_3;
+        data += 4;
+    }
+    for (; data < end; data++)
+    {
+        result ^= (unsigned char)*data * HASH_PRIME_5;
+        result = rotate_hash_bits(result, 11) * HASH_PRIME_1;
+    }
+
+    result ^= result >> 33;
+    result *= HASH_PRIME_2;
+    result ^= result >> 29;
+    result *= HASH_PRIME_3;
+    result ^= result >> 32;
+    return result;
+}
@@ -0,0 +1,11 @@
+#ifndef KNR_COMMON_HASH_H
+#define KNR_COMMON_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// XXH64 of the bytes, which hashes several gigabytes a second. The input is read as little-endian words, so the hashes
+// are only the reference ones on little-endian machines.
+uint64_t hash_bytes(char* data, size_t size, uint64_t seed);
+
+#endif
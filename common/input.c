@@ -0,0 +1,125 @@
+#include "input.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define KNR_INPUT_HAS_MMAP
+#endif
+
+#define INPUT_READ_BLOCK_SIZE (64 * 1024)
+
+#ifdef KNR_INPUT_HAS_MMAP
+
+InputView read_input_from_descriptor(int file_descriptor, char* display_name)
+{
+    InputView result;
+    result.is_mapped = false;
+    result.size = 0;
+    size_t capacity = INPUT_READ_BLOCK_SIZE;
+    result.data = malloc(capacity);
+    while (true)
+    {
+        if (result.size == capacity)
+        {
+            capacity *= 2;
+            result.data = realloc(result.data, capacity);
+        }
+        ssize_t bytes_read = read(file_descriptor, result.data + result.size, capacity - result.size);
+        if (bytes_read == 0) { break; }
+        if (bytes_read < 0) { printf("Failed to read from '%s'\n", display_name); exit(1); }
+        result.size += (size_t)bytes_read;
+    }
+    return result;
+}
+
+InputView open_input_view_from_descriptor(int file_descriptor, char* display_name)
+{
+    struct stat file_status;
+    if (fstat(file_descriptor, &file_status) != 0) { printf("Failed to stat '%s'\n", display_name); exit(1); }
+    if (!S_ISREG(file_status.st_mode)) { return read_input_from_descriptor(file_descriptor, display_name); }
+
+    InputView result;
+    result.size = (size_t)file_status.st_size;
+    if (result.size == 0)
+    { // mapping an empty file is an error, and there is nothing to map anyway
+        result.data = NULL;
+        result.is_mapped = false;
+        return result;
+    }
+    void* mapping = mmap(NULL, result.size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+    if (mapping == MAP_FAILED) { return read_input_from_descriptor(file_descriptor, display_name); }
+    posix_madvise(mapping, result.size, POSIX_MADV_SEQUENTIAL);
+    result.data = mapping;
+    result.is_mapped = true;
+    return result;
+}
+
+InputView open_input_view(char* file_path)
+{
+    int file_descriptor = open(file_path, O_RDONLY);
+    if (file_descriptor < 0) { printf("Failed to open file '%s'\n", file_path); exit(1); }
+    InputView result = open_input_view_from_descriptor(file_descriptor, file_path);
+    close(file_descriptor); // a mapping stays valid after its descriptor is closed
+    return result;
+}
+
+void close_input_view(InputView view)
+{
+    if (view.is_mapped) { munmap(view.data, view.size); }
+    else { free(view.data); }
+}
+
+#else
+
+InputView read_input_from_stream(FILE* file_handle, char* display_name)
+{
+    InputView result;
+    result.is_mapped = false;
+    result.size = 0;
+    size_t capacity = INPUT_READ_BLOCK_SIZE;
+    result.data = malloc(capacity);
+    while (true)
+    {
+        if (result.size == capacity)
+        {
+            capacity *= 2;
+            result.data = realloc(result.data, capacity);
+        }
+        size_t bytes_read = fread(result.data + result.size, 1, capacity - result.size, file_handle);
+        result.size += bytes_read;
+        if (bytes_read == 0)
+        {
+            if (ferror(file_handle)) { printf("Failed to read from '%s'\n", display_name); exit(1); }
+            break;
+        }
+    }
+    return result;
+}
+
+InputView open_input_view_from_descriptor(int file_descriptor, char* display_name)
+{
+    if (file_descriptor != 0)
+    {
+        printf("Reading '%s' from a descriptor is only supported for standard input on this platform\n", display_name);
+        exit(1);
+    }
+    return read_input_from_stream(stdin, display_name);
+}
+
+InputView open_input_view(char* file_path)
+{
+    FILE* file_handle = fopen(file_path, "rb");
+    if (file_handle == NULL) { printf("Failed to open file '%s'\n", file_path); exit(1); }
+    InputView result = read_input_from_stream(file_handle, file_path);
+    fclose(file_handle);
+    return result;
+}
+
+void close_input_view(InputView view) { free(view.data); }
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef KNR_COMMON_INPUT_H
+#define KNR_COMMON_INPUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Read-only view of a whole input. Regular files are memory mapped so that no heap copy is made, everything else (pipes,
+// terminals, character devices) is read into a heap buffer. `data` is not NUL-terminated.
+typedef struct
+{
+    char* data;
+    size_t size;
+    bool is_mapped;
+} InputView;
+
+InputView open_input_view(char* file_path);
+InputView open_input_view_from_descriptor(int file_descriptor, char* display_name);
+void close_input_view(InputView view);
+
+#endif
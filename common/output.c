@@ -0,0 +1,58 @@
+#include "output.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+OutputBuffer make_output_buffer(FILE* file_handle)
+{
+    OutputBuffer result;
+    result.file_handle = file_handle;
+    result.size = 0;
+    result.capacity = OUTPUT_BUFFER_CAPACITY;
+    result.data = malloc(result.capacity);
+    return result;
+}
+
+void flush_output(OutputBuffer* output)
+{
+    if (output->file_handle == NULL || output->size == 0) { return; }
+    if (fwrite(output->data, 1, output->size, output->file_handle) != output->size)
+    {
+        printf("Failed to write %zu bytes of output\n", output->size);
+        exit(1);
+    }
+    output->size = 0;
+}
+
+char* reserve_output(OutputBuffer* output, size_t size)
+{
+    if (output->capacity - output->size < size)
+    {
+        flush_output(output);
+        if (output->capacity - output->size < size)
+        {
+            while (output->capacity - output->size < size) { output->capacity *= 2; }
+            output->data = realloc(output->data, output->capacity);
+            if (output->data == NULL) { printf("Failed to allocate %zu bytes of output\n", output->capacity); exit(1); }
+        }
+    }
+    return output->data + output->size;
+}
+
+void write_output(OutputBuffer* output, char* data, size_t size)
+{
+    if (output->file_handle != NULL && size >= output->capacity)
+    { // too big to be worth copying, write it out directly after whatever is buffered
+        flush_output(output);
+        if (fwrite(data, 1, size, output->file_handle) != size)
+        {
+            printf("Failed to write %zu bytes of output\n", size);
+            exit(1);
+        }
+        return;
+    }
+    memcpy(reserve_output(output, size), data, size);
+    output->size += size;
+}
+
+void deallocate_output_buffer(OutputBuffer output) { free(output.data); }
@@ -0,0 +1,27 @@
+#ifndef KNR_COMMON_OUTPUT_H
+#define KNR_COMMON_OUTPUT_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#define OUTPUT_BUFFER_CAPACITY (1024 * 1024)
+
+// Output that is collected in one large reusable buffer and written out only when it fills up, so that producers can
+// emit any amount of data with a bounded amount of memory and few system calls. Without a file the buffer grows instead
+// and ends up holding the whole output.
+typedef struct
+{
+    FILE* file_handle;
+    char* data;
+    size_t size;
+    size_t capacity;
+} OutputBuffer;
+
+OutputBuffer make_output_buffer(FILE* file_handle);
+// Returns space for at least `size` more bytes at `data + size`. The caller writes there and then advances `size`.
+char* reserve_output(OutputBuffer* output, size_t size);
+void write_output(OutputBuffer* output, char* data, size_t size);
+void flush_output(OutputBuffer* output);
+void deallocate_output_buffer(OutputBuffer output);
+
+#endif
@@ -0,0 +1,400 @@
+#include "pipeline.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "strings.h"
+
+#ifdef PIPELINE_HAS_THREADS
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef PIPELINE_HAS_IO_URING
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+PipelineInput* get_pipeline_input(InputPipeline* pipeline, int input_i)
+{ return pipeline->inputs[input_i % pipeline->inputs_capacity]; }
+
+#ifdef PIPELINE_HAS_THREADS
+
+// Opens the file and allocates its buffer. Returns false if it isn't going to be read ahead.
+bool open_pipeline_input(PipelineInput* input)
+{
+    int file_descriptor = open(input->path, O_RDONLY);
+    if (file_descriptor < 0) { return false; }
+    struct stat file_status;
+    bool is_regular_file = fstat(file_descriptor, &file_status) == 0 && S_ISREG(file_status.st_mode);
+    if (!is_regular_file || file_status.st_size == 0 || (size_t)file_status.st_size > PIPELINE_MAX_READ_SIZE)
+    { // large files get mapped when they are taken, but the kernel can start reading them already
+        if (is_regular_file) { posix_fadvise(file_descriptor, 0, 0, POSIX_FADV_WILLNEED); }
+        close(file_descriptor);
+        return false;
+    }
+    input->file_descriptor = file_descriptor;
+    input->size = (size_t)file_status.st_size;
+    input->data = malloc(input->size);
+    input->read_size = 0;
+    return true;
+}
+
+PipelineInputStatus close_pipeline_input(PipelineInput* input, bool has_read)
+{
+    close(input->file_descriptor);
+    if (has_read) { return PipelineInputStatusRead; }
+    free(input->data);
+    input->data = NULL;
+    return PipelineInputStatusDeferred;
+}
+
+// Reads the rest of an open input. A file that got shorter in the meantime ends where it ends now.
+PipelineInputStatus read_pipeline_input_rest(PipelineInput* input)
+{
+    while (input->read_size < input->size)
+    {
+        ssize_t bytes_read = pread(
+            input->file_descriptor,
+            input->data + input->read_size,
+            input->size - input->read_size,
+            (off_t)input->read_size
+        );
+        if (bytes_read < 0 && errno == EINTR) { continue; }
+        if (bytes_read < 0) { return close_pipeline_input(input, false); }
+        if (bytes_read == 0) { input->size = input->read_size; }
+        input->read_size += (size_t)bytes_read;
+    }
+    return close_pipeline_input(input, true);
+}
+
+PipelineInputStatus read_pipeline_input(PipelineInput* input)
+{ return open_pipeline_input(input) ? read_pipeline_input_rest(input) : PipelineInputStatusDeferred; }
+
+void* run_pipeline_prefetch_thread(void* pipeline_pointer)
+{
+    InputPipeline* pipeline = pipeline_pointer;
+    pthread_mutex_lock(&pipeline->lock);
+    while (true)
+    {
+        // no more than `depth` files are held in memory before they are taken
+        while (
+            !pipeline->is_closing
+                && (pipeline->read_i == pipeline->end_i || pipeline->read_i - pipeline->take_i >= pipeline->depth)
+        )
+        { pthread_cond_wait(&pipeline->has_work, &pipeline->lock); }
+        if (pipeline->is_closing) { break; }
+        PipelineInput* input = get_pipeline_input(pipeline, pipeline->read_i);
+        input->status = PipelineInputStatusReading;
+        pipeline->read_i++;
+        pthread_mutex_unlock(&pipeline->lock);
+        PipelineInputStatus status = read_pipeline_input(input);
+        pthread_mutex_lock(&pipeline->lock);
+        input->status = status;
+        pthread_cond_signal(&pipeline->has_input);
+    }
+    pthread_mutex_unlock(&pipeline->lock);
+    return NULL;
+}
+
+#endif
+
+#ifdef PIPELINE_HAS_IO_URING
+
+// The rings are shared with the kernel: we own the submission tail and the completion head, the kernel the others
+bool set_up_io_uring(IoUring* ring, int depth)
+{
+    struct io_uring_params parameters;
+    memset(&parameters, 0, sizeof(parameters));
+    ring->file_descriptor = (int)syscall(__NR_io_uring_setup, (unsigned)depth, &parameters);
+    if (ring->file_descriptor < 0) { return false; }
+
+    ring->submission_ring_size = parameters.sq_off.array + parameters.sq_entries * sizeof(unsigned);
+    ring->completion_ring_size = parameters.cq_off.cqes + parameters.cq_entries * sizeof(struct io_uring_cqe);
+    bool is_single_mapping = (parameters.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (is_single_mapping)
+    {
+        if (ring->completion_ring_size > ring->submission_ring_size)
+        { ring->submission_ring_size = ring->completion_ring_size; }
+        ring->completion_ring_size = ring->submission_ring_size;
+    }
+    ring->submission_entries_size = parameters.sq_entries * sizeof(struct io_uring_sqe);
+    int protection = PROT_READ | PROT_WRITE;
+    int flags = MAP_SHARED | MAP_POPULATE;
+    ring->submission_ring = mmap(
+        NULL, ring->submission_ring_size, protection, flags, ring->file_descriptor, IORING_OFF_SQ_RING
+    );
+    ring->completion_ring = is_single_mapping || ring->submission_ring == MAP_FAILED
+        ? ring->submission_ring
+        : mmap(NULL, ring->completion_ring_size, protection, flags, ring->file_descriptor, IORING_OFF_CQ_RING);
+    void* submission_entries = mmap(
+        NULL, ring->submission_entries_size, protection, flags, ring->file_descriptor, IORING_OFF_SQES
+    );
+    if (ring->submission_ring == MAP_FAILED || ring->completion_ring == MAP_FAILED || submission_entries == MAP_FAILED)
+    {
+        if (submission_entries != MAP_FAILED) { munmap(submission_entries, ring->submission_entries_size); }
+        if (ring->completion_ring != MAP_FAILED && ring->completion_ring != ring->submission_ring)
+        { munmap(ring->completion_ring, ring->completion_ring_size); }
+        if (ring->submission_ring != MAP_FAILED) { munmap(ring->submission_ring, ring->submission_ring_size); }
+        close(ring->file_descriptor);
+        return false;
+    }
+
+    char* submission_ring = ring->submission_ring;
+    ring->submission_head = (unsigned*)(submission_ring + parameters.sq_off.head);
+    ring->submission_tail = (unsigned*)(submission_ring + parameters.sq_off.tail);
+    ring->submission_mask = *(unsigned*)(submission_ring + parameters.sq_off.ring_mask);
+    ring->submission_array = (unsigned*)(submission_ring + parameters.sq_off.array);
+    ring->submission_entries = submission_entries;
+    char* completion_ring = ring->completion_ring;
+    ring->completion_head = (unsigned*)(completion_ring + parameters.cq_off.head);
+    ring->completion_tail = (unsigned*)(completion_ring + parameters.cq_off.tail);
+    ring->completion_mask = *(unsigned*)(completion_ring + parameters.cq_off.ring_mask);
+    ring->completion_entries = (struct io_uring_cqe*)(completion_ring + parameters.cq_off.cqes);
+    return true;
+}
+
+void tear_down_io_uring(IoUring* ring)
+{
+    munmap(ring->submission_entries, ring->submission_entries_size);
+    if (ring->completion_ring != ring->submission_ring) { munmap(ring->completion_ring, ring->completion_ring_size); }
+    munmap(ring->submission_ring, ring->submission_ring_size);
+    close(ring->file_descriptor);
+}
+
+// Submits a read of the rest of the input. If the kernel doesn't take it, the input is read right away instead.
+void submit_pipeline_read(InputPipeline* pipeline, PipelineInput* input)
+{
+    IoUring* ring = &pipeline->io_uring;
+    unsigned tail = *ring->submission_tail;
+    unsigned entry_i = tail & ring->submission_mask;
+    struct io_uring_sqe* entry = &ring->submission_entries[entry_i];
+    memset(entry, 0, sizeof(*entry));
+    entry->opcode = IORING_OP_READ;
+    entry->fd = input->file_descriptor;
+    entry->addr = (uint64_t)(uintptr_t)(input->data + input->read_size);
+    entry->len = (unsigned)(input->size - input->read_size);
+    entry->off = input->read_size;
+    entry->user_data = (uint64_t)(uintptr_t)input;
+    ring->submission_array[entry_i] = entry_i;
+    __atomic_store_n(ring->submission_tail, tail + 1, __ATOMIC_RELEASE);
+    long submitted_count;
+    do { submitted_count = syscall(__NR_io_uring_enter, ring->file_descriptor, 1, 0, 0, NULL, 0); }
+    while (submitted_count < 0 && errno == EINTR);
+    if (submitted_count != 1 && __atomic_load_n(ring->submission_head, __ATOMIC_ACQUIRE) == tail)
+    {
+        __atomic_store_n(ring->submission_tail, tail, __ATOMIC_RELEASE);
+        input->status = read_pipeline_input_rest(input);
+    }
+}
+
+// Waits for the next read to complete, which can be that of any input in flight
+void complete_pipeline_read(InputPipeline* pipeline)
+{
+    IoUring* ring = &pipeline->io_uring;
+    unsigned head = *ring->completion_head;
+    while (head == __atomic_load_n(ring->completion_tail, __ATOMIC_ACQUIRE))
+    {
+        long result = syscall(__NR_io_uring_enter, ring->file_descriptor, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (result < 0 && errno != EINTR) { printf("Failed to wait for reads to complete\n"); exit(1); }
+    }
+    struct io_uring_cqe* completion = &ring->completion_entries[head & ring->completion_mask];
+    PipelineInput* input = (PipelineInput*)(uintptr_t)completion->user_data;
+    int read_result = completion->res;
+    __atomic_store_n(ring->completion_head, head + 1, __ATOMIC_RELEASE);
+
+    // kernels without IORING_OP_READ fail it, which defers the input like any failed read
+    if (read_result < 0) { input->status = close_pipeline_input(input, false); }
+    else if (read_result == 0)
+    {
+        input->size = input->read_size;
+        input->status = close_pipeline_input(input, true);
+    }
+    else
+    {
+        input->read_size += (size_t)read_result;
+        if (input->read_size < input->size) { submit_pipeline_read(pipeline, input); }
+        else { input->status = close_pipeline_input(input, true); }
+    }
+}
+
+void start_pipeline_reads(InputPipeline* pipeline)
+{
+    while (pipeline->read_i < pipeline->end_i && pipeline->read_i - pipeline->take_i < pipeline->depth)
+    {
+        PipelineInput* input = get_pipeline_input(pipeline, pipeline->read_i);
+        pipeline->read_i++;
+        if (!open_pipeline_input(input)) { input->status = PipelineInputStatusDeferred; }
+        else
+        {
+            input->status = PipelineInputStatusReading;
+            submit_pipeline_read(pipeline, input);
+        }
+    }
+}
+
+#endif
+
+InputPipeline* make_input_pipeline_with_backend(int depth, InputPipelineBackend backend)
+{
+    InputPipeline* result = malloc(sizeof(InputPipeline));
+    result->depth = depth < 1 ? 1 : depth;
+    result->inputs_capacity = 64;
+    result->inputs = malloc(sizeof(PipelineInput*) * result->inputs_capacity);
+    result->take_i = 0;
+    result->read_i = 0;
+    result->end_i = 0;
+#ifdef PIPELINE_HAS_IO_URING
+    if (backend == InputPipelineBackendIoUring && !set_up_io_uring(&result->io_uring, result->depth))
+    { backend = InputPipelineBackendThread; }
+#else
+    if (backend == InputPipelineBackendIoUring) { backend = InputPipelineBackendThread; }
+#endif
+#ifdef PIPELINE_HAS_THREADS
+    pthread_mutex_init(&result->lock, NULL);
+    pthread_cond_init(&result->has_work, NULL);
+    pthread_cond_init(&result->has_input, NULL);
+    result->is_closing = false;
+    if (
+        backend == InputPipelineBackendThread
+            && pthread_create(&result->prefetch_thread, NULL, run_pipeline_prefetch_thread, result) != 0
+    )
+    { backend = InputPipelineBackendSynchronous; }
+#else
+    if (backend == InputPipelineBackendThread) { backend = InputPipelineBackendSynchronous; }
+#endif
+    result->backend = backend;
+    return result;
+}
+
+InputPipeline* make_input_pipeline(int depth)
+{ return make_input_pipeline_with_backend(depth, InputPipelineBackendIoUring); }
+
+void lock_input_pipeline(InputPipeline* pipeline)
+{
+#ifdef PIPELINE_HAS_THREADS
+    if (pipeline->backend == InputPipelineBackendThread) { pthread_mutex_lock(&pipeline->lock); }
+#else
+    (void)pipeline;
+#endif
+}
+
+void unlock_input_pipeline(InputPipeline* pipeline)
+{
+#ifdef PIPELINE_HAS_THREADS
+    if (pipeline->backend == InputPipelineBackendThread) { pthread_mutex_unlock(&pipeline->lock); }
+#else
+    (void)pipeline;
+#endif
+}
+
+void queue_pipeline_input(InputPipeline* pipeline, char* path)
+{
+    PipelineInput* input = malloc(sizeof(PipelineInput));
+    input->path = copy_string(path);
+    input->status = PipelineInputStatusQueued;
+    input->data = NULL;
+
+    lock_input_pipeline(pipeline);
+    if (pipeline->end_i - pipeline->take_i == pipeline->inputs_capacity)
+    {
+        int capacity = pipeline->inputs_capacity * 2;
+        PipelineInput** inputs = malloc(sizeof(PipelineInput*) * capacity);
+        for (int i = pipeline->take_i; i < pipeline->end_i; i++)
+        { inputs[i % capacity] = get_pipeline_input(pipeline, i); }
+        free(pipeline->inputs);
+        pipeline->inputs = inputs;
+        pipeline->inputs_capacity = capacity;
+    }
+    pipeline->inputs[pipeline->end_i % pipeline->inputs_capacity] = input;
+    pipeline->end_i++;
+#ifdef PIPELINE_HAS_THREADS
+    if (pipeline->backend == InputPipelineBackendThread) { pthread_cond_signal(&pipeline->has_work); }
+#endif
+    unlock_input_pipeline(pipeline);
+#ifdef PIPELINE_HAS_IO_URING
+    if (pipeline->backend == InputPipelineBackendIoUring) { start_pipeline_reads(pipeline); }
+#endif
+}
+
+InputView take_pipeline_input(InputPipeline* pipeline)
+{
+    if (pipeline->take_i == pipeline->end_i) { printf("Took more inputs from a pipeline than were queued\n"); exit(1); }
+    lock_input_pipeline(pipeline);
+    PipelineInput* input = get_pipeline_input(pipeline, pipeline->take_i);
+#ifdef PIPELINE_HAS_IO_URING
+    if (pipeline->backend == InputPipelineBackendIoUring)
+    {
+        while (input->status == PipelineInputStatusReading) { complete_pipeline_read(pipeline); }
+    }
+#endif
+#ifdef PIPELINE_HAS_THREADS
+    if (pipeline->backend == InputPipelineBackendThread)
+    {
+        while (input->status == PipelineInputStatusQueued || input->status == PipelineInputStatusReading)
+        { pthread_cond_wait(&pipeline->has_input, &pipeline->lock); }
+    }
+#endif
+    pipeline->take_i++;
+    if (pipeline->read_i < pipeline->take_i) { pipeline->read_i = pipeline->take_i; } // the synchronous backend
+#ifdef PIPELINE_HAS_THREADS
+    if (pipeline->backend == InputPipelineBackendThread) { pthread_cond_signal(&pipeline->has_work); }
+#endif
+    unlock_input_pipeline(pipeline);
+#ifdef PIPELINE_HAS_IO_URING
+    if (pipeline->backend == InputPipelineBackendIoUring) { start_pipeline_reads(pipeline); }
+#endif
+
+    InputView result;
+    if (input->status == PipelineInputStatusRead)
+    {
+        result.data = input->data;
+        result.size = input->size;
+        result.is_mapped = false;
+    }
+    else { result = open_input_view(input->path); }
+    free(input->path);
+    free(input);
+    return result;
+}
+
+void deallocate_input_pipeline(InputPipeline* pipeline)
+{
+#ifdef PIPELINE_HAS_IO_URING
+    if (pipeline->backend == InputPipelineBackendIoUring)
+    { // the kernel writes into the buffers of the reads in flight until they complete
+        for (int i = pipeline->take_i; i < pipeline->read_i; i++)
+        {
+            while (get_pipeline_input(pipeline, i)->status == PipelineInputStatusReading)
+            { complete_pipeline_read(pipeline); }
+        }
+        tear_down_io_uring(&pipeline->io_uring);
+    }
+#endif
+#ifdef PIPELINE_HAS_THREADS
+    if (pipeline->backend == InputPipelineBackendThread)
+    {
+        pthread_mutex_lock(&pipeline->lock);
+        pipeline->is_closing = true;
+        pthread_cond_signal(&pipeline->has_work);
+        pthread_mutex_unlock(&pipeline->lock);
+        pthread_join(pipeline->prefetch_thread, NULL);
+    }
+    pthread_cond_destroy(&pipeline->has_input);
+    pthread_cond_destroy(&pipeline->has_work);
+    pthread_mutex_destroy(&pipeline->lock);
+#endif
+    for (int i = pipeline->take_i; i < pipeline->end_i; i++)
+    {
+        PipelineInput* input = get_pipeline_input(pipeline, i);
+        free(input->data);
+        free(input->path);
+        free(input);
+    }
+    free(pipeline->inputs);
+    free(pipeline);
+}
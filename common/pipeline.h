@@ -0,0 +1,109 @@
+#ifndef KNR_COMMON_PIPELINE_H
+#define KNR_COMMON_PIPELINE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "input.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define PIPELINE_HAS_THREADS
+#include <pthread.h>
+#endif
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define PIPELINE_HAS_IO_URING
+#include <linux/io_uring.h>
+#endif
+#endif
+
+// Reads files ahead while the ones before them are being processed. Files are queued in the order in which they are
+// taken, up to `depth` of them are read into memory in the background, and taking a file only waits for its own read.
+// The reads go through io_uring where the kernel has it and through a prefetch thread otherwise. Files that aren't read
+// ahead (anything but regular files, and ones larger than `PIPELINE_MAX_READ_SIZE`, which are mapped instead) and files
+// whose read fails are opened with `open_input_view` when they are taken, so errors are reported then and in order.
+#define DEFAULT_READ_AHEAD_DEPTH 8
+#define PIPELINE_MAX_READ_SIZE (16 * 1024 * 1024)
+
+typedef enum
+{
+    InputPipelineBackendIoUring,
+    InputPipelineBackendThread,
+    InputPipelineBackendSynchronous, // nothing is read ahead
+} InputPipelineBackend;
+
+typedef enum
+{
+    PipelineInputStatusQueued,
+    PipelineInputStatusReading,
+    PipelineInputStatusRead,
+    PipelineInputStatusDeferred, // left to `open_input_view`
+} PipelineInputStatus;
+
+typedef struct
+{
+    char* path;
+    PipelineInputStatus status;
+    int file_descriptor; // while it's being read
+    char* data;
+    size_t size;
+    size_t read_size;
+} PipelineInput;
+
+#ifdef PIPELINE_HAS_IO_URING
+typedef struct
+{
+    int file_descriptor;
+    unsigned* submission_head;
+    unsigned* submission_tail;
+    unsigned submission_mask;
+    unsigned* submission_array;
+    struct io_uring_sqe* submission_entries;
+    unsigned* completion_head;
+    unsigned* completion_tail;
+    unsigned completion_mask;
+    struct io_uring_cqe* completion_entries;
+    void* submission_ring;
+    size_t submission_ring_size;
+    void* completion_ring; // the same mapping as the submission ring on kernels that map them together
+    size_t completion_ring_size;
+    size_t submission_entries_size;
+} IoUring;
+#endif
+
+// Allocated, because the prefetch thread keeps a pointer to it
+typedef struct
+{
+    InputPipelineBackend backend;
+    int depth;
+    // A ring of the inputs that haven't been taken yet. Inputs are numbered in the order they were queued: those from
+    // `take_i` to `read_i` have been started, the rest up to `end_i` are waiting for their turn.
+    PipelineInput** inputs;
+    int inputs_capacity;
+    int take_i;
+    int read_i;
+    int end_i;
+#ifdef PIPELINE_HAS_IO_URING
+    IoUring io_uring;
+#endif
+#ifdef PIPELINE_HAS_THREADS
+    pthread_t prefetch_thread;
+    pthread_mutex_t lock; // thread backend only, guards the indices and the statuses
+    pthread_cond_t has_work;
+    pthread_cond_t has_input;
+    bool is_closing;
+#endif
+} InputPipeline;
+
+// Uses the best backend there is
+InputPipeline* make_input_pipeline(int depth);
+// Falls back to the next backend if the given one isn't available
+InputPipeline* make_input_pipeline_with_backend(int depth, InputPipelineBackend backend);
+void queue_pipeline_input(InputPipeline* pipeline, char* path);
+// The next queued file, which is the caller's to close
+InputView take_pipeline_input(InputPipeline* pipeline);
+// Drops the files that haven't been taken
+void deallocate_input_pipeline(InputPipeline* pipeline);
+
+#endif
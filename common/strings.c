@@ -0,0 +1,12 @@
+#include "strings.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+char* copy_string(char* source)
+{
+    int source_size = strlen(source);
+    char* result = malloc(source_size + 1);
+    memcpy(result, source, source_size + 1);
+    return result;
+}
@@ -0,0 +1,6 @@
+#ifndef KNR_COMMON_STRINGS_H
+#define KNR_COMMON_STRINGS_H
+
+char* copy_string(char* source);
+
+#endif
@@ -0,0 +1,29 @@
+#include "system.h"
+
+#include <time.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#define KNR_SYSTEM_IS_POSIX
+#endif
+
+int get_processor_count()
+{
+#ifdef KNR_SYSTEM_IS_POSIX
+    long processor_count = sysconf(_SC_NPROCESSORS_ONLN);
+    return processor_count < 1 ? 1 : (int)processor_count;
+#else
+    return 1;
+#endif
+}
+
+double get_seconds()
+{
+#ifdef KNR_SYSTEM_IS_POSIX
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+#else
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
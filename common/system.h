@@ -0,0 +1,9 @@
+#ifndef KNR_COMMON_SYSTEM_H
+#define KNR_COMMON_SYSTEM_H
+
+// The number of processors that are online, 1 where that can't be found out
+int get_processor_count();
+// Seconds from some fixed point in the past, for measuring durations
+double get_seconds();
+
+#endif
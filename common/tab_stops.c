@@ -0,0 +1,112 @@
+#include "tab_stops.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+TabStops make_uniform_tab_stops(int width)
+{
+    if (width < 1) { printf("Tab width has to be positive, got %d\n", width); exit(1); }
+    TabStops result;
+    result.type = (width & (width - 1)) == 0 ? TabStopsTypePowerOfTwo : TabStopsTypeUniform;
+    result.width = width;
+    result.width_shift = 0;
+    while ((1 << result.width_shift) < width) { result.width_shift++; }
+    result.next_stops = NULL;
+    result.last_stop = 0;
+    result.max_distance = width;
+    return result;
+}
+
+TabStops make_listed_tab_stops(int* stops, int stop_count)
+{
+    if (stop_count == 1) { return make_uniform_tab_stops(stops[0]); }
+    TabStops result;
+    result.type = TabStopsTypeList;
+    result.width = 0;
+    result.width_shift = 0;
+    result.last_stop = (size_t)stops[stop_count - 1];
+    result.next_stops = malloc(sizeof(int) * (result.last_stop + 1));
+    result.max_distance = 1;
+    int column = 0;
+    for (int i = 0; i < stop_count; i++)
+    {
+        if (stops[i] <= column)
+        {
+            printf("Tab stops have to be positive and increasing, got %d after %d\n", stops[i], column);
+            exit(1);
+        }
+        if (stops[i] - column > result.max_distance) { result.max_distance = stops[i] - column; }
+        for (; column < stops[i]; column++) { result.next_stops[column] = stops[i]; }
+    }
+    return result;
+}
+
+TabStops parse_tab_stops(char* text)
+{
+    int stops_capacity = 8;
+    int* stops = malloc(sizeof(int) * stops_capacity);
+    int stop_count = 0;
+    char* text_i = text;
+    while (true)
+    {
+        if (*text_i < '0' || *text_i > '9') { printf("Invalid tab stops '%s'\n", text); exit(1); }
+        int stop = 0;
+        for (; *text_i >= '0' && *text_i <= '9'; text_i++)
+        {
+            stop = stop * 10 + (*text_i - '0');
+            if (stop > MAX_TAB_STOP)
+            {
+                printf("Tab stop too large in '%s', the most is %d\n", text, MAX_TAB_STOP);
+                exit(1);
+            }
+        }
+        if (stop_count == stops_capacity)
+        {
+            stops_capacity *= 2;
+            stops = realloc(stops, sizeof(int) * stops_capacity);
+        }
+        stops[stop_count++] = stop;
+        if (*text_i == '\0') { break; }
+        if (*text_i != ',') { printf("Invalid tab stops '%s'\n", text); exit(1); }
+        text_i++;
+    }
+    TabStops result = make_listed_tab_stops(stops, stop_count);
+    free(stops);
+    return result;
+}
+
+bool are_tab_stops_valid(char* text, int max_stop)
+{
+    if (max_stop > MAX_TAB_STOP) { max_stop = MAX_TAB_STOP; }
+    int previous_stop = 0;
+    char* text_i = text;
+    while (true)
+    {
+        if (*text_i < '0' || *text_i > '9') { return false; }
+        int stop = 0;
+        for (; *text_i >= '0' && *text_i <= '9'; text_i++)
+        {
+            stop = stop * 10 + (*text_i - '0');
+            if (stop > max_stop) { return false; }
+        }
+        if (stop <= previous_stop) { return false; }
+        previous_stop = stop;
+        if (*text_i == '\0') { return true; }
+        if (*text_i != ',') { return false; }
+        text_i++;
+    }
+}
+
+size_t get_next_tab_stop(TabStops* tab_stops, size_t column)
+{
+    switch (tab_stops->type)
+    {
+        case TabStopsTypePowerOfTwo: return NEXT_TAB_STOP(TabStopsTypePowerOfTwo, tab_stops, column);
+        case TabStopsTypeUniform: return NEXT_TAB_STOP(TabStopsTypeUniform, tab_stops, column);
+        case TabStopsTypeList: return NEXT_TAB_STOP(TabStopsTypeList, tab_stops, column);
+    }
+    return column + 1;
+}
+
+void deallocate_tab_stops(TabStops tab_stops) { free(tab_stops.next_stops); }
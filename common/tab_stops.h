@@ -0,0 +1,59 @@
+#ifndef KNR_COMMON_TAB_STOPS_H
+#define KNR_COMMON_TAB_STOPS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define DEFAULT_TAB_SIZE 4
+// The largest stop that parsing accepts. Listed stops take memory for every column up to the last one, and buffers are
+// reserved for the widest tab, so much larger ones would cost gigabytes.
+#define MAX_TAB_STOP (64 * 1024)
+
+// Tab stops are either every `width` columns or an explicit list of columns, like `expand -t 4,8,12`. Past the last
+// listed stop a tab spans a single column, as it does for expand. Columns are 0-based.
+typedef enum
+{
+    TabStopsTypePowerOfTwo,
+    TabStopsTypeUniform,
+    TabStopsTypeList,
+} TabStopsType;
+
+typedef struct
+{
+    TabStopsType type;
+    int width; // uniform tab stops only
+    int width_shift; // power-of-two tab stops only, log2 of the width
+    int* next_stops; // list tab stops only, the next stop after each column before the last one
+    size_t last_stop;
+    int max_distance; // the most columns that a single tab can span
+} TabStops;
+
+TabStops make_uniform_tab_stops(int width);
+// The stops have to be positive and increasing
+TabStops make_listed_tab_stops(int* stops, int stop_count);
+// Accepts expand's `-t` syntax: a single width or a comma-separated list of stops, none past `MAX_TAB_STOP`
+TabStops parse_tab_stops(char* text);
+// Whether `parse_tab_stops` accepts the text and it has no stop past `max_stop`, for text that doesn't come from the
+// user, where it can't just exit
+bool are_tab_stops_valid(char* text, int max_stop);
+size_t get_next_tab_stop(TabStops* tab_stops, size_t column);
+void deallocate_tab_stops(TabStops tab_stops);
+
+// The same as `get_next_tab_stop`, but with the type given separately: code that uses this with a constant type gets
+// compiled without the cases of the other types. `column` is evaluated more than once, the result is a `size_t`.
+#define NEXT_TAB_STOP(type, tab_stops, column)                                                                      \
+    ((type) == TabStopsTypePowerOfTwo                                                                               \
+        ? (((size_t)(column) >> (tab_stops)->width_shift) + 1) << (tab_stops)->width_shift                          \
+        : (type) == TabStopsTypeUniform ? ((size_t)(column) / (size_t)(tab_stops)->width + 1) * (tab_stops)->width  \
+        : (size_t)(column) < (tab_stops)->last_stop ? (size_t)(tab_stops)->next_stops[column]                       \
+        : (size_t)(column) + 1)
+
+// For functions that get a specialized copy for each type of tab stops by being called with constant types. They have to
+// be inlined for that to happen.
+#if defined(__GNUC__)
+#define TAB_STOPS_SPECIALIZED __attribute__((always_inline)) inline
+#else
+#define TAB_STOPS_SPECIALIZED
+#endif
+
+#endif
@@ -0,0 +1,37 @@
+#include "testing.h"
+
+#include <stdlib.h>
+
+#include "utf8.h"
+
+uint64_t get_random_number(uint64_t* random_state)
+{
+    *random_state ^= *random_state << 13;
+    *random_state ^= *random_state >> 7;
+    *random_state ^= *random_state << 17;
+    return *random_state;
+}
+
+char* expand_tabs(char* input, size_t input_size, TabStops* tab_stops, size_t* result_size)
+{
+    char* result = malloc(input_size * tab_stops->max_distance + 1);
+    *result_size = 0;
+    size_t column = 0;
+    Utf8Decoder utf8_decoder = make_utf8_decoder();
+    for (size_t i = 0; i < input_size; i++)
+    {
+        if (input[i] == '\t')
+        {
+            size_t next_stop = get_next_tab_stop(tab_stops, column);
+            for (; column < next_stop; column++) { result[(*result_size)++] = ' '; }
+            utf8_decoder = make_utf8_decoder();
+        }
+        else
+        {
+            result[(*result_size)++] = input[i];
+            int width = advance_utf8_decoder(&utf8_decoder, (unsigned char)input[i]);
+            column = input[i] == '\n' ? 0 : column + width;
+        }
+    }
+    return result;
+}
@@ -0,0 +1,17 @@
+#ifndef KNR_COMMON_TESTING_H
+#define KNR_COMMON_TESTING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tab_stops.h"
+
+// Helpers shared by the test runners, the fuzzers and the benchmarks, so that their copies can't drift apart
+
+// xorshift64, so that the same state gives the same numbers on every run. The state can't be zero.
+uint64_t get_random_number(uint64_t* random_state);
+// Replaces tabs by blanks the plain way, a byte at a time with columns counted by display width, as a reference for
+// the optimized engines
+char* expand_tabs(char* input, size_t input_size, TabStops* tab_stops, size_t* result_size);
+
+#endif
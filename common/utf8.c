@@ -0,0 +1,130 @@
+#include "utf8.h"
+
+// The out-of-line copies, for calls that don't get inlined
+extern inline int advance_utf8_decoder(Utf8Decoder* decoder, unsigned char byte);
+extern inline bool is_ascii_block(char* block);
+
+typedef struct
+{
+    uint32_t first;
+    uint32_t last;
+    int width;
+} CodePointRange;
+
+// The combining marks and the main blocks of wide characters, sorted. Everything else is a column wide, so this is
+// close to what terminals show without carrying the full Unicode tables.
+CodePointRange code_point_widths[] = {
+    {0x0300, 0x036F, 0},
+    {0x0483, 0x0489, 0},
+    {0x0591, 0x05BD, 0},
+    {0x0610, 0x061A, 0},
+    {0x064B, 0x065F, 0},
+    {0x1100, 0x115F, 2},
+    {0x1AB0, 0x1AFF, 0},
+    {0x1DC0, 0x1DFF, 0},
+    {0x200B, 0x200F, 0},
+    {0x20D0, 0x20FF, 0},
+    {0x2E80, 0x303E, 2},
+    {0x3041, 0x33FF, 2},
+    {0x3400, 0x4DBF, 2},
+    {0x4E00, 0x9FFF, 2},
+    {0xA000, 0xA4CF, 2},
+    {0xA960, 0xA97F, 2},
+    {0xAC00, 0xD7A3, 2},
+    {0xF900, 0xFAFF, 2},
+    {0xFE00, 0xFE0F, 0},
+    {0xFE10, 0xFE19, 2},
+    {0xFE20, 0xFE2F, 0},
+    {0xFE30, 0xFE6F, 2},
+    {0xFF00, 0xFF60, 2},
+    {0xFFE0, 0xFFE6, 2},
+    {0x1F300, 0x1F64F, 2},
+    {0x1F680, 0x1F6FF, 2},
+    {0x1F900, 0x1F9FF, 2},
+    {0x20000, 0x2FFFD, 2},
+    {0x30000, 0x3FFFD, 2},
+};
+
+Utf8Decoder make_utf8_decoder()
+{
+    Utf8Decoder result;
+    result.code_point = 0;
+    result.remaining_size = 0;
+    return result;
+}
+
+// A sequence is at most 4 bytes long, so only the last 3 bytes before the text can be part of one that isn't complete
+Utf8Decoder make_utf8_decoder_before(char* text, size_t readable_before_size)
+{
+    Utf8Decoder result = make_utf8_decoder();
+    size_t lookback_size = readable_before_size < 3 ? readable_before_size : 3;
+    for (size_t i = lookback_size; i > 0; i--) { advance_utf8_decoder(&result, (unsigned char)text[-(ptrdiff_t)i]); }
+    return result;
+}
+
+bool are_utf8_decoders_equal(Utf8Decoder left, Utf8Decoder right)
+{
+    return left.remaining_size == right.remaining_size
+        && (left.remaining_size == 0 || left.code_point == right.code_point);
+}
+
+DisplayColumn make_display_column(size_t column)
+{
+    DisplayColumn result;
+    result.column = column;
+    result.utf8_decoder = make_utf8_decoder();
+    return result;
+}
+
+int get_code_point_width(uint32_t code_point)
+{
+    if (code_point < code_point_widths[0].first) { return 1; }
+    int low = 0;
+    int high = sizeof(code_point_widths) / sizeof(code_point_widths[0]) - 1;
+    while (low <= high)
+    {
+        int middle = (low + high) / 2;
+        if (code_point < code_point_widths[middle].first) { high = middle - 1; }
+        else if (code_point > code_point_widths[middle].last) { low = middle + 1; }
+        else { return code_point_widths[middle].width; }
+    }
+    return 1;
+}
+
+int advance_utf8_decoder_over_non_ascii(Utf8Decoder* decoder, unsigned char byte)
+{
+    if (byte < 0xC0)
+    { // a continuation byte
+        if (decoder->remaining_size == 0) { return 1; }
+        decoder->code_point = decoder->code_point << 6 | (byte & 0x3F);
+        decoder->remaining_size--;
+        return decoder->remaining_size == 0 ? get_code_point_width(decoder->code_point) - 1 : 0;
+    }
+    if (byte >= 0xC2 && byte <= 0xF4)
+    { // a lead byte, 0xC0 and 0xC1 would only start overlong sequences and the ones above 0xF4 code points past Unicode
+        decoder->remaining_size = byte < 0xE0 ? 1 : byte < 0xF0 ? 2 : 3;
+        decoder->code_point = byte & (0x3F >> decoder->remaining_size);
+        return 1;
+    }
+    decoder->remaining_size = 0;
+    return 1;
+}
+
+ptrdiff_t get_display_width(Utf8Decoder* decoder, char* text, size_t size)
+{
+    ptrdiff_t result = 0;
+    size_t i = 0;
+    while (i < size)
+    {
+        if (i + UTF8_ASCII_BLOCK_SIZE <= size && is_ascii_block(text + i))
+        {
+            decoder->remaining_size = 0;
+            result += UTF8_ASCII_BLOCK_SIZE;
+            i += UTF8_ASCII_BLOCK_SIZE;
+            continue;
+        }
+        size_t block_end = i + UTF8_ASCII_BLOCK_SIZE < size ? i + UTF8_ASCII_BLOCK_SIZE : size;
+        for (; i < block_end; i++) { result += advance_utf8_decoder(decoder, (unsigned char)text[i]); }
+    }
+    return result;
+}
@@ -0,0 +1,79 @@
+#ifndef KNR_COMMON_UTF8_H
+#define KNR_COMMON_UTF8_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Columns are counted in display width: a UTF-8 sequence takes the columns of the code point it encodes, 2 for wide
+// East Asian characters and emoji and 0 for combining marks, instead of a column per byte. The width is counted as the
+// bytes come in, so text can be split anywhere: a lead byte counts a column right away and the last byte of its
+// sequence adds the rest of the code point's width, which can be -1. Malformed bytes count a column each, a sequence
+// that gets cut off counts one for its lead byte.
+typedef struct
+{
+    uint32_t code_point; // the bits so far of the sequence in progress
+    int remaining_size; // the continuation bytes that it still needs, 0 between sequences
+} Utf8Decoder;
+
+// A column that is carried over from one piece of text to the next, together with the sequence the last piece ended in
+typedef struct
+{
+    size_t column; // 0-based
+    Utf8Decoder utf8_decoder;
+} DisplayColumn;
+
+#define UTF8_ASCII_BLOCK_SIZE 64
+
+Utf8Decoder make_utf8_decoder();
+// The decoder after the bytes right before `text`, of which `readable_before_size` can be looked at, for text that
+// starts partway through a larger one
+Utf8Decoder make_utf8_decoder_before(char* text, size_t readable_before_size);
+bool are_utf8_decoders_equal(Utf8Decoder left, Utf8Decoder right);
+DisplayColumn make_display_column(size_t column);
+int get_code_point_width(uint32_t code_point);
+int advance_utf8_decoder_over_non_ascii(Utf8Decoder* decoder, unsigned char byte);
+// The display width of text without tabs and newlines
+ptrdiff_t get_display_width(Utf8Decoder* decoder, char* text, size_t size);
+
+// How many columns a byte other than a tab or a newline moves the column by. ASCII stays a column per byte.
+inline int advance_utf8_decoder(Utf8Decoder* decoder, unsigned char byte)
+{
+    if (byte < 0x80)
+    {
+        decoder->remaining_size = 0;
+        return 1;
+    }
+    return advance_utf8_decoder_over_non_ascii(decoder, byte);
+}
+
+// Whether the `UTF8_ASCII_BLOCK_SIZE` bytes at `block` are all ASCII, in which case they are a column each
+#if defined(__SSE2__)
+inline bool is_ascii_block(char* block)
+{
+    __m128i bytes = _mm_or_si128(
+        _mm_or_si128(_mm_loadu_si128((__m128i*)block), _mm_loadu_si128((__m128i*)(block + 16))),
+        _mm_or_si128(_mm_loadu_si128((__m128i*)(block + 32)), _mm_loadu_si128((__m128i*)(block + 48)))
+    );
+    return _mm_movemask_epi8(bytes) == 0;
+}
+#else
+inline bool is_ascii_block(char* block)
+{
+    uint64_t bytes = 0;
+    for (int i = 0; i < UTF8_ASCII_BLOCK_SIZE; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, block + i, sizeof(word));
+        bytes |= word;
+    }
+    return (bytes & 0x8080808080808080ULL) == 0;
+}
+#endif
+
+#endif
@@ -0,0 +1,43 @@
+#include "fuzz.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+char* copy_fuzz_input(const uint8_t* data, size_t size)
+{
+    char* result = malloc(size == 0 ? 1 : size);
+    if (size > 0) { memcpy(result, data, size); }
+    return result;
+}
+
+// FNV-1a, never zero since xorshift would get stuck there
+uint64_t seed_fuzz_random(const uint8_t* data, size_t size)
+{
+    uint64_t result = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; i++) { result = (result ^ data[i]) * 1099511628211ULL; }
+    return result == 0 ? 1 : result;
+}
+
+void report_fuzz_mismatch(char* engine, char* expected, char* actual)
+{
+    fprintf(stderr, "%s differs from the reference: expected `%s`; got `%s`\n", engine, expected, actual);
+    abort();
+}
+
+void check_fuzz_output(char* engine, char* expected, size_t expected_size, char* actual, size_t actual_size)
+{
+    if (actual_size == expected_size && (actual_size == 0 || memcmp(actual, expected, actual_size) == 0)) { return; }
+    size_t difference_i = 0;
+    while (difference_i < expected_size && difference_i < actual_size && actual[difference_i] == expected[difference_i])
+    { difference_i++; }
+    fprintf(
+        stderr,
+        "%s differs from the reference at byte %zu, with %zu bytes instead of %zu\n",
+        engine,
+        difference_i,
+        actual_size,
+        expected_size
+    );
+    abort();
+}
@@ -0,0 +1,26 @@
+#ifndef KNR_FUZZ_H
+#define KNR_FUZZ_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../common/testing.h"
+
+// Every fuzzer compares the optimized engines with the plain reference one on the same input and aborts on the first
+// difference, so that the fuzzer keeps the input. Splits, chunk counts and the like are picked at random, seeded from
+// the input, so that running an input again does the same thing.
+
+// Larger inputs are skipped, they only make the fuzzers slower without reaching anything new
+#define FUZZ_MAX_INPUT_SIZE (1024 * 1024)
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+
+// An exactly sized copy, so that reading past the input is caught by sanitizers
+char* copy_fuzz_input(const uint8_t* data, size_t size);
+uint64_t seed_fuzz_random(const uint8_t* data, size_t size);
+void report_fuzz_mismatch(char* engine, char* expected, char* actual);
+// Reports a mismatch unless the outputs are equal
+void check_fuzz_output(char* engine, char* expected, size_t expected_size, char* actual, size_t actual_size);
+
+#endif
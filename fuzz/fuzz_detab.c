@@ -0,0 +1,99 @@
+/*
+Differential fuzzer for detab. The byte-at-a-time expansion is the reference for every type of tab stops, and the block
+kernel with every available block scanner, streaming in random splits and writing out with `writev` all have to give
+the same bytes.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fuzz.h"
+#include "../1-20/detab.h"
+
+#ifdef DETAB_HAS_WRITEV
+#include <unistd.h>
+
+// One file for all the inputs, emptied before each of them
+FILE* zero_copy_output_file_handle = NULL;
+
+void check_zero_copy_detab(char* input, size_t input_size, TabStops* tab_stops, char* expected, size_t expected_size)
+{
+    if (zero_copy_output_file_handle == NULL) { zero_copy_output_file_handle = tmpfile(); }
+    int file_descriptor = fileno(zero_copy_output_file_handle);
+    if (ftruncate(file_descriptor, 0) != 0 || lseek(file_descriptor, 0, SEEK_SET) != 0)
+    { printf("Failed to empty the output file\n"); exit(1); }
+    detab_to_descriptor(input, input_size, tab_stops, file_descriptor);
+    char* output = malloc(expected_size + 1);
+    ssize_t output_size = pread(file_descriptor, output, expected_size + 1, 0);
+    check_fuzz_output("Zero-copy detab", expected, expected_size, output, output_size < 0 ? 0 : (size_t)output_size);
+    free(output);
+}
+#endif
+
+// In random splits, or in one piece without a random state
+OutputBuffer detab_in_splits(char* input, size_t input_size, TabStops* tab_stops, uint64_t* random_state)
+{
+    OutputBuffer result = make_output_buffer(NULL);
+    DetabState state = make_detab_state(tab_stops);
+    for (size_t offset = 0; offset < input_size;)
+    {
+        size_t remaining_size = input_size - offset;
+        size_t split_size = random_state == NULL ? remaining_size : 1 + get_random_number(random_state) % 300;
+        if (split_size > remaining_size) { split_size = remaining_size; }
+        detab_chunk(&state, input + offset, split_size, &result);
+        offset += split_size;
+    }
+    return result;
+}
+
+void check_detab(char* input, size_t input_size, TabStops* tab_stops, uint64_t* random_state)
+{
+    char* expected = malloc(input_size * tab_stops->max_distance + 1);
+    DisplayColumn column = make_display_column(0);
+    size_t expected_size = detab_piece_scalar(tab_stops, &column, input, input_size, expected);
+
+    ScanTabBlockFunction scan_tab_block_functions[MAX_SCAN_TAB_BLOCK_FUNCTION_COUNT];
+    char* scan_tab_block_names[MAX_SCAN_TAB_BLOCK_FUNCTION_COUNT];
+    int scan_tab_block_function_count = get_available_scan_tab_block_functions(
+        scan_tab_block_functions,
+        scan_tab_block_names
+    );
+    ScanTabBlockFunction selected_scan_tab_block = select_scan_tab_block_function();
+    for (int i = 0; i < scan_tab_block_function_count; i++)
+    {
+        scan_tab_block = scan_tab_block_functions[i];
+        char engine[64];
+        snprintf(engine, sizeof(engine), "Block kernel with the %s scanner", scan_tab_block_names[i]);
+        OutputBuffer output = detab_in_splits(input, input_size, tab_stops, NULL);
+        check_fuzz_output(engine, expected, expected_size, output.data, output.size);
+        deallocate_output_buffer(output);
+    }
+    scan_tab_block = selected_scan_tab_block;
+
+    OutputBuffer output = detab_in_splits(input, input_size, tab_stops, random_state);
+    check_fuzz_output("Detab in random splits", expected, expected_size, output.data, output.size);
+    deallocate_output_buffer(output);
+
+#ifdef DETAB_HAS_WRITEV
+    check_zero_copy_detab(input, input_size, tab_stops, expected, expected_size);
+#endif
+    free(expected);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    if (size > FUZZ_MAX_INPUT_SIZE) { return 0; }
+    char* input = copy_fuzz_input(data, size);
+    uint64_t random_state = seed_fuzz_random(data, size);
+    // every type of tab stops, including a list with a tab wider than the kernel's spaces
+    char* tab_stops_texts[] = {"4", "8", "1", "3", "20", "2,5,13", "1,2,40,41"};
+    for (size_t i = 0; i < sizeof(tab_stops_texts) / sizeof(tab_stops_texts[0]); i++)
+    {
+        TabStops tab_stops = parse_tab_stops(tab_stops_texts[i]);
+        check_detab(input, size, &tab_stops, &random_state);
+        deallocate_tab_stops(tab_stops);
+    }
+    free(input);
+    return 0;
+}
@@ -0,0 +1,143 @@
+/*
+Differential fuzzer for retabbing. The reference goes through the input a byte at a time, counting columns by display
+width, and finds every tab stop the plain way. The kernels specialized for each type of output tab stops, retabbing in
+chunks on several threads and retabbing in random splits of whole lines all have to give the same bytes, which also
+have to expand to the same text as the input.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "fuzz.h"
+#include "../1-21/entab.h"
+#include "../common/utf8.h"
+
+// Tabs up to every output stop that a run of blanks reaches, except past the last listed stop, and spaces for the rest
+char* retab_plainly(
+    char* input,
+    size_t input_size,
+    TabStops* input_tab_stops,
+    TabStops* output_tab_stops,
+    size_t* result_size
+)
+{
+    char* result = malloc(input_size * input_tab_stops->max_distance + 1);
+    *result_size = 0;
+    size_t column = 0;
+    Utf8Decoder utf8_decoder = make_utf8_decoder();
+    for (size_t i = 0; i < input_size;)
+    {
+        if (input[i] != ' ' && input[i] != '\t')
+        {
+            result[(*result_size)++] = input[i];
+            int width = advance_utf8_decoder(&utf8_decoder, (unsigned char)input[i]);
+            column = input[i] == '\n' ? 0 : column + width;
+            i++;
+            continue;
+        }
+        utf8_decoder = make_utf8_decoder();
+        size_t blanks_start_column = column;
+        for (; i < input_size && (input[i] == ' ' || input[i] == '\t'); i++)
+        { column = input[i] == ' ' ? column + 1 : get_next_tab_stop(input_tab_stops, column); }
+        size_t j = blanks_start_column;
+        while (
+            output_tab_stops != NULL
+                && get_next_tab_stop(output_tab_stops, j) <= column
+                && (output_tab_stops->type != TabStopsTypeList || j < output_tab_stops->last_stop)
+        )
+        {
+            result[(*result_size)++] = '\t';
+            j = get_next_tab_stop(output_tab_stops, j);
+        }
+        for (; j < column; j++) { result[(*result_size)++] = ' '; }
+    }
+    return result;
+}
+
+void check_retab(
+    char* input,
+    size_t input_size,
+    TabStops* input_tab_stops,
+    TabStops* output_tab_stops,
+    uint64_t* random_state
+)
+{
+    size_t expected_size;
+    char* expected = retab_plainly(input, input_size, input_tab_stops, output_tab_stops, &expected_size);
+
+    char* output = malloc(input_size * input_tab_stops->max_distance + 1);
+    size_t output_size = select_retab_lines_function(output_tab_stops)(
+        input_tab_stops,
+        output_tab_stops,
+        input,
+        input_size,
+        output
+    );
+    check_fuzz_output("Specialized retab kernel", expected, expected_size, output, output_size);
+    free(output);
+
+    // the spacing stays the same, and without output tab stops there are no tabs left
+    TabStops* expansion_tab_stops = output_tab_stops == NULL ? input_tab_stops : output_tab_stops;
+    size_t expanded_input_size;
+    char* expanded_input = expand_tabs(input, input_size, input_tab_stops, &expanded_input_size);
+    size_t expanded_output_size;
+    char* expanded_output = expand_tabs(expected, expected_size, expansion_tab_stops, &expanded_output_size);
+    check_fuzz_output(
+        "Expanded retab output",
+        expanded_input,
+        expanded_input_size,
+        expanded_output,
+        expanded_output_size
+    );
+    if (output_tab_stops == NULL && memchr(expected, '\t', expected_size) != NULL)
+    { report_fuzz_mismatch("Retab to spaces", "no tabs", "tabs"); }
+    free(expanded_output);
+    free(expanded_input);
+
+    OutputBuffer parallel_output = make_output_buffer(NULL);
+    size_t chunk_size = 1 + get_random_number(random_state) % 200;
+    int thread_count = 1 + get_random_number(random_state) % 3;
+    retab_in_parallel(input, input_size, input_tab_stops, output_tab_stops, chunk_size, thread_count, &parallel_output);
+    check_fuzz_output("Parallel retab", expected, expected_size, parallel_output.data, parallel_output.size);
+    deallocate_output_buffer(parallel_output);
+
+    // splits after random newlines, like standard input gets retabbed a block of whole lines at a time
+    OutputBuffer split_output = make_output_buffer(NULL);
+    for (size_t offset = 0; offset < input_size;)
+    {
+        size_t split_end = offset + 1 + get_random_number(random_state) % 300;
+        if (split_end > input_size) { split_end = input_size; }
+        while (split_end < input_size && input[split_end - 1] != '\n') { split_end++; }
+        retab_to_output(input + offset, split_end - offset, input_tab_stops, output_tab_stops, &split_output);
+        offset = split_end;
+    }
+    check_fuzz_output("Retab in random splits", expected, expected_size, split_output.data, split_output.size);
+    deallocate_output_buffer(split_output);
+    free(expected);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    if (size > FUZZ_MAX_INPUT_SIZE) { return 0; }
+    char* input = copy_fuzz_input(data, size);
+    uint64_t random_state = seed_fuzz_random(data, size);
+    char* tab_stops_texts[] = {"4", "8", "1", "3", "2,5,13", "1,2,40,41"};
+    int tab_stops_count = sizeof(tab_stops_texts) / sizeof(tab_stops_texts[0]);
+    // entabbing, retabbing to spaces only, and retabbing between two random sets of tab stops
+    for (int round_i = 0; round_i < 4; round_i++)
+    {
+        int input_tab_stops_i = get_random_number(&random_state) % tab_stops_count;
+        int output_tab_stops_i = round_i == 0
+            ? input_tab_stops_i
+            : (int)(get_random_number(&random_state) % tab_stops_count);
+        TabStops input_tab_stops = parse_tab_stops(tab_stops_texts[input_tab_stops_i]);
+        TabStops output_tab_stops = parse_tab_stops(tab_stops_texts[output_tab_stops_i]);
+        check_retab(input, size, &input_tab_stops, round_i == 1 ? NULL : &output_tab_stops, &random_state);
+        deallocate_tab_stops(output_tab_stops);
+        deallocate_tab_stops(input_tab_stops);
+    }
+    free(input);
+    return 0;
+}
@@ -0,0 +1,169 @@
+/*
+Differential fuzzer for the validator. Feeding the source a byte at a time without the block scanner is the reference.
+Validating with every available block scanner, streaming with random splits, validating in parallel, validating with a
+reused state and revalidating incrementally after a random edit all have to give the same result, recovery mode has to
+report the same errors as it does a byte at a time however the source is split, and the line index has to agree with
+counting lines and characters from the start.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fuzz.h"
+#include "../1-24/validation.h"
+
+void check_validation_result(char* engine, ValidationResult expected, ValidationResult actual)
+{
+    if (are_validation_results_equal(expected, actual)) { return; }
+    report_fuzz_mismatch(engine, validation_result_to_string(expected), validation_result_to_string(actual));
+}
+
+ValidationResult validate_in_random_splits(char* source, size_t source_size, uint64_t* random_state)
+{
+    ValidationState state = make_validation_state();
+    for (size_t offset = 0; offset < source_size;)
+    {
+        size_t remaining_size = source_size - offset;
+        size_t split_size = 1 + get_random_number(random_state) % 300;
+        if (split_size > remaining_size) { split_size = remaining_size; }
+        if (!feed_validation_state(&state, source + offset, split_size)) { break; }
+        offset += split_size;
+    }
+    return finish_validation(&state);
+}
+
+void check_recovery(char* source, size_t source_size, uint64_t* random_state)
+{
+    ValidationState reference_state = make_recovering_validation_state(DEFAULT_MAX_RECOVERED_ERROR_COUNT);
+    feed_validation_state_bytewise(&reference_state, source, source_size);
+    ValidationResultList expected = finish_validation_with_recovery(&reference_state);
+    ValidationState state = make_recovering_validation_state(DEFAULT_MAX_RECOVERED_ERROR_COUNT);
+    for (size_t offset = 0; offset < source_size;)
+    {
+        size_t remaining_size = source_size - offset;
+        size_t split_size = 1 + get_random_number(random_state) % 300;
+        if (split_size > remaining_size) { split_size = remaining_size; }
+        if (!feed_validation_state(&state, source + offset, split_size)) { break; }
+        offset += split_size;
+    }
+    ValidationResultList actual = finish_validation_with_recovery(&state);
+    if (actual.size != expected.size || actual.is_truncated != expected.is_truncated)
+    {
+        char expected_size[32];
+        char actual_size[32];
+        snprintf(expected_size, sizeof(expected_size), "%d errors", expected.size);
+        snprintf(actual_size, sizeof(actual_size), "%d errors", actual.size);
+        report_fuzz_mismatch("Recovery in random splits", expected_size, actual_size);
+    }
+    for (int i = 0; i < expected.size; i++)
+    { check_validation_result("Recovery in random splits", expected.data[i], actual.data[i]); }
+    deallocate_validation_result_list(actual);
+    deallocate_validation_result_list(expected);
+}
+
+void check_incremental_validation(char* source, size_t source_size, ValidationResult expected, uint64_t* random_state)
+{
+    size_t checkpoint_interval = 1 + get_random_number(random_state) % 512;
+    IncrementalValidation validation = make_incremental_validation(source, source_size, checkpoint_interval);
+    check_validation_result("Incremental validation", expected, validation.result);
+
+    // replaces a random range with random bytes of the source
+    size_t edit_offset = get_random_number(random_state) % (source_size + 1);
+    size_t removed_size = get_random_number(random_state) % (source_size - edit_offset + 1);
+    size_t inserted_size = get_random_number(random_state) % 16;
+    size_t edited_source_size = source_size - removed_size + inserted_size;
+    char* edited_source = malloc(edited_source_size == 0 ? 1 : edited_source_size);
+    memcpy(edited_source, source, edit_offset);
+    for (size_t i = 0; i < inserted_size; i++)
+    {
+        edited_source[edit_offset + i] = source_size == 0
+            ? '{'
+            : source[get_random_number(random_state) % source_size];
+    }
+    memcpy(
+        edited_source + edit_offset + inserted_size,
+        source + edit_offset + removed_size,
+        source_size - edit_offset - removed_size
+    );
+    revalidate_after_edit(edited_source, edited_source_size, edit_offset, removed_size, inserted_size, &validation);
+    check_validation_result(
+        "Incremental validation after an edit",
+        validate_in_chunks(edited_source, edited_source_size, 1),
+        validation.result
+    );
+    free(edited_source);
+    deallocate_incremental_validation(validation);
+}
+
+// Random offsets have to map to the line and character that counting from the start gives
+void check_line_index(char* source, size_t source_size, uint64_t* random_state)
+{
+    LineIndex index = make_line_index(source, source_size);
+    for (int i = 0; i < 16; i++)
+    {
+        size_t offset = get_random_number(random_state) % (source_size + 1);
+        int line = 1;
+        int character = 1;
+        Utf8Decoder utf8_decoder = make_utf8_decoder();
+        for (size_t j = 0; j < offset; j++)
+        {
+            if (source[j] != '\n') { character += advance_utf8_decoder(&utf8_decoder, (unsigned char)source[j]); }
+            else
+            {
+                line++;
+                character = 1;
+                utf8_decoder = make_utf8_decoder();
+            }
+        }
+        SourcePosition position = get_source_position(&index, source, offset);
+        if (position.line != line || position.character != character)
+        {
+            char expected[64];
+            char actual[64];
+            snprintf(expected, sizeof(expected), "%d:%d", line, character);
+            snprintf(actual, sizeof(actual), "%d:%d", position.line, position.character);
+            report_fuzz_mismatch("Line index", expected, actual);
+        }
+    }
+    deallocate_line_index(index);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    if (size > FUZZ_MAX_INPUT_SIZE) { return 0; }
+    char* source = copy_fuzz_input(data, size);
+    uint64_t random_state = seed_fuzz_random(data, size);
+    ValidationState reference_state = make_validation_state();
+    feed_validation_state_bytewise(&reference_state, source, size);
+    ValidationResult expected = finish_validation(&reference_state);
+
+    ScanBlockFunction scan_block_functions[MAX_SCAN_BLOCK_FUNCTION_COUNT];
+    char* scan_block_names[MAX_SCAN_BLOCK_FUNCTION_COUNT];
+    int scan_block_function_count = get_available_scan_block_functions(scan_block_functions, scan_block_names);
+    ScanBlockFunction selected_scan_block = select_scan_block_function();
+    ValidationState reused_state = make_validation_state();
+    for (int i = 0; i < scan_block_function_count; i++)
+    {
+        scan_block = scan_block_functions[i];
+        char engine[64];
+        snprintf(engine, sizeof(engine), "Whole validation with the %s scanner", scan_block_names[i]);
+        check_validation_result(engine, expected, validate_in_chunks(source, size, size == 0 ? 1 : size));
+        snprintf(engine, sizeof(engine), "Streaming with the %s scanner", scan_block_names[i]);
+        check_validation_result(engine, expected, validate_in_random_splits(source, size, &random_state));
+        snprintf(engine, sizeof(engine), "Parallel validation with the %s scanner", scan_block_names[i]);
+        int chunk_count = 1 + get_random_number(&random_state) % 8;
+        int thread_count = 1 + get_random_number(&random_state) % 3;
+        check_validation_result(engine, expected, validate_in_parallel(source, size, chunk_count, thread_count));
+        snprintf(engine, sizeof(engine), "Reused state with the %s scanner", scan_block_names[i]);
+        check_validation_result(engine, expected, validate_reusing_state(&reused_state, source, size));
+    }
+    deallocate_validation_state(reused_state);
+    scan_block = selected_scan_block;
+
+    check_line_index(source, size, &random_state);
+    check_recovery(source, size, &random_state);
+    check_incremental_validation(source, size, expected, &random_state);
+    free(source);
+    return 0;
+}
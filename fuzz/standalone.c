@@ -0,0 +1,57 @@
+/*
+Runs a fuzzer on files instead of generated inputs, for builds without libFuzzer. Every file argument is an input and
+every directory argument a corpus of them; without arguments the input is read from standard input, which is how AFL
+runs a program.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "fuzz.h"
+#include "../common/input.h"
+
+int run_fuzz_input(char* path)
+{
+    InputView input = strcmp(path, "-") == 0
+        ? open_input_view_from_descriptor(0, "standard input")
+        : open_input_view(path);
+    LLVMFuzzerTestOneInput((uint8_t*)input.data, input.size);
+    close_input_view(input);
+    return 1;
+}
+
+int run_fuzz_corpus(char* directory_path)
+{
+    DIR* directory = opendir(directory_path);
+    if (directory == NULL) { printf("Failed to open directory '%s'\n", directory_path); exit(1); }
+    int result = 0;
+    struct dirent* entry;
+    while ((entry = readdir(directory)) != NULL)
+    {
+        size_t path_size = strlen(directory_path) + strlen(entry->d_name) + 2;
+        char* path = malloc(path_size);
+        snprintf(path, path_size, "%s/%s", directory_path, entry->d_name);
+        struct stat path_stat;
+        if (stat(path, &path_stat) == 0 && S_ISREG(path_stat.st_mode)) { result += run_fuzz_input(path); }
+        free(path);
+    }
+    closedir(directory);
+    return result;
+}
+
+int main(int argument_count, char** arguments)
+{
+    if (argument_count == 1) { run_fuzz_input("-"); return 0; }
+    int input_count = 0;
+    for (int i = 1; i < argument_count; i++)
+    {
+        struct stat path_stat;
+        bool is_directory = stat(arguments[i], &path_stat) == 0 && S_ISDIR(path_stat.st_mode);
+        input_count += is_directory ? run_fuzz_corpus(arguments[i]) : run_fuzz_input(arguments[i]);
+    }
+    printf("All %d inputs matched the reference\n", input_count);
+    return 0;
+}